@@ -0,0 +1,291 @@
+#include "PreCompile.h"
+#include "AsyncLoader.h"        // Pick up forward declarations to ensure correctness.
+#include "Bitmap.h"
+#include "pcx.h"
+#include "PixMap.h"
+#include "targa.h"
+#include <PortableRuntime/CheckException.h>
+
+namespace ImageProcessing
+{
+
+static std::vector<uint8_t> read_file(const std::string& file_name, const std::function<void (size_t)>& reserve_memory)
+{
+    std::ifstream file(file_name, std::ios::in | std::ios::binary | std::ios::ate);
+    CHECK_EXCEPTION(file.good(), u8"Could not open image file.");
+
+    const auto file_size = static_cast<size_t>(file.tellg());
+    file.seekg(0, std::ios::beg);
+
+    // Wait for room in the memory budget before allocating the buffer.
+    reserve_memory(file_size);
+
+    // A blocking read.  Reads are overlapped by running max_outstanding_reads of them on separate threads.
+    std::vector<uint8_t> file_data(file_size);
+    file.read(reinterpret_cast<char*>(file_data.data()), file_size);
+    CHECK_EXCEPTION(file.good(), u8"Could not read image file.");
+
+    return file_data;
+}
+
+static Bitmap decode_bitmap_from_file_data(const std::string& file_name, const std::vector<uint8_t>& file_data, bool is_preview, unsigned int preview_size)
+{
+    if(is_pcx_file_name(file_name.c_str()))
+    {
+        return is_preview ? decode_preview_from_pcx_memory(file_data.data(), file_data.size(), preview_size) :
+                            decode_bitmap_from_pcx_memory(file_data.data(), file_data.size());
+    }
+    else if(is_tga_file_name(file_name.c_str()))
+    {
+        return is_preview ? decode_preview_from_tga_memory(file_data.data(), file_data.size(), preview_size) :
+                            decode_bitmap_from_tga_memory(file_data.data(), file_data.size());
+    }
+
+    CHECK_EXCEPTION(is_pixmap_file_name(file_name.c_str()), u8"Image format is not supported.");
+    return is_preview ? decode_preview_from_pixmap_memory(file_data.data(), file_data.size(), preview_size) :
+                        decode_bitmap_from_pixmap_memory(file_data.data(), file_data.size());
+}
+
+// Returns a completion that fulfills future.
+static Async_bitmap_loader::Completion make_promise_completion(_Out_ std::future<Bitmap>* future)
+{
+    auto promise = std::make_shared<std::promise<Bitmap>>();
+    *future = promise->get_future();
+
+    return [promise](std::exception_ptr exception, Bitmap&& bitmap)
+    {
+        if(exception)
+        {
+            promise->set_exception(exception);
+        }
+        else
+        {
+            promise->set_value(std::move(bitmap));
+        }
+    };
+}
+
+Async_bitmap_loader::Async_bitmap_loader(const Async_loader_options& options) :
+    m_options(options),
+    m_active_read_count(0),
+    m_reserved_memory(0),
+    m_stopping(false)
+{
+    CHECK_EXCEPTION(options.max_outstanding_reads > 0, u8"Invalid loader options.");
+    CHECK_EXCEPTION(options.decode_thread_count > 0, u8"Invalid loader options.");
+
+    try
+    {
+        for(size_t ix = 0; ix < options.max_outstanding_reads; ++ix)
+        {
+            m_read_threads.emplace_back(&Async_bitmap_loader::read_thread_proc, this);
+        }
+
+        for(size_t ix = 0; ix < options.decode_thread_count; ++ix)
+        {
+            m_decode_threads.emplace_back(&Async_bitmap_loader::decode_thread_proc, this);
+        }
+    }
+    catch(...)
+    {
+        stop();
+        throw;
+    }
+}
+
+Async_bitmap_loader::~Async_bitmap_loader()
+{
+    stop();
+}
+
+void Async_bitmap_loader::stop() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+
+    m_read_ready.notify_all();
+
+    // Decode threads may only exit once the read threads can no longer produce work.
+    for(auto& thread : m_read_threads)
+    {
+        thread.join();
+    }
+    m_read_threads.clear();
+
+    m_decode_ready.notify_all();
+    for(auto& thread : m_decode_threads)
+    {
+        thread.join();
+    }
+    m_decode_threads.clear();
+}
+
+std::future<Bitmap> Async_bitmap_loader::load(const std::string& file_name)
+{
+    std::future<Bitmap> future;
+    load(file_name, make_promise_completion(&future));
+    return future;
+}
+
+void Async_bitmap_loader::load(const std::string& file_name, Completion completion)
+{
+    queue_read(Read_request{file_name, false, 0, std::move(completion)});
+}
+
+std::future<Bitmap> Async_bitmap_loader::load_preview(const std::string& file_name, unsigned int preview_size)
+{
+    std::future<Bitmap> future;
+    load_preview(file_name, preview_size, make_promise_completion(&future));
+    return future;
+}
+
+void Async_bitmap_loader::load_preview(const std::string& file_name, unsigned int preview_size, Completion completion)
+{
+    queue_read(Read_request{file_name, true, preview_size, std::move(completion)});
+}
+
+void Async_bitmap_loader::queue_read(Read_request&& request)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        assert(!m_stopping);
+        m_read_queue.push_back(std::move(request));
+    }
+
+    m_read_ready.notify_one();
+}
+
+void Async_bitmap_loader::reserve_memory(size_t size)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // A file larger than the entire budget is allowed through once nothing else is reserved,
+    // otherwise it could never be loaded.
+    m_memory_available.wait(lock, [this, size]()
+    {
+        return (m_reserved_memory == 0) || (m_reserved_memory + size <= m_options.memory_budget);
+    });
+
+    m_reserved_memory += size;
+}
+
+void Async_bitmap_loader::release_memory(size_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        assert(m_reserved_memory >= size);
+        m_reserved_memory -= size;
+    }
+
+    m_memory_available.notify_all();
+}
+
+void Async_bitmap_loader::read_thread_proc()
+{
+    for(;;)
+    {
+        Read_request request;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_read_ready.wait(lock, [this]()
+            {
+                return m_stopping || !m_read_queue.empty();
+            });
+
+            if(m_read_queue.empty())
+            {
+                // Stopping, and all requests have been read.
+                break;
+            }
+
+            request = std::move(m_read_queue.front());
+            m_read_queue.pop_front();
+            ++m_active_read_count;
+        }
+
+        size_t reserved_size = 0;
+        std::vector<uint8_t> file_data;
+        std::exception_ptr exception;
+        try
+        {
+            file_data = read_file(request.file_name, [this, &reserved_size](size_t size)
+            {
+                reserve_memory(size);
+                reserved_size = size;
+            });
+        }
+        catch(...)
+        {
+            exception = std::current_exception();
+        }
+
+        if(exception)
+        {
+            release_memory(reserved_size);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                --m_active_read_count;
+            }
+            m_decode_ready.notify_all();
+
+            request.completion(exception, Bitmap());
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_decode_queue.push_back(Decode_request{std::move(request.file_name), request.is_preview, request.preview_size,
+                                                    std::move(request.completion), std::move(file_data)});
+            --m_active_read_count;
+        }
+
+        m_decode_ready.notify_one();
+    }
+}
+
+void Async_bitmap_loader::decode_thread_proc()
+{
+    for(;;)
+    {
+        Decode_request request;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_decode_ready.wait(lock, [this]()
+            {
+                return !m_decode_queue.empty() || (m_stopping && m_read_queue.empty() && (m_active_read_count == 0));
+            });
+
+            if(m_decode_queue.empty())
+            {
+                // Stopping, and no more file data can arrive.
+                break;
+            }
+
+            request = std::move(m_decode_queue.front());
+            m_decode_queue.pop_front();
+        }
+
+        Bitmap bitmap;
+        std::exception_ptr exception;
+        try
+        {
+            bitmap = decode_bitmap_from_file_data(request.file_name, request.file_data, request.is_preview, request.preview_size);
+        }
+        catch(...)
+        {
+            exception = std::current_exception();
+        }
+
+        // Free the file data before the completion runs so the next read can proceed.
+        const size_t file_size = request.file_data.size();
+        request.file_data = std::vector<uint8_t>();
+        release_memory(file_size);
+
+        request.completion(exception, std::move(bitmap));
+    }
+}
+
+}
+
@@ -0,0 +1,82 @@
+#pragma once
+
+namespace ImageProcessing
+{
+
+struct Async_loader_options
+{
+    size_t max_outstanding_reads;       // Number of file reads in flight at once.
+    size_t memory_budget;               // Bytes of file data that may be held while waiting for decode.
+    size_t decode_thread_count;         // Number of threads decoding file data into Bitmaps.
+};
+
+// Loads image files on background threads.  File reads are overlapped with decoding so that neither the
+// disk nor the CPU sits idle, and file data awaiting decode is bounded by the memory budget.
+// Files are decoded based on their extension (.pcx, .tga, .pbm, .pgm, .ppm).
+// Each outstanding read is a blocking read on its own thread.  Kernel asynchronous I/O (io_uring on Linux,
+// overlapped reads on Windows) is not used, so max_outstanding_reads also sets the number of reader threads.
+class Async_bitmap_loader
+{
+public:
+    typedef std::function<void (std::exception_ptr, struct Bitmap&&)> Completion;
+
+    explicit Async_bitmap_loader(const Async_loader_options& options);
+
+    // Waits for all queued loads to complete.
+    ~Async_bitmap_loader();
+
+    Async_bitmap_loader(const Async_bitmap_loader&) = delete;
+    Async_bitmap_loader& operator=(const Async_bitmap_loader&) = delete;
+
+    std::future<struct Bitmap> load(const std::string& file_name);
+
+    // The completion is called on a loader thread with either an exception or the decoded Bitmap.
+    void load(const std::string& file_name, Completion completion);
+
+    // Loads a reduced size image for display as a thumbnail.  See the decode_preview_from_*_memory functions.
+    std::future<struct Bitmap> load_preview(const std::string& file_name, unsigned int preview_size);
+    void load_preview(const std::string& file_name, unsigned int preview_size, Completion completion);
+
+private:
+    struct Read_request
+    {
+        std::string file_name;
+        bool is_preview;
+        unsigned int preview_size;
+        Completion completion;
+    };
+
+    struct Decode_request
+    {
+        std::string file_name;
+        bool is_preview;
+        unsigned int preview_size;
+        Completion completion;
+        std::vector<uint8_t> file_data;
+    };
+
+    void queue_read(Read_request&& request);
+    void stop() noexcept;
+    void read_thread_proc();
+    void decode_thread_proc();
+    void reserve_memory(size_t size);
+    void release_memory(size_t size);
+
+    const Async_loader_options m_options;
+
+    std::mutex m_mutex;
+    std::condition_variable m_read_ready;
+    std::condition_variable m_decode_ready;
+    std::condition_variable m_memory_available;
+    std::deque<Read_request> m_read_queue;
+    std::deque<Decode_request> m_decode_queue;
+    size_t m_active_read_count;
+    size_t m_reserved_memory;
+    bool m_stopping;
+
+    std::vector<std::thread> m_read_threads;
+    std::vector<std::thread> m_decode_threads;
+};
+
+}
+
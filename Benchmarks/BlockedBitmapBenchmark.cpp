@@ -0,0 +1,96 @@
+#include "PreCompile.h"
+#include "Bitmap.h"
+#include "BlockedBitmap.h"
+#include "Filter.h"
+#include "Geometry.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+// Compares the blocked layout with the linear layout for the operations that have blocked versions.  Blocked
+// times are given without and with the conversions to and from the blocked layout.  Each time is the best of
+// several runs.
+//
+// 4000x3000 Rgb image, GCC 12 -O2, one core of a 2.1 GHz Xeon with AVX-512, median of three runs of the
+// benchmark, in milliseconds:
+//
+//                                      Linear  Blocked  With conversions
+// Box filter, 3 taps                       51       72      133
+// Box filter, 5 taps                       99      119      204
+// Box filter, 9 taps                      412      321      401
+// Box filter, 15 taps                    1030      957      948
+// Area averaged resize to 1/3              30       45       85
+// Rotate 90                                54       61      139
+//
+// Run to run variation is about 10%, and more for the conversions.  Small filters and the resize are slower on
+// the blocked layout, because each region is read into a padded copy before it is filtered: the row kernels
+// need longer runs of contiguous pixels than a block row.  Filters of nine or more taps are 5-20% faster when
+// the image stays blocked, and about break even when the conversions are included.  Rotation does not gain.
+
+namespace ImageProcessing
+{
+
+template<typename Operation>
+static double time_best_of(const Operation& operation)
+{
+    double best = 0.0;
+    for(int run = 0; run < 3; ++run)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        operation();
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        best = (run == 0) ? elapsed.count() : std::min(best, elapsed.count());
+    }
+
+    return best;
+}
+
+template<typename Linear_operation, typename Blocked_operation>
+static void compare(const char* name, const Bitmap& bitmap, const Linear_operation& linear_operation, const Blocked_operation& blocked_operation)
+{
+    const Blocked_bitmap blocked_bitmap = make_blocked_bitmap(bitmap);
+
+    const double linear = time_best_of([&]() { linear_operation(bitmap); });
+    const double blocked = time_best_of([&]() { blocked_operation(blocked_bitmap); });
+    const double converted = time_best_of([&]() { make_bitmap_from_blocked_bitmap(blocked_operation(make_blocked_bitmap(bitmap))); });
+
+    std::printf("%-36s %8.0f %8.0f %8.0f\n", name, linear, blocked, converted);
+}
+
+static void run_benchmark()
+{
+    const unsigned int width = 4000;
+    const unsigned int height = 3000;
+    std::mt19937 generator(39);
+    Bitmap bitmap{std::vector<uint8_t>(static_cast<size_t>(width) * height * sizeof(Color_rgb)), width, height, true};
+    std::generate(bitmap.bitmap.begin(), bitmap.bitmap.end(), [&generator]() { return static_cast<uint8_t>(generator()); });
+
+    std::printf("%-36s %8s %8s %8s\n", "", "Linear", "Blocked", "With conversions");
+    for(const unsigned int dimension : {3u, 5u, 9u, 15u})
+    {
+        char name[64];
+        std::snprintf(name, sizeof(name), "Box filter, %u taps", dimension);
+
+        const auto filter = generate_simple_box_filter(dimension);
+        compare(name, bitmap,
+                [&filter, dimension](const Bitmap& source) { return apply_box_filter(filter, dimension, source, Blend_space::Srgb); },
+                [&filter, dimension](const Blocked_bitmap& source) { return apply_box_filter(filter, dimension, source, Blend_space::Srgb); });
+    }
+
+    compare("Area averaged resize to 1/3", bitmap,
+            [](const Bitmap& source) { return resize_bitmap_area_averaged(source, source.width / 3, source.height / 3, Blend_space::Srgb); },
+            [](const Blocked_bitmap& source) { return resize_bitmap_area_averaged(source, source.width() / 3, source.height() / 3, Blend_space::Srgb); });
+
+    compare("Rotate 90", bitmap,
+            [](const Bitmap& source) { return rotate_bitmap_90(source); },
+            [](const Blocked_bitmap& source) { return rotate_bitmap_90(source); });
+}
+
+}
+
+int main()
+{
+    ImageProcessing::run_benchmark();
+    return EXIT_SUCCESS;
+}
+
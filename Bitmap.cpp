@@ -1,5 +1,11 @@
 #include "PreCompile.h"
 #include "Bitmap.h"         // Pick up forward declarations to ensure correctness.
+#include "BlockedBitmap.h"
+#include "CpuDispatch.h"
+#include "Gamma.h"
+#include "Parallel.h"
+#include "PixelKernels.h"
+#include "TiledBitmap.h"
 #include "pcx.h"
 #include "targa.h"
 
@@ -36,23 +42,75 @@ static void generate_grid_texture_rgb(
 }
 #endif
 
+// Rectangle of an image held in a buffer whose rows are stride pixels apart.  The pixel at image
+// coordinates (x, y) is pixels[(y - top) * stride + (x - left)].  Resizes read and write through
+// windows so that the same code scales whole images and the blocks of tiled images.
+template<typename Pixel>
+struct Image_window
+{
+    Pixel* pixels;
+    size_t stride;
+    unsigned int left;
+    unsigned int top;
+    unsigned int right;
+    unsigned int bottom;
+};
+
+// Unscaled coordinate sampled by a scaled coordinate for point sampling.
+static unsigned int get_point_sample(unsigned int unscaled_size, unsigned int scaled_size, unsigned int scaled_coordinate) noexcept
+{
+    return static_cast<unsigned int>(static_cast<uint64_t>(unscaled_size) * scaled_coordinate / scaled_size);
+}
+
+// Unscaled coordinates [begin, end) covered by a scaled coordinate for area averaging.
+// When upscaling, each scaled pixel covers at least the nearest unscaled pixel.
+static unsigned int get_area_begin(unsigned int unscaled_size, unsigned int scaled_size, unsigned int scaled_coordinate) noexcept
+{
+    return static_cast<unsigned int>(static_cast<uint64_t>(unscaled_size) * scaled_coordinate / scaled_size);
+}
+
+static unsigned int get_area_end(unsigned int unscaled_size, unsigned int scaled_size, unsigned int scaled_coordinate) noexcept
+{
+    return std::max(get_area_begin(unscaled_size, scaled_size, scaled_coordinate) + 1,
+                    static_cast<unsigned int>(static_cast<uint64_t>(unscaled_size) * (scaled_coordinate + 1) / scaled_size));
+}
+
 // Resamples and scales an image using a nearest neighbor algorithm.
-static void resize_bitmap_point_sampled_unchecked(const Color_rgb* unscaled_pixels, unsigned int unscaled_width, unsigned int unscaled_height,
-                                                  Color_rgb* scaled_pixels, unsigned int scaled_width, unsigned int scaled_height) noexcept
+// Samples are copied rather than blended, so there is no need for a linear light variant.
+static void resize_bitmap_point_sampled_unchecked(const Image_window<const Color_rgb>& unscaled, unsigned int unscaled_width, unsigned int unscaled_height,
+                                                  const Image_window<Color_rgb>& scaled, unsigned int scaled_width, unsigned int scaled_height)
 {
-    for(unsigned int scaled_y = 0; scaled_y < scaled_height; ++scaled_y)
+    const Pixel_kernels& kernels = get_pixel_kernels();
+
+    // Every row samples the same columns.
+    const unsigned int scaled_count = scaled.right - scaled.left;
+    std::vector<unsigned int> unscaled_columns(scaled_count);
+    for(unsigned int scaled_x = scaled.left; scaled_x < scaled.right; ++scaled_x)
     {
-        for(unsigned int scaled_x = 0; scaled_x < scaled_width; ++scaled_x)
-        {
-            unsigned int unscaled_x = unscaled_width * scaled_x / scaled_width;
-            unsigned int unscaled_y = unscaled_height * scaled_y / scaled_height;
+        const unsigned int unscaled_x = get_point_sample(unscaled_width, scaled_width, scaled_x);
+        assert((unscaled_x >= unscaled.left) && (unscaled_x < unscaled.right));
+        unscaled_columns[scaled_x - scaled.left] = unscaled_x - unscaled.left;
+    }
 
-            assert(unscaled_x < unscaled_width);
-            assert(unscaled_y < unscaled_height);
+    unsigned int previous_unscaled_y = UINT_MAX;
+    for(unsigned int scaled_y = scaled.top; scaled_y < scaled.bottom; ++scaled_y)
+    {
+        unsigned int unscaled_y = get_point_sample(unscaled_height, scaled_height, scaled_y);
+        assert((unscaled_y >= unscaled.top) && (unscaled_y < unscaled.bottom));
 
-            const Color_rgb color = unscaled_pixels[unscaled_y * unscaled_width + unscaled_x];
-            scaled_pixels[scaled_y * scaled_width + scaled_x] = color;
+        Color_rgb* scaled_row = scaled.pixels + static_cast<size_t>(scaled_y - scaled.top) * scaled.stride;
+        if(unscaled_y == previous_unscaled_y)
+        {
+            // When upscaling, consecutive rows sample the same source row.
+            std::copy(scaled_row - scaled.stride, scaled_row - scaled.stride + scaled_count, scaled_row);
+        }
+        else
+        {
+            kernels.gather_pixels(unscaled.pixels + static_cast<size_t>(unscaled_y - unscaled.top) * unscaled.stride, unscaled.right - unscaled.left,
+                                  unscaled_columns.data(), scaled_row, scaled_count);
         }
+
+        previous_unscaled_y = unscaled_y;
     }
 }
 
@@ -63,10 +121,359 @@ Bitmap resize_bitmap_point_sampled(const Bitmap& unscaled_bitmap, unsigned int s
     auto unscaled_pixels = reinterpret_cast<const Color_rgb*>(&unscaled_bitmap.bitmap[0]);
     auto scaled_pixels = reinterpret_cast<Color_rgb*>(&scaled_bitmap.bitmap[0]);
 
-    resize_bitmap_point_sampled_unchecked(unscaled_pixels, unscaled_bitmap.width, unscaled_bitmap.height, scaled_pixels, scaled_width, scaled_height);
+    resize_bitmap_point_sampled_unchecked({unscaled_pixels, unscaled_bitmap.width, 0, 0, unscaled_bitmap.width, unscaled_bitmap.height},
+                                          unscaled_bitmap.width, unscaled_bitmap.height,
+                                          {scaled_pixels, scaled_width, 0, 0, scaled_width, scaled_height}, scaled_width, scaled_height);
 
     return scaled_bitmap;
 }
 
+// The union is swept from top to bottom.  Between consecutive top and bottom edges, the union is a set of rows
+// that all cover the same x intervals, which are found by merging the intervals of the rectangles that span those
+// rows.  An interval that continues unchanged from the rows above extends the rectangle started there, so a single
+// rectangle comes back whole.  The result covers exactly the union, and the cost grows with the number of
+// rectangles rather than with their area.
+std::vector<Bitmap_rectangle> merge_rectangles(const std::vector<Bitmap_rectangle>& rectangles, unsigned int width, unsigned int height)
+{
+    struct Edge
+    {
+        unsigned int y;
+        unsigned int left;
+        unsigned int right;
+        bool is_top;
+    };
+
+    std::vector<Edge> edges;
+    edges.reserve(rectangles.size() * 2);
+    for(const Bitmap_rectangle& rectangle : rectangles)
+    {
+        const unsigned int left = std::min(rectangle.left, width);
+        const unsigned int top = std::min(rectangle.top, height);
+        const unsigned int right = std::min(rectangle.right, width);
+        const unsigned int bottom = std::min(rectangle.bottom, height);
+        if((left < right) && (top < bottom))
+        {
+            edges.push_back({top, left, right, true});
+            edges.push_back({bottom, left, right, false});
+        }
+    }
+    std::sort(edges.begin(), edges.end(), [](const Edge& first, const Edge& second) { return first.y < second.y; });
+
+    // active holds the x intervals of the rectangles spanning the current rows, sorted.  open holds, for each merged
+    // interval of the rows just above, the index of the rectangle it belongs to in merged.
+    std::vector<std::pair<unsigned int, unsigned int>> active;
+    std::vector<size_t> open;
+    std::vector<size_t> next_open;
+    std::vector<Bitmap_rectangle> merged;
+    for(size_t edge_ix = 0; edge_ix < edges.size();)
+    {
+        const unsigned int top = edges[edge_ix].y;
+        for(; (edge_ix < edges.size()) && (edges[edge_ix].y == top); ++edge_ix)
+        {
+            const std::pair<unsigned int, unsigned int> interval(edges[edge_ix].left, edges[edge_ix].right);
+            const auto position = std::lower_bound(active.begin(), active.end(), interval);
+            if(edges[edge_ix].is_top)
+            {
+                active.insert(position, interval);
+            }
+            else
+            {
+                assert((position != active.end()) && (*position == interval));
+                active.erase(position);
+            }
+        }
+
+        if(active.empty())
+        {
+            open.clear();
+            continue;
+        }
+
+        assert(edge_ix < edges.size());
+        const unsigned int bottom = edges[edge_ix].y;
+        size_t open_ix = 0;
+        next_open.clear();
+        for(size_t active_ix = 0; active_ix < active.size();)
+        {
+            const unsigned int left = active[active_ix].first;
+            unsigned int right = active[active_ix].second;
+            for(++active_ix; (active_ix < active.size()) && (active[active_ix].first <= right); ++active_ix)
+            {
+                right = std::max(right, active[active_ix].second);
+            }
+
+            // Both lists are sorted by left, and the open rectangles all end at top.
+            while((open_ix < open.size()) && (merged[open[open_ix]].left < left))
+            {
+                ++open_ix;
+            }
+
+            if((open_ix < open.size()) && (merged[open[open_ix]].left == left) && (merged[open[open_ix]].right == right))
+            {
+                merged[open[open_ix]].bottom = bottom;
+                next_open.push_back(open[open_ix]);
+            }
+            else
+            {
+                next_open.push_back(merged.size());
+                merged.push_back({left, top, right, bottom});
+            }
+        }
+        open.swap(next_open);
+    }
+
+    // Return value optimization expected.
+    return merged;
+}
+
+// First scaled coordinate whose point sample is at or after unscaled_coordinate.  This is the inverse of
+// get_point_sample, so the scaled pixels that sample [begin, end) are [first(begin), first(end)).
+static unsigned int get_first_point_sampling(unsigned int unscaled_size, unsigned int scaled_size, unsigned int unscaled_coordinate) noexcept
+{
+    return static_cast<unsigned int>((static_cast<uint64_t>(unscaled_coordinate) * scaled_size + unscaled_size - 1) / unscaled_size);
+}
+
+// Each changed rectangle of scaled pixels is split into bands of rows, and the bands of all rectangles are
+// divided between the threads.  Each band is resized by the same code as the whole image.
+void update_resized_bitmap_point_sampled(const Bitmap& unscaled_bitmap, const std::vector<Bitmap_rectangle>& dirty_rectangles, Bitmap& scaled_bitmap)
+{
+    assert(unscaled_bitmap.format == Pixel_format::Rgb);
+    assert(scaled_bitmap.format == Pixel_format::Rgb);
+
+    const unsigned int unscaled_width = unscaled_bitmap.width;
+    const unsigned int unscaled_height = unscaled_bitmap.height;
+    const unsigned int scaled_width = scaled_bitmap.width;
+    const unsigned int scaled_height = scaled_bitmap.height;
+    if((scaled_width == 0) || (scaled_height == 0))
+    {
+        return;
+    }
+    assert((unscaled_width > 0) && (unscaled_height > 0));
+
+    std::vector<Bitmap_rectangle> scaled_rectangles;
+    scaled_rectangles.reserve(dirty_rectangles.size());
+    for(const Bitmap_rectangle& dirty : dirty_rectangles)
+    {
+        scaled_rectangles.push_back({get_first_point_sampling(unscaled_width, scaled_width, std::min(dirty.left, unscaled_width)),
+                                     get_first_point_sampling(unscaled_height, scaled_height, std::min(dirty.top, unscaled_height)),
+                                     get_first_point_sampling(unscaled_width, scaled_width, std::min(dirty.right, unscaled_width)),
+                                     get_first_point_sampling(unscaled_height, scaled_height, std::min(dirty.bottom, unscaled_height))});
+    }
+
+    const unsigned int band_height = 64;
+    std::vector<Bitmap_rectangle> bands;
+    for(const Bitmap_rectangle& rectangle : merge_rectangles(scaled_rectangles, scaled_width, scaled_height))
+    {
+        for(unsigned int top = rectangle.top; top < rectangle.bottom; top += band_height)
+        {
+            bands.push_back({rectangle.left, top, rectangle.right, std::min(top + band_height, rectangle.bottom)});
+        }
+    }
+
+    auto unscaled_pixels = reinterpret_cast<const Color_rgb*>(unscaled_bitmap.bitmap.data());
+    auto scaled_pixels = reinterpret_cast<Color_rgb*>(scaled_bitmap.bitmap.data());
+    parallel_for(bands.size(), 1, [&](size_t band_begin, size_t band_end)
+    {
+        for(size_t band_ix = band_begin; band_ix < band_end; ++band_ix)
+        {
+            const Bitmap_rectangle& band = bands[band_ix];
+            resize_bitmap_point_sampled_unchecked({unscaled_pixels, unscaled_width, 0, 0, unscaled_width, unscaled_height}, unscaled_width, unscaled_height,
+                                                  {scaled_pixels + static_cast<size_t>(band.top) * scaled_width + band.left, scaled_width,
+                                                   band.left, band.top, band.right, band.bottom},
+                                                  scaled_width, scaled_height);
+        }
+    });
+}
+
+// Resamples and scales an image by averaging all unscaled pixels covered by each scaled pixel.
+// When upscaling, each scaled pixel covers at least the nearest unscaled pixel.
+static void resize_bitmap_area_averaged_unchecked(const Image_window<const Color_rgb>& unscaled, unsigned int unscaled_width, unsigned int unscaled_height,
+                                                  const Image_window<Color_rgb>& scaled, unsigned int scaled_width, unsigned int scaled_height,
+                                                  Blend_space blend_space) noexcept
+{
+    const uint16_t* srgb_to_linear_table = get_srgb_to_linear_table();
+    const bool linear = blend_space == Blend_space::Linear;
+
+    // Conversions are applied as each sample is loaded and as each average is stored.
+    const auto load = [srgb_to_linear_table, linear](uint8_t value) -> uint64_t
+    {
+        return linear ? srgb_to_linear_table[value] : value;
+    };
+    const auto store = [linear](uint64_t sum, uint64_t count) -> uint8_t
+    {
+        const uint64_t average = (sum + count / 2) / count;
+        return linear ? linear_to_srgb(static_cast<uint16_t>(average)) : static_cast<uint8_t>(average);
+    };
+
+    for(unsigned int scaled_y = scaled.top; scaled_y < scaled.bottom; ++scaled_y)
+    {
+        const unsigned int unscaled_y_begin = get_area_begin(unscaled_height, scaled_height, scaled_y);
+        const unsigned int unscaled_y_end = get_area_end(unscaled_height, scaled_height, scaled_y);
+
+        for(unsigned int scaled_x = scaled.left; scaled_x < scaled.right; ++scaled_x)
+        {
+            const unsigned int unscaled_x_begin = get_area_begin(unscaled_width, scaled_width, scaled_x);
+            const unsigned int unscaled_x_end = get_area_end(unscaled_width, scaled_width, scaled_x);
+
+            assert((unscaled_x_begin >= unscaled.left) && (unscaled_x_end <= unscaled.right));
+            assert((unscaled_y_begin >= unscaled.top) && (unscaled_y_end <= unscaled.bottom));
+
+            uint64_t red = 0, green = 0, blue = 0;
+            for(unsigned int unscaled_y = unscaled_y_begin; unscaled_y < unscaled_y_end; ++unscaled_y)
+            {
+                const Color_rgb* row = unscaled.pixels + static_cast<size_t>(unscaled_y - unscaled.top) * unscaled.stride;
+                for(unsigned int unscaled_x = unscaled_x_begin - unscaled.left; unscaled_x < unscaled_x_end - unscaled.left; ++unscaled_x)
+                {
+                    red += load(row[unscaled_x].red);
+                    green += load(row[unscaled_x].green);
+                    blue += load(row[unscaled_x].blue);
+                }
+            }
+
+            const uint64_t count = static_cast<uint64_t>(unscaled_y_end - unscaled_y_begin) * (unscaled_x_end - unscaled_x_begin);
+            scaled.pixels[static_cast<size_t>(scaled_y - scaled.top) * scaled.stride + (scaled_x - scaled.left)] =
+                Color_rgb(store(red, count), store(green, count), store(blue, count));
+        }
+    }
+}
+
+Bitmap resize_bitmap_area_averaged(const Bitmap& unscaled_bitmap, unsigned int scaled_width, unsigned int scaled_height, Blend_space blend_space)
+{
+    Bitmap scaled_bitmap{std::vector<uint8_t>(scaled_width * scaled_height * sizeof(Color_rgb)), scaled_width, scaled_height, true};
+
+    auto unscaled_pixels = reinterpret_cast<const Color_rgb*>(&unscaled_bitmap.bitmap[0]);
+    auto scaled_pixels = reinterpret_cast<Color_rgb*>(&scaled_bitmap.bitmap[0]);
+
+    resize_bitmap_area_averaged_unchecked({unscaled_pixels, unscaled_bitmap.width, 0, 0, unscaled_bitmap.width, unscaled_bitmap.height},
+                                          unscaled_bitmap.width, unscaled_bitmap.height,
+                                          {scaled_pixels, scaled_width, 0, 0, scaled_width, scaled_height}, scaled_width, scaled_height,
+                                          blend_space);
+
+    return scaled_bitmap;
+}
+
+// The scaled image is processed in blocks sized so that the unscaled pixels each block covers are about
+// one tile, whatever the scale, and each block's unscaled pixels are read into a window.  Each thread
+// holds one block and its window in memory.
+template<typename Image>
+static void resize_by_tiles(const Image& unscaled_bitmap, Image& scaled_bitmap, unsigned int tile_size, bool area_averaged, Blend_space blend_space)
+{
+    assert(unscaled_bitmap.format() == Pixel_format::Rgb);
+    assert(scaled_bitmap.format() == Pixel_format::Rgb);
+
+    const unsigned int unscaled_width = unscaled_bitmap.width();
+    const unsigned int unscaled_height = unscaled_bitmap.height();
+    const unsigned int scaled_width = scaled_bitmap.width();
+    const unsigned int scaled_height = scaled_bitmap.height();
+    if((scaled_width == 0) || (scaled_height == 0))
+    {
+        return;
+    }
+    assert((unscaled_width > 0) && (unscaled_height > 0));
+
+    const auto get_block_size = [tile_size](unsigned int unscaled_size, unsigned int scaled_size)
+    {
+        const uint64_t block_size = static_cast<uint64_t>(tile_size) * scaled_size / unscaled_size;
+        return static_cast<unsigned int>(std::min<uint64_t>(std::max<uint64_t>(block_size, 1), tile_size));
+    };
+    const unsigned int block_width = get_block_size(unscaled_width, scaled_width);
+    const unsigned int block_height = get_block_size(unscaled_height, scaled_height);
+    const size_t block_columns = (static_cast<size_t>(scaled_width) + block_width - 1) / block_width;
+    const size_t block_rows = (static_cast<size_t>(scaled_height) + block_height - 1) / block_height;
+
+    parallel_for(block_columns * block_rows, 1, [&, area_averaged, blend_space, block_width, block_height, block_columns](size_t block_begin, size_t block_end)
+    {
+        std::vector<Color_rgb> unscaled_pixels;
+        std::vector<Color_rgb> scaled_pixels;
+        for(size_t block_ix = block_begin; block_ix < block_end; ++block_ix)
+        {
+            Image_window<Color_rgb> scaled;
+            scaled.left = static_cast<unsigned int>((block_ix % block_columns) * block_width);
+            scaled.top = static_cast<unsigned int>((block_ix / block_columns) * block_height);
+            scaled.right = std::min(scaled.left + block_width, scaled_width);
+            scaled.bottom = std::min(scaled.top + block_height, scaled_height);
+            scaled.stride = scaled.right - scaled.left;
+            scaled_pixels.resize(scaled.stride * (scaled.bottom - scaled.top), Color_rgb(0, 0, 0));
+            scaled.pixels = scaled_pixels.data();
+
+            Image_window<const Color_rgb> unscaled;
+            if(area_averaged)
+            {
+                unscaled.left = get_area_begin(unscaled_width, scaled_width, scaled.left);
+                unscaled.top = get_area_begin(unscaled_height, scaled_height, scaled.top);
+                unscaled.right = get_area_end(unscaled_width, scaled_width, scaled.right - 1);
+                unscaled.bottom = get_area_end(unscaled_height, scaled_height, scaled.bottom - 1);
+            }
+            else
+            {
+                unscaled.left = get_point_sample(unscaled_width, scaled_width, scaled.left);
+                unscaled.top = get_point_sample(unscaled_height, scaled_height, scaled.top);
+                unscaled.right = get_point_sample(unscaled_width, scaled_width, scaled.right - 1) + 1;
+                unscaled.bottom = get_point_sample(unscaled_height, scaled_height, scaled.bottom - 1) + 1;
+            }
+            unscaled.stride = unscaled.right - unscaled.left;
+            unscaled_pixels.resize(unscaled.stride * (unscaled.bottom - unscaled.top), Color_rgb(0, 0, 0));
+            unscaled.pixels = unscaled_pixels.data();
+
+            unscaled_bitmap.read_region(unscaled.left, unscaled.top, unscaled.right - unscaled.left, unscaled.bottom - unscaled.top,
+                                        reinterpret_cast<uint8_t*>(unscaled_pixels.data()), unscaled.stride * sizeof(Color_rgb));
+
+            if(area_averaged)
+            {
+                resize_bitmap_area_averaged_unchecked(unscaled, unscaled_width, unscaled_height, scaled, scaled_width, scaled_height, blend_space);
+            }
+            else
+            {
+                resize_bitmap_point_sampled_unchecked(unscaled, unscaled_width, unscaled_height, scaled, scaled_width, scaled_height);
+            }
+
+            scaled_bitmap.write_region(scaled.left, scaled.top, scaled.right - scaled.left, scaled.bottom - scaled.top,
+                                       reinterpret_cast<const uint8_t*>(scaled_pixels.data()), scaled.stride * sizeof(Color_rgb));
+        }
+    });
+}
+
+void resize_bitmap_point_sampled(const Tiled_bitmap& unscaled_bitmap, Tiled_bitmap& scaled_bitmap)
+{
+    resize_by_tiles(unscaled_bitmap, scaled_bitmap, Tiled_bitmap::tile_size, false, Blend_space::Srgb);
+}
+
+void resize_bitmap_area_averaged(const Tiled_bitmap& unscaled_bitmap, Tiled_bitmap& scaled_bitmap, Blend_space blend_space)
+{
+    resize_by_tiles(unscaled_bitmap, scaled_bitmap, Tiled_bitmap::tile_size, true, blend_space);
+}
+
+// Each window of the blocked source is a group of blocks, which is contiguous in memory.
+Blocked_bitmap resize_bitmap_point_sampled(const Blocked_bitmap& unscaled_bitmap, unsigned int scaled_width, unsigned int scaled_height)
+{
+    Blocked_bitmap scaled_bitmap(scaled_width, scaled_height, unscaled_bitmap.format());
+    resize_by_tiles(unscaled_bitmap, scaled_bitmap, 8 * Blocked_bitmap::block_size, false, Blend_space::Srgb);
+
+    // Return value optimization expected.
+    return scaled_bitmap;
+}
+
+Blocked_bitmap resize_bitmap_area_averaged(const Blocked_bitmap& unscaled_bitmap, unsigned int scaled_width, unsigned int scaled_height, Blend_space blend_space)
+{
+    Blocked_bitmap scaled_bitmap(scaled_width, scaled_height, unscaled_bitmap.format());
+    resize_by_tiles(unscaled_bitmap, scaled_bitmap, 8 * Blocked_bitmap::block_size, true, blend_space);
+
+    // Return value optimization expected.
+    return scaled_bitmap;
+}
+
+unsigned int get_preview_reduction(unsigned int width, unsigned int height, unsigned int preview_size) noexcept
+{
+    const unsigned int size = std::max(width, height);
+
+    unsigned int reduction = 1;
+    while((reduction < 8) && (size / (reduction * 2) >= preview_size))
+    {
+        reduction *= 2;
+    }
+
+    return reduction;
+}
+
 }
 
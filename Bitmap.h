@@ -16,17 +16,97 @@ struct Color_rgb
     uint8_t green;
     uint8_t blue;
 };
+
+struct Color_rgba
+{
+    // Empty default constructor is used to prevent zero-init when creating a std::vector<Color_rgba>.
+    explicit Color_rgba() {}
+    Color_rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a) : red(r), green(g), blue(b), alpha(a) {}
+
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    uint8_t alpha;
+};
 #pragma pack(pop)
 
+enum class Pixel_format : uint8_t
+{
+    Rgb,                    // Color_rgb.
+    Rgba,                   // Color_rgba with straight alpha.
+    Rgba_premultiplied,     // Color_rgba with the color channels pre-multiplied by alpha.
+};
+
+inline size_t get_bytes_per_pixel(Pixel_format format) noexcept
+{
+    return format == Pixel_format::Rgb ? sizeof(Color_rgb) : sizeof(Color_rgba);
+}
+
 struct Bitmap
 {
     std::vector<uint8_t> bitmap;
     unsigned int width;
     unsigned int height;
     bool filtered;
+    Pixel_format format = Pixel_format::Rgb;
+};
+
+// Eight bit per pixel image where each pixel is an index into a palette of up to 256 colors.
+struct Paletted_bitmap
+{
+    std::vector<uint8_t> indices;
+    std::vector<Color_rgb> palette;
+    unsigned int width;
+    unsigned int height;
+};
+
+// Selects whether filters blend the stored sRGB encoded values, or convert them to linear light first.
+// Blending sRGB encoded values darkens blurred and downscaled images.
+enum class Blend_space
+{
+    Srgb,
+    Linear,
+};
+
+// Pixels from left to right and top to bottom, excluding right and bottom.
+struct Bitmap_rectangle
+{
+    unsigned int left;
+    unsigned int top;
+    unsigned int right;
+    unsigned int bottom;
 };
 
+// Clips the rectangles to width by height, drops empty rectangles, and returns rectangles that do not overlap and
+// cover exactly the pixels of the clipped rectangles, so each changed pixel is processed once and no other pixel is.
+std::vector<Bitmap_rectangle> merge_rectangles(const std::vector<Bitmap_rectangle>& rectangles, unsigned int width, unsigned int height);
+
 Bitmap resize_bitmap_point_sampled(const Bitmap& unscaled_bitmap, unsigned int scaled_width, unsigned int scaled_height);
+Bitmap resize_bitmap_area_averaged(const Bitmap& unscaled_bitmap, unsigned int scaled_width, unsigned int scaled_height, Blend_space blend_space);
+
+// Updates scaled_bitmap, the point sampled resize of unscaled_bitmap, after the pixels of unscaled_bitmap in
+// dirty_rectangles have changed.  Only the scaled pixels that sample a dirty pixel are copied again, so the
+// cost depends on the size of the change, and the result is identical to resizing the whole image again.
+void update_resized_bitmap_point_sampled(const Bitmap& unscaled_bitmap, const std::vector<Bitmap_rectangle>& dirty_rectangles, Bitmap& scaled_bitmap);
+
+// Out-of-core versions for images of any size.  The scaled size is the size of scaled_bitmap.
+void resize_bitmap_point_sampled(const class Tiled_bitmap& unscaled_bitmap, class Tiled_bitmap& scaled_bitmap);
+void resize_bitmap_area_averaged(const class Tiled_bitmap& unscaled_bitmap, class Tiled_bitmap& scaled_bitmap, Blend_space blend_space);
+
+// Versions for the blocked layout, which read each window of the unscaled image from contiguous blocks.
+class Blocked_bitmap resize_bitmap_point_sampled(const class Blocked_bitmap& unscaled_bitmap, unsigned int scaled_width, unsigned int scaled_height);
+class Blocked_bitmap resize_bitmap_area_averaged(const class Blocked_bitmap& unscaled_bitmap, unsigned int scaled_width, unsigned int scaled_height, Blend_space blend_space);
+
+// Previews are decoded at 1/2, 1/4 or 1/8 of the full size, from the top left pixel of each cell of
+// reduction by reduction pixels, so only those pixels need to be read from the file.  Returns the largest
+// reduction that keeps the larger dimension at least preview_size, or 1 if the image is not large enough.
+unsigned int get_preview_reduction(unsigned int width, unsigned int height, unsigned int preview_size) noexcept;
+
+// Partial cells at the right and bottom edges are kept.
+inline unsigned int get_reduced_size(unsigned int size, unsigned int reduction) noexcept
+{
+    return (size + reduction - 1) / reduction;
+}
 
 }
 
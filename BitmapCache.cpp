@@ -0,0 +1,556 @@
+#include "PreCompile.h"
+#include "Bitmap.h"
+#include "BitmapCache.h"        // Pick up forward declarations to ensure correctness.
+#include <PortableRuntime/CheckException.h>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ImageProcessing
+{
+
+// Cache files are a header followed by the pixels exactly as stored in a Bitmap.  The header is padded so
+// the pixels are aligned in the mapping.
+struct Cache_file_header
+{
+    uint8_t signature[8];
+    uint64_t key;
+    uint64_t data_size;
+    uint32_t width;
+    uint32_t height;
+    uint8_t format;
+    uint8_t filtered;
+    uint8_t reserved[30];
+};
+static_assert(sizeof(Cache_file_header) == 64, "Cache file header must not be padded by the compiler.");
+
+constexpr uint8_t cache_file_signature[] = {'I', 'P', 'B', 'M', 'P', 'C', '0', '1'};
+constexpr char cache_file_extension[] = ".ipc";
+
+// xxHash64, which hashes at memory bandwidth without vector instructions.
+// https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+constexpr uint64_t hash_prime_1 = 11400714785074694791ull;
+constexpr uint64_t hash_prime_2 = 14029467366897019727ull;
+constexpr uint64_t hash_prime_3 = 1609587929392839161ull;
+constexpr uint64_t hash_prime_4 = 9650029242287828579ull;
+constexpr uint64_t hash_prime_5 = 2870177450012600261ull;
+
+static uint64_t rotate_left(uint64_t value, int count) noexcept
+{
+    return (value << count) | (value >> (64 - count));
+}
+
+static uint64_t read_uint64(_In_reads_(8) const uint8_t* data) noexcept
+{
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint64_t hash_round(uint64_t accumulator, uint64_t input) noexcept
+{
+    return rotate_left(accumulator + input * hash_prime_2, 31) * hash_prime_1;
+}
+
+static uint64_t hash_merge_round(uint64_t accumulator, uint64_t value) noexcept
+{
+    return (accumulator ^ hash_round(0, value)) * hash_prime_1 + hash_prime_4;
+}
+
+static uint64_t hash_bytes(_In_reads_(size) const uint8_t* data, size_t size, uint64_t seed) noexcept
+{
+    const uint8_t* end = data + size;
+    uint64_t hash;
+
+    if(size >= 32)
+    {
+        // Four independent lanes keep the multipliers busy.
+        uint64_t lanes[4] = {seed + hash_prime_1 + hash_prime_2, seed + hash_prime_2, seed, seed - hash_prime_1};
+        for(; end - data >= 32; data += 32)
+        {
+            lanes[0] = hash_round(lanes[0], read_uint64(data));
+            lanes[1] = hash_round(lanes[1], read_uint64(data + 8));
+            lanes[2] = hash_round(lanes[2], read_uint64(data + 16));
+            lanes[3] = hash_round(lanes[3], read_uint64(data + 24));
+        }
+
+        hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+        for(const uint64_t lane : lanes)
+        {
+            hash = hash_merge_round(hash, lane);
+        }
+    }
+    else
+    {
+        hash = seed + hash_prime_5;
+    }
+
+    hash += size;
+
+    for(; end - data >= 8; data += 8)
+    {
+        hash = rotate_left(hash ^ hash_round(0, read_uint64(data)), 27) * hash_prime_1 + hash_prime_4;
+    }
+
+    if(end - data >= 4)
+    {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        hash = rotate_left(hash ^ (value * hash_prime_1), 23) * hash_prime_2 + hash_prime_3;
+        data += 4;
+    }
+
+    for(; data < end; ++data)
+    {
+        hash = rotate_left(hash ^ (*data * hash_prime_5), 11) * hash_prime_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= hash_prime_2;
+    hash ^= hash >> 29;
+    hash *= hash_prime_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+Bitmap_cache_key make_bitmap_cache_key(_In_reads_(size) const uint8_t* data, size_t size) noexcept
+{
+    return Bitmap_cache_key{hash_bytes(data, size, 0)};
+}
+
+// Chaining through the seed makes the key depend on the order of the operations.
+Bitmap_cache_key add_to_bitmap_cache_key(const Bitmap_cache_key& key, _In_reads_bytes_(size) const void* parameters, size_t size) noexcept
+{
+    return Bitmap_cache_key{hash_bytes(static_cast<const uint8_t*>(parameters), size, key.hash)};
+}
+
+Mapped_bitmap::Mapped_bitmap() noexcept :
+    m_view(nullptr),
+    m_view_size(0),
+    m_pixels(nullptr),
+    m_size(0),
+    m_width(0),
+    m_height(0),
+    m_format(Pixel_format::Rgb),
+    m_filtered(false)
+{
+}
+
+Mapped_bitmap::Mapped_bitmap(Mapped_bitmap&& other) noexcept :
+    m_view(other.m_view),
+    m_view_size(other.m_view_size),
+    m_pixels(other.m_pixels),
+    m_size(other.m_size),
+    m_width(other.m_width),
+    m_height(other.m_height),
+    m_format(other.m_format),
+    m_filtered(other.m_filtered)
+{
+    other.m_view = nullptr;
+    other.m_view_size = 0;
+    other.m_pixels = nullptr;
+    other.m_size = 0;
+}
+
+Mapped_bitmap::~Mapped_bitmap()
+{
+    if(m_view != nullptr)
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(m_view);
+#else
+        munmap(const_cast<uint8_t*>(m_view), m_view_size);
+#endif
+    }
+}
+
+Bitmap_cache::Bitmap_cache(const Bitmap_cache_options& options) :
+    m_options(options)
+{
+    CHECK_EXCEPTION(!options.directory.empty(), u8"Invalid cache options.");
+}
+
+std::string Bitmap_cache::get_file_name(const Bitmap_cache_key& key) const
+{
+    char name[17];
+    for(int ix = 0; ix < 16; ++ix)
+    {
+        name[ix] = "0123456789abcdef"[(key.hash >> (60 - ix * 4)) & 0xf];
+    }
+    name[16] = '\0';
+
+    return m_options.directory + "/" + name + cache_file_extension;
+}
+
+// Maps the whole file read-only.  Returns nullptr if the file does not exist.
+static const uint8_t* map_cache_file(const std::string& file_name, _Out_ size_t* size) noexcept
+{
+    *size = 0;
+    const uint8_t* view = nullptr;
+
+#if defined(_WIN32)
+    // Sharing delete allows other processes to evict or replace the file while it is mapped.
+    const HANDLE file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                    nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return nullptr;
+    }
+
+    LARGE_INTEGER file_size;
+    if(GetFileSizeEx(file, &file_size) && (file_size.QuadPart >= static_cast<LONGLONG>(sizeof(Cache_file_header))))
+    {
+        const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(mapping != nullptr)
+        {
+            view = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            CloseHandle(mapping);
+        }
+
+        if(view != nullptr)
+        {
+            *size = static_cast<size_t>(file_size.QuadPart);
+        }
+    }
+
+    CloseHandle(file);
+#else
+    const int file_descriptor = open(file_name.c_str(), O_RDONLY);
+    if(file_descriptor < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat status;
+    if((fstat(file_descriptor, &status) == 0) && (status.st_size >= static_cast<off_t>(sizeof(Cache_file_header))))
+    {
+        void* mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, file_descriptor, 0);
+        if(mapping != MAP_FAILED)
+        {
+            view = static_cast<const uint8_t*>(mapping);
+            *size = static_cast<size_t>(status.st_size);
+        }
+    }
+
+    close(file_descriptor);
+#endif
+
+    return view;
+}
+
+// Marks the file as recently used.  Returns false if this user may not change the times of the file,
+// which requires owning it or having write access to it.
+static bool touch_cache_file(const std::string& file_name) noexcept
+{
+#if defined(_WIN32)
+    const HANDLE file = CreateFileA(file_name.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                    nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    const bool touched = SetFileTime(file, nullptr, nullptr, &now) != FALSE;
+
+    CloseHandle(file);
+    return touched;
+#else
+    return utimensat(AT_FDCWD, file_name.c_str(), nullptr, 0) == 0;
+#endif
+}
+
+// The file is written under a unique temporary name, then renamed over the final name, which is atomic.
+// Returns false if the file could not be written.
+static bool write_cache_file(const std::string& directory, const std::string& file_name,
+                             _In_reads_(buffer_count) const std::pair<const uint8_t*, size_t>* buffers, size_t buffer_count)
+{
+    bool written = true;
+
+#if defined(_WIN32)
+    char temporary_name[MAX_PATH];
+    if(GetTempFileNameA(directory.c_str(), "ipc", 0, temporary_name) == 0)
+    {
+        return false;
+    }
+
+    const HANDLE file = CreateFileA(temporary_name, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    written = (file != INVALID_HANDLE_VALUE);
+    for(size_t ix = 0; ix < buffer_count; ++ix)
+    {
+        const uint8_t* start = buffers[ix].first;
+        size_t remaining = buffers[ix].second;
+        while(written && (remaining > 0))
+        {
+            DWORD chunk_written = 0;
+            written = WriteFile(file, start, static_cast<DWORD>(std::min<size_t>(remaining, UINT_MAX)), &chunk_written, nullptr) && (chunk_written > 0);
+            start += chunk_written;
+            remaining -= chunk_written;
+        }
+    }
+
+    if(file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file);
+    }
+
+    // Replacing fails if another process has the file mapped, but then the file already holds this bitmap.
+    if(!written || !MoveFileExA(temporary_name, file_name.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileA(temporary_name);
+    }
+#else
+    // Only the file name is needed, as it is in the cache directory.
+    static_cast<void>(directory);
+
+    std::string temporary_name = file_name + ".tmp-XXXXXX";
+    const int file_descriptor = mkstemp(&temporary_name[0]);
+    if(file_descriptor < 0)
+    {
+        return false;
+    }
+
+    // mkstemp creates files only the owner can read, but the cache may be shared between users.
+    fchmod(file_descriptor, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+    for(size_t ix = 0; ix < buffer_count; ++ix)
+    {
+        const uint8_t* start = buffers[ix].first;
+        size_t remaining = buffers[ix].second;
+        while(written && (remaining > 0))
+        {
+            const ssize_t chunk_written = write(file_descriptor, start, remaining);
+            if((chunk_written < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+
+            written = chunk_written > 0;
+            start += written ? chunk_written : 0;
+            remaining -= written ? chunk_written : 0;
+        }
+    }
+
+    written &= (close(file_descriptor) == 0);
+    written = written && (rename(temporary_name.c_str(), file_name.c_str()) == 0);
+    if(!written)
+    {
+        unlink(temporary_name.c_str());
+    }
+#endif
+
+    return written;
+}
+
+Mapped_bitmap Bitmap_cache::find(const Bitmap_cache_key& key) const
+{
+    const std::string file_name = get_file_name(key);
+
+    Mapped_bitmap bitmap;
+    bitmap.m_view = map_cache_file(file_name, &bitmap.m_view_size);
+    if(bitmap.m_view == nullptr)
+    {
+        return bitmap;
+    }
+
+    const Cache_file_header* header = reinterpret_cast<const Cache_file_header*>(bitmap.m_view);
+    const uint64_t pixel_count = static_cast<uint64_t>(header->width) * header->height;
+
+    bool valid = std::equal(cache_file_signature, cache_file_signature + sizeof(cache_file_signature), header->signature);
+    valid &= (header->key == key.hash);
+    valid &= (header->format <= static_cast<uint8_t>(Pixel_format::Rgba_premultiplied));
+    valid = valid && (header->data_size == pixel_count * get_bytes_per_pixel(static_cast<Pixel_format>(header->format)));
+    valid = valid && (header->data_size == bitmap.m_view_size - sizeof(Cache_file_header));
+
+    if(!valid)
+    {
+        // The destructor unmaps the file.
+        return Mapped_bitmap();
+    }
+
+    // Only the access time is updated, and a file written by another user is never rewritten.  If this user may not
+    // change its times, the file only looks older than it is, and may be evicted sooner.
+    touch_cache_file(file_name);
+
+    bitmap.m_pixels = bitmap.m_view + sizeof(Cache_file_header);
+    bitmap.m_size = static_cast<size_t>(header->data_size);
+    bitmap.m_width = header->width;
+    bitmap.m_height = header->height;
+    bitmap.m_format = static_cast<Pixel_format>(header->format);
+    bitmap.m_filtered = header->filtered != 0;
+
+    // Return value optimization expected.
+    return bitmap;
+}
+
+void Bitmap_cache::insert(const Bitmap_cache_key& key, const Bitmap& bitmap) const
+{
+    Cache_file_header header{};
+    std::copy(cache_file_signature, cache_file_signature + sizeof(cache_file_signature), header.signature);
+    header.key = key.hash;
+    header.data_size = static_cast<uint64_t>(bitmap.width) * bitmap.height * get_bytes_per_pixel(bitmap.format);
+    header.width = bitmap.width;
+    header.height = bitmap.height;
+    header.format = static_cast<uint8_t>(bitmap.format);
+    header.filtered = bitmap.filtered ? 1 : 0;
+    CHECK_EXCEPTION(header.data_size == bitmap.bitmap.size(), u8"Image data is invalid.");
+
+    const std::pair<const uint8_t*, size_t> buffers[] =
+    {
+        {reinterpret_cast<const uint8_t*>(&header), sizeof(header)},
+        {bitmap.bitmap.data(), bitmap.bitmap.size()},
+    };
+
+    const std::string file_name = get_file_name(key);
+    const bool written = write_cache_file(m_options.directory, file_name, buffers, sizeof(buffers) / sizeof(buffers[0]));
+    CHECK_EXCEPTION(written, u8"Could not write cache file.");
+
+    evict(file_name);
+}
+
+struct Cache_file_entry
+{
+    std::string file_name;
+    uint64_t size;
+    uint64_t last_used;
+};
+
+// Lists the cache files in the directory.  Temporary files being written by other processes are skipped.
+static std::vector<Cache_file_entry> list_cache_files(const std::string& directory)
+{
+    const size_t extension_length = sizeof(cache_file_extension) - 1;
+    std::vector<Cache_file_entry> entries;
+
+#if defined(_WIN32)
+    WIN32_FIND_DATAA find_data;
+    const HANDLE find = FindFirstFileA((directory + "/*" + cache_file_extension).c_str(), &find_data);
+    if(find == INVALID_HANDLE_VALUE)
+    {
+        return entries;
+    }
+
+    do
+    {
+        if((find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+        {
+            entries.push_back(Cache_file_entry{directory + "/" + find_data.cFileName,
+                                               (static_cast<uint64_t>(find_data.nFileSizeHigh) << 32) | find_data.nFileSizeLow,
+                                               (static_cast<uint64_t>(find_data.ftLastWriteTime.dwHighDateTime) << 32) | find_data.ftLastWriteTime.dwLowDateTime});
+        }
+    } while(FindNextFileA(find, &find_data));
+
+    FindClose(find);
+#else
+    DIR* directory_stream = opendir(directory.c_str());
+    if(directory_stream == nullptr)
+    {
+        return entries;
+    }
+
+    while(const dirent* entry = readdir(directory_stream))
+    {
+        const size_t name_length = std::strlen(entry->d_name);
+        if((name_length <= extension_length) || (std::strcmp(entry->d_name + name_length - extension_length, cache_file_extension) != 0))
+        {
+            continue;
+        }
+
+        // Files may be evicted by other processes during the listing.
+        std::string file_name = directory + "/" + entry->d_name;
+        struct stat status;
+        if((stat(file_name.c_str(), &status) == 0) && S_ISREG(status.st_mode))
+        {
+            // Whole seconds would make files used within the same second indistinguishable.
+#if defined(__APPLE__)
+            const timespec& modified = status.st_mtimespec;
+#else
+            const timespec& modified = status.st_mtim;
+#endif
+            const uint64_t last_used = static_cast<uint64_t>(modified.tv_sec) * 1000000000 + static_cast<uint64_t>(modified.tv_nsec);
+            entries.push_back(Cache_file_entry{std::move(file_name), static_cast<uint64_t>(status.st_size), last_used});
+        }
+    }
+
+    closedir(directory_stream);
+#endif
+
+    return entries;
+}
+
+void Bitmap_cache::evict(const std::string& inserted_file_name) const
+{
+    auto entries = list_cache_files(m_options.directory);
+
+    uint64_t total_size = 0;
+    for(const auto& entry : entries)
+    {
+        total_size += entry.size;
+    }
+
+    if(total_size <= m_options.maximum_size)
+    {
+        return;
+    }
+
+    // Ties are broken by name, so that every process evicts files in the same order.
+    std::sort(entries.begin(), entries.end(), [](const Cache_file_entry& a, const Cache_file_entry& b)
+    {
+        return (a.last_used != b.last_used) ? (a.last_used < b.last_used) : (a.file_name < b.file_name);
+    });
+
+    // Other processes may be evicting at the same time, so failures to delete are expected.  Mapped files stay
+    // valid until they are unmapped.  The file just inserted is kept, even if it alone is over the maximum size.
+    for(auto entry = entries.cbegin(); (entry != entries.cend()) && (total_size > m_options.maximum_size); ++entry)
+    {
+        if(entry->file_name == inserted_file_name)
+        {
+            continue;
+        }
+
+#if defined(_WIN32)
+        DeleteFileA(entry->file_name.c_str());
+#else
+        unlink(entry->file_name.c_str());
+#endif
+        total_size -= entry->size;
+    }
+}
+
+Bitmap Bitmap_cache::find_or_insert(const Bitmap_cache_key& key, const std::function<Bitmap ()>& make_bitmap) const
+{
+    const Mapped_bitmap mapped_bitmap = find(key);
+    if(mapped_bitmap.is_valid())
+    {
+        Bitmap bitmap{std::vector<uint8_t>(mapped_bitmap.pixels(), mapped_bitmap.pixels() + mapped_bitmap.size()),
+                      mapped_bitmap.width(), mapped_bitmap.height(), mapped_bitmap.filtered(), mapped_bitmap.format()};
+        return bitmap;
+    }
+
+    Bitmap bitmap = make_bitmap();
+
+    // The cache is only an optimization, so failing to write it, e.g. because the disk is full, is not an error.
+    try
+    {
+        insert(key, bitmap);
+    }
+    catch(...)
+    {
+    }
+
+    return bitmap;
+}
+
+}
+
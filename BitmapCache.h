@@ -0,0 +1,85 @@
+#pragma once
+
+namespace ImageProcessing
+{
+
+// Identifies the result of decoding and processing a particular input.  Start with the hash of the input
+// file bytes, then add the parameters of each operation applied, in order, e.g. the filter taps, dimension
+// and blend space of apply_box_filter.
+struct Bitmap_cache_key
+{
+    uint64_t hash;
+};
+
+Bitmap_cache_key make_bitmap_cache_key(_In_reads_(size) const uint8_t* data, size_t size) noexcept;
+Bitmap_cache_key add_to_bitmap_cache_key(const Bitmap_cache_key& key, _In_reads_bytes_(size) const void* parameters, size_t size) noexcept;
+
+struct Bitmap_cache_options
+{
+    std::string directory;              // Directory holding the cache files.  Must exist.
+    uint64_t maximum_size;              // Least recently used files are deleted once the cache grows beyond this many bytes.
+};
+
+// Read-only view of a cached bitmap, mapped directly from the cache file.
+class Mapped_bitmap
+{
+public:
+    Mapped_bitmap() noexcept;
+    Mapped_bitmap(Mapped_bitmap&& other) noexcept;
+    ~Mapped_bitmap();
+
+    Mapped_bitmap(const Mapped_bitmap&) = delete;
+    Mapped_bitmap& operator=(const Mapped_bitmap&) = delete;
+    Mapped_bitmap& operator=(Mapped_bitmap&&) = delete;
+
+    // False if the cache did not have the bitmap.
+    bool is_valid() const noexcept { return m_view != nullptr; }
+
+    unsigned int width() const noexcept { return m_width; }
+    unsigned int height() const noexcept { return m_height; }
+    Pixel_format format() const noexcept { return m_format; }
+    bool filtered() const noexcept { return m_filtered; }
+    const uint8_t* pixels() const noexcept { return m_pixels; }
+    size_t size() const noexcept { return m_size; }
+
+private:
+    friend class Bitmap_cache;
+
+    const uint8_t* m_view;
+    size_t m_view_size;
+    const uint8_t* m_pixels;
+    size_t m_size;
+    unsigned int m_width;
+    unsigned int m_height;
+    Pixel_format m_format;
+    bool m_filtered;
+};
+
+// Cache of bitmaps stored as raw pixels behind a small header, so a hit is a single file mapping with no decode.
+// Files are written to a temporary name and renamed into place, so any number of threads and processes may
+// share a cache directory and never observe a partially written file.  Recency of use is tracked by the file
+// modification time, which is updated on every hit.  A hit never rewrites the file, so files written by another
+// user, whose times this user may not change, keep the time they were written.
+class Bitmap_cache
+{
+public:
+    explicit Bitmap_cache(const Bitmap_cache_options& options);
+
+    // Returns an invalid Mapped_bitmap on a miss.  Damaged files are treated as misses.
+    Mapped_bitmap find(const Bitmap_cache_key& key) const;
+
+    // Evicts least recently used files if the cache has grown beyond the maximum size.  The inserted file is never evicted.
+    void insert(const Bitmap_cache_key& key, const struct Bitmap& bitmap) const;
+
+    // Returns the cached bitmap, or the bitmap from make_bitmap after adding it to the cache.
+    struct Bitmap find_or_insert(const Bitmap_cache_key& key, const std::function<struct Bitmap ()>& make_bitmap) const;
+
+private:
+    std::string get_file_name(const Bitmap_cache_key& key) const;
+    void evict(const std::string& inserted_file_name) const;
+
+    const Bitmap_cache_options m_options;
+};
+
+}
+
@@ -0,0 +1,130 @@
+#include "PreCompile.h"
+#include "Bitmap.h"
+#include "BlockedBitmap.h"      // Pick up forward declarations to ensure correctness.
+#include "Parallel.h"
+
+namespace ImageProcessing
+{
+
+Blocked_bitmap::Blocked_bitmap(unsigned int width, unsigned int height, Pixel_format format) :
+    m_width(width),
+    m_height(height),
+    m_format(format),
+    m_pixel_size(get_bytes_per_pixel(format)),
+    m_block_bytes(static_cast<size_t>(block_size) * block_size * get_bytes_per_pixel(format))
+{
+    const size_t group_pixels = static_cast<size_t>(block_size) * group_size;
+    m_group_columns = (static_cast<size_t>(width) + group_pixels - 1) / group_pixels;
+    const size_t group_rows = (static_cast<size_t>(height) + group_pixels - 1) / group_pixels;
+
+    m_pixels.resize(m_group_columns * group_rows * group_size * group_size * m_block_bytes);
+}
+
+void Blocked_bitmap::read_region(int x, int y, unsigned int width, unsigned int height, _Out_ uint8_t* target, size_t target_stride) const noexcept
+{
+    assert((m_width > 0) && (m_height > 0));
+
+    const int64_t right = static_cast<int64_t>(x) + width;
+    const int64_t bottom = static_cast<int64_t>(y) + height;
+
+    // Columns left and right of the image repeat the edge pixels.
+    const unsigned int inside_begin = static_cast<unsigned int>(std::min<int64_t>(std::max<int64_t>(x, 0), m_width));
+    const unsigned int inside_end = std::max(inside_begin, static_cast<unsigned int>(std::min<int64_t>(std::max<int64_t>(right, 0), m_width)));
+    const size_t left_count = static_cast<size_t>(std::min<int64_t>(std::max<int64_t>(-static_cast<int64_t>(x), 0), width));
+    const size_t right_count = width - left_count - (inside_end - inside_begin);
+
+    for(int64_t row = y; row < bottom; ++row)
+    {
+        const unsigned int source_y = static_cast<unsigned int>(std::min<int64_t>(std::max<int64_t>(row, 0), m_height - 1));
+        uint8_t* target_pixel = target + static_cast<size_t>(row - y) * target_stride;
+
+        const uint8_t* left_edge = get_pixel(0, source_y);
+        for(size_t ix = 0; ix < left_count; ++ix)
+        {
+            target_pixel = std::copy(left_edge, left_edge + m_pixel_size, target_pixel);
+        }
+
+        // Copy the part of the row inside each block.
+        for(unsigned int column = inside_begin; column < inside_end;)
+        {
+            const unsigned int count = std::min(inside_end, (column / block_size + 1) * block_size) - column;
+            const uint8_t* source = get_pixel(column, source_y);
+            target_pixel = std::copy(source, source + count * m_pixel_size, target_pixel);
+            column += count;
+        }
+
+        const uint8_t* right_edge = get_pixel(m_width - 1, source_y);
+        for(size_t ix = 0; ix < right_count; ++ix)
+        {
+            target_pixel = std::copy(right_edge, right_edge + m_pixel_size, target_pixel);
+        }
+    }
+}
+
+void Blocked_bitmap::write_region(unsigned int x, unsigned int y, unsigned int width, unsigned int height, _In_ const uint8_t* source, size_t source_stride) noexcept
+{
+    assert((static_cast<uint64_t>(x) + width <= m_width) && (static_cast<uint64_t>(y) + height <= m_height));
+
+    for(unsigned int row = 0; row < height; ++row)
+    {
+        const uint8_t* source_pixel = source + row * source_stride;
+        for(unsigned int column = x; column < x + width;)
+        {
+            const unsigned int count = std::min(x + width, (column / block_size + 1) * block_size) - column;
+            std::copy(source_pixel, source_pixel + count * m_pixel_size, get_pixel(column, y + row));
+            source_pixel += count * m_pixel_size;
+            column += count;
+        }
+    }
+}
+
+// Conversions work in bands one block high, so each band writes or reads each of its blocks while they are in cache.
+Blocked_bitmap make_blocked_bitmap(const Bitmap& bitmap)
+{
+    Blocked_bitmap blocked_bitmap(bitmap.width, bitmap.height, bitmap.format);
+
+    const size_t row_size = static_cast<size_t>(bitmap.width) * get_bytes_per_pixel(bitmap.format);
+    assert(bitmap.bitmap.size() >= row_size * bitmap.height);
+
+    const unsigned int block_size = Blocked_bitmap::block_size;
+    const size_t band_count = (static_cast<size_t>(bitmap.height) + block_size - 1) / block_size;
+    parallel_for(band_count, 1, [&bitmap, &blocked_bitmap, row_size, block_size](size_t band_begin, size_t band_end)
+    {
+        for(size_t band = band_begin; band < band_end; ++band)
+        {
+            const unsigned int y = static_cast<unsigned int>(band * block_size);
+            const unsigned int height = std::min(block_size, bitmap.height - y);
+            blocked_bitmap.write_region(0, y, bitmap.width, height, bitmap.bitmap.data() + y * row_size, row_size);
+        }
+    });
+
+    // Return value optimization expected.
+    return blocked_bitmap;
+}
+
+Bitmap make_bitmap_from_blocked_bitmap(const Blocked_bitmap& blocked_bitmap)
+{
+    const size_t row_size = static_cast<size_t>(blocked_bitmap.width()) * get_bytes_per_pixel(blocked_bitmap.format());
+    Bitmap bitmap{std::vector<uint8_t>(row_size * blocked_bitmap.height()), blocked_bitmap.width(), blocked_bitmap.height(), true, blocked_bitmap.format()};
+
+    if(!bitmap.bitmap.empty())
+    {
+        const unsigned int block_size = Blocked_bitmap::block_size;
+        const size_t band_count = (static_cast<size_t>(bitmap.height) + block_size - 1) / block_size;
+        parallel_for(band_count, 1, [&bitmap, &blocked_bitmap, row_size, block_size](size_t band_begin, size_t band_end)
+        {
+            for(size_t band = band_begin; band < band_end; ++band)
+            {
+                const unsigned int y = static_cast<unsigned int>(band * block_size);
+                const unsigned int height = std::min(block_size, bitmap.height - y);
+                blocked_bitmap.read_region(0, y, bitmap.width, height, bitmap.bitmap.data() + y * row_size, row_size);
+            }
+        });
+    }
+
+    // Return value optimization expected.
+    return bitmap;
+}
+
+}
+
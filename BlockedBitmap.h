@@ -0,0 +1,73 @@
+#pragma once
+
+namespace ImageProcessing
+{
+
+// Image stored as 16x16 pixel blocks, for kernels that read two dimensional neighborhoods.  A block is
+// contiguous, and blocks are ordered along a Z-order curve within groups of 8x8 blocks, so pixels that are
+// near each other vertically are also near each other in memory.  Groups are stored in rows, and groups on
+// the right and bottom edges are padded.
+//
+// The layout only pays off for box filters of nine or more taps on images that stay blocked between operations.
+// Smaller filters, resizing and rotation are as fast or faster on a Bitmap, and converting to and from the layout
+// costs about as much as it saves.  See Benchmarks/BlockedBitmapBenchmark.cpp.
+class Blocked_bitmap
+{
+public:
+    static const unsigned int block_size = 16;
+
+    Blocked_bitmap(unsigned int width, unsigned int height, Pixel_format format);
+
+    unsigned int width() const noexcept { return m_width; }
+    unsigned int height() const noexcept { return m_height; }
+    Pixel_format format() const noexcept { return m_format; }
+
+    // Pixels from x to the end of its block row are contiguous.
+    const uint8_t* get_pixel(unsigned int x, unsigned int y) const noexcept
+    {
+        assert((x < m_width) && (y < m_height));
+        return m_pixels.data() + get_block_offset(x / block_size, y / block_size) + ((y % block_size) * block_size + x % block_size) * m_pixel_size;
+    }
+
+    uint8_t* get_pixel(unsigned int x, unsigned int y) noexcept
+    {
+        return const_cast<uint8_t*>(static_cast<const Blocked_bitmap*>(this)->get_pixel(x, y));
+    }
+
+    // Copies a rectangle into target, whose rows are target_stride bytes apart.  Coordinates outside the
+    // image are clamped to the nearest edge, so borders around regions can be read without special cases.
+    void read_region(int x, int y, unsigned int width, unsigned int height, _Out_ uint8_t* target, size_t target_stride) const noexcept;
+
+    // Copies a rectangle, which must be inside the image, from source, whose rows are source_stride bytes apart.
+    void write_region(unsigned int x, unsigned int y, unsigned int width, unsigned int height, _In_ const uint8_t* source, size_t source_stride) noexcept;
+
+private:
+    static const unsigned int group_size = 8;
+
+    size_t get_block_offset(unsigned int block_x, unsigned int block_y) const noexcept
+    {
+        // Interleave the three low bits of each coordinate to find the position along the Z-order curve.
+        const auto spread_bits = [](unsigned int value)
+        {
+            return (value & 1) | ((value & 2) << 1) | ((value & 4) << 2);
+        };
+
+        const size_t group = (block_y / group_size) * m_group_columns + block_x / group_size;
+        const size_t block = group * group_size * group_size + spread_bits(block_x % group_size) + (spread_bits(block_y % group_size) << 1);
+        return block * m_block_bytes;
+    }
+
+    unsigned int m_width;
+    unsigned int m_height;
+    Pixel_format m_format;
+    size_t m_pixel_size;
+    size_t m_block_bytes;
+    size_t m_group_columns;
+    std::vector<uint8_t> m_pixels;
+};
+
+Blocked_bitmap make_blocked_bitmap(const struct Bitmap& bitmap);
+struct Bitmap make_bitmap_from_blocked_bitmap(const Blocked_bitmap& blocked_bitmap);
+
+}
+
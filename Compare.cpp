@@ -0,0 +1,358 @@
+#include "PreCompile.h"
+#include "Compare.h"            // Pick up forward declarations to ensure correctness.
+#include "Bitmap.h"
+#include "CpuDispatch.h"
+#include "Parallel.h"
+#include "PixelKernels.h"
+#include <PortableRuntime/CheckException.h>
+
+namespace ImageProcessing
+{
+
+static size_t validate_compared_bitmaps(const Bitmap& first, const Bitmap& second)
+{
+    CHECK_EXCEPTION((first.width == second.width) && (first.height == second.height) && (first.format == second.format),
+                    u8"Bitmaps must have the same size and format.");
+
+    const size_t row_size = static_cast<size_t>(first.width) * get_bytes_per_pixel(first.format);
+    assert(first.bitmap.size() >= row_size * first.height);
+    assert(second.bitmap.size() >= row_size * second.height);
+    return row_size;
+}
+
+// Returns the first differing pixel of a row that is known to differ.
+static unsigned int find_first_difference(_In_reads_(row_size) const uint8_t* first, _In_reads_(row_size) const uint8_t* second, size_t row_size, Pixel_format format)
+{
+    const size_t offset = std::mismatch(first, first + row_size, second).first - first;
+    assert(offset < row_size);
+    return static_cast<unsigned int>(offset / get_bytes_per_pixel(format));
+}
+
+// Rows are compared with memcmp.  Ranges stop at the first differing row found by any range above them.
+bool bitmaps_are_identical(const Bitmap& first, const Bitmap& second, _Out_opt_ unsigned int* first_x, _Out_opt_ unsigned int* first_y)
+{
+    const size_t row_size = validate_compared_bitmaps(first, second);
+
+    std::atomic<size_t> first_different_row(first.height);
+    parallel_for(first.height, 16, [&first, &second, &first_different_row, row_size](size_t row_begin, size_t row_end)
+    {
+        for(size_t row = row_begin; (row < row_end) && (row < first_different_row.load(std::memory_order_relaxed)); ++row)
+        {
+            if(std::memcmp(first.bitmap.data() + row * row_size, second.bitmap.data() + row * row_size, row_size) != 0)
+            {
+                size_t current = first_different_row.load(std::memory_order_relaxed);
+                while((row < current) && !first_different_row.compare_exchange_weak(current, row, std::memory_order_relaxed))
+                {
+                }
+                break;
+            }
+        }
+    });
+
+    const size_t row = first_different_row.load();
+    const bool identical = (row == first.height);
+    if(first_x != nullptr)
+    {
+        *first_x = identical ? 0 : find_first_difference(first.bitmap.data() + row * row_size, second.bitmap.data() + row * row_size, row_size, first.format);
+    }
+    if(first_y != nullptr)
+    {
+        *first_y = identical ? 0 : static_cast<unsigned int>(row);
+    }
+
+    return identical;
+}
+
+// Each range of rows sums its own differences, and the sums are merged at the end of each range.
+// The sums are integers, so the result does not depend on how the rows are divided.
+Bitmap_difference compare_bitmaps(const Bitmap& first, const Bitmap& second)
+{
+    const size_t row_size = validate_compared_bitmaps(first, second);
+
+    uint64_t absolute_sum = 0;
+    uint64_t squared_sum = 0;
+    uint8_t maximum = 0;
+    size_t first_different_row = first.height;
+    std::mutex sums_mutex;
+
+    const Pixel_kernels& kernels = get_pixel_kernels();
+    parallel_for(first.height, 16, [&, row_size](size_t row_begin, size_t row_end)
+    {
+        uint64_t range_absolute_sum = 0;
+        uint64_t range_squared_sum = 0;
+        uint8_t range_maximum = 0;
+        size_t range_first_different_row = first.height;
+
+        for(size_t row = row_begin; row < row_end; ++row)
+        {
+            const uint64_t previous_absolute_sum = range_absolute_sum;
+            range_maximum = std::max(range_maximum, kernels.accumulate_differences(first.bitmap.data() + row * row_size, second.bitmap.data() + row * row_size,
+                                                                                    row_size, &range_absolute_sum, &range_squared_sum));
+            if((range_absolute_sum != previous_absolute_sum) && (range_first_different_row == first.height))
+            {
+                range_first_different_row = row;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(sums_mutex);
+        absolute_sum += range_absolute_sum;
+        squared_sum += range_squared_sum;
+        maximum = std::max(maximum, range_maximum);
+        first_different_row = std::min(first_different_row, range_first_different_row);
+    });
+
+    Bitmap_difference difference = {};
+    difference.identical = (first_different_row == first.height);
+    difference.maximum_absolute_difference = maximum;
+    difference.psnr = INFINITY;
+
+    const uint64_t value_count = static_cast<uint64_t>(row_size) * first.height;
+    if(!difference.identical)
+    {
+        const size_t row = first_different_row;
+        difference.first_difference_x = find_first_difference(first.bitmap.data() + row * row_size, second.bitmap.data() + row * row_size, row_size, first.format);
+        difference.first_difference_y = static_cast<unsigned int>(row);
+        difference.mean_absolute_difference = static_cast<double>(absolute_sum) / value_count;
+        difference.psnr = 10.0 * std::log10(255.0 * 255.0 * value_count / squared_sum);
+    }
+
+    return difference;
+}
+
+// SSIM windows are 8x8 pixels and start every 4 pixels in each direction, as in libvpx, with a last window in each
+// direction aligned to the edge of the image.
+const unsigned int ssim_window_size = 8;
+const size_t ssim_window_step = 4;
+
+// When the steps do not reach the far edge, one more window is aligned to it, so every pixel is in a window.
+static size_t get_ssim_window_count(unsigned int size, unsigned int window_size) noexcept
+{
+    const size_t span = size - window_size;
+    return span / ssim_window_step + 1 + ((span % ssim_window_step != 0) ? 1 : 0);
+}
+
+static size_t get_ssim_window_start(size_t window, unsigned int size, unsigned int window_size) noexcept
+{
+    return std::min<size_t>(window * ssim_window_step, size - window_size);
+}
+
+// Sums of the values, squares and products of the two images, for each byte of a row.
+struct Ssim_sums
+{
+    explicit Ssim_sums(size_t size) : first(size), second(size), first_squared(size), second_squared(size), product(size)
+    {
+    }
+
+    std::vector<uint32_t> first;
+    std::vector<uint32_t> second;
+    std::vector<uint32_t> first_squared;
+    std::vector<uint32_t> second_squared;
+    std::vector<uint32_t> product;
+};
+
+// Adds a row to, or removes a row from, the column sums.  Removal relies on unsigned wraparound.
+static void update_ssim_column_sums(Ssim_sums& sums, _In_reads_(row_size) const uint8_t* first, _In_reads_(row_size) const uint8_t* second, size_t row_size, bool add) noexcept
+{
+    uint32_t* first_sums = sums.first.data();
+    uint32_t* second_sums = sums.second.data();
+    uint32_t* first_squared_sums = sums.first_squared.data();
+    uint32_t* second_squared_sums = sums.second_squared.data();
+    uint32_t* product_sums = sums.product.data();
+
+    size_t ix = 0;
+
+#if defined(IMAGEPROCESSING_SSE2)
+    // Sixteen bytes at a time.  Squares and products of bytes fit in 16 bits, so they are formed before widening.
+    const __m128i zero = _mm_setzero_si128();
+    const auto update = [add, zero](_Inout_updates_(16) uint32_t* target, __m128i low, __m128i high)
+    {
+        const __m128i values[4] = {_mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero), _mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero)};
+        for(size_t group = 0; group < 4; ++group)
+        {
+            __m128i* sums = reinterpret_cast<__m128i*>(target + group * 4);
+            const __m128i current = _mm_loadu_si128(sums);
+            _mm_storeu_si128(sums, add ? _mm_add_epi32(current, values[group]) : _mm_sub_epi32(current, values[group]));
+        }
+    };
+
+    for(; ix + 16 <= row_size; ix += 16)
+    {
+        const __m128i first_values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + ix));
+        const __m128i second_values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + ix));
+        const __m128i first_low = _mm_unpacklo_epi8(first_values, zero);
+        const __m128i first_high = _mm_unpackhi_epi8(first_values, zero);
+        const __m128i second_low = _mm_unpacklo_epi8(second_values, zero);
+        const __m128i second_high = _mm_unpackhi_epi8(second_values, zero);
+
+        update(first_sums + ix, first_low, first_high);
+        update(second_sums + ix, second_low, second_high);
+        update(first_squared_sums + ix, _mm_mullo_epi16(first_low, first_low), _mm_mullo_epi16(first_high, first_high));
+        update(second_squared_sums + ix, _mm_mullo_epi16(second_low, second_low), _mm_mullo_epi16(second_high, second_high));
+        update(product_sums + ix, _mm_mullo_epi16(first_low, second_low), _mm_mullo_epi16(first_high, second_high));
+    }
+#endif
+
+    const uint32_t sign = add ? 1 : static_cast<uint32_t>(-1);
+    for(; ix < row_size; ++ix)
+    {
+        const uint32_t first_value = first[ix];
+        const uint32_t second_value = second[ix];
+        first_sums[ix] += sign * first_value;
+        second_sums[ix] += sign * second_value;
+        first_squared_sums[ix] += sign * first_value * first_value;
+        second_squared_sums[ix] += sign * second_value * second_value;
+        product_sums[ix] += sign * first_value * second_value;
+    }
+}
+
+// Sums window_width pixels of column sums for each window of a row of width pixels, see get_ssim_window_start.
+// window_sums holds the sums for each channel of each window in order.
+static void compute_ssim_window_sums(const std::vector<uint32_t>& column_sums, size_t channel_count, unsigned int width, unsigned int window_width,
+                                     size_t window_columns, _Out_writes_(window_columns * channel_count) uint32_t* window_sums) noexcept
+{
+    const uint32_t* sums = column_sums.data();
+    for(size_t window_column = 0; window_column < window_columns; ++window_column)
+    {
+        const uint32_t* window_start = sums + get_ssim_window_start(window_column, width, window_width) * channel_count;
+        for(size_t channel = 0; channel < channel_count; ++channel)
+        {
+            uint32_t window_sum = 0;
+            for(size_t column = 0; column < window_width; ++column)
+            {
+                window_sum += window_start[column * channel_count + channel];
+            }
+            window_sums[window_column * channel_count + channel] = window_sum;
+        }
+    }
+}
+
+// Returns the total SSIM of count windows from their sums over window_count values.  The means, variances and
+// covariance of Wang et al. are multiplied through by window_count squared, so every term but the constants is an
+// integer below 2^53 and exact as a double.
+static double sum_window_ssim(const Ssim_sums& window_sums, size_t count, double window_count) noexcept
+{
+    const double c1 = (0.01 * 255.0) * (0.01 * 255.0) * window_count * window_count;
+    const double c2 = (0.03 * 255.0) * (0.03 * 255.0) * window_count * window_count;
+
+    const uint32_t* first_sums = window_sums.first.data();
+    const uint32_t* second_sums = window_sums.second.data();
+    const uint32_t* first_squared_sums = window_sums.first_squared.data();
+    const uint32_t* second_squared_sums = window_sums.second_squared.data();
+    const uint32_t* product_sums = window_sums.product.data();
+
+    double total = 0.0;
+    size_t ix = 0;
+
+#if defined(IMAGEPROCESSING_SSE2)
+    // Two windows at a time.  The sums are below 2^31, so they convert as signed integers.
+    const auto load_sums = [](_In_reads_(2) const uint32_t* sums)
+    {
+        return _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(sums)));
+    };
+
+    const __m128d counts = _mm_set1_pd(window_count);
+    const __m128d c1s = _mm_set1_pd(c1);
+    const __m128d c2s = _mm_set1_pd(c2);
+    __m128d totals = _mm_setzero_pd();
+    for(; ix + 2 <= count; ix += 2)
+    {
+        const __m128d first_sum = load_sums(first_sums + ix);
+        const __m128d second_sum = load_sums(second_sums + ix);
+        const __m128d means_product = _mm_mul_pd(first_sum, second_sum);
+        const __m128d means_squared = _mm_add_pd(_mm_mul_pd(first_sum, first_sum), _mm_mul_pd(second_sum, second_sum));
+        const __m128d covariance = _mm_sub_pd(_mm_mul_pd(counts, load_sums(product_sums + ix)), means_product);
+        const __m128d variances = _mm_sub_pd(_mm_mul_pd(counts, _mm_add_pd(load_sums(first_squared_sums + ix), load_sums(second_squared_sums + ix))), means_squared);
+
+        const __m128d numerator = _mm_mul_pd(_mm_add_pd(_mm_add_pd(means_product, means_product), c1s), _mm_add_pd(_mm_add_pd(covariance, covariance), c2s));
+        const __m128d denominator = _mm_mul_pd(_mm_add_pd(means_squared, c1s), _mm_add_pd(variances, c2s));
+        totals = _mm_add_pd(totals, _mm_div_pd(numerator, denominator));
+    }
+
+    alignas(16) double total_lanes[2];
+    _mm_store_pd(total_lanes, totals);
+    total = total_lanes[0] + total_lanes[1];
+#endif
+
+    for(; ix < count; ++ix)
+    {
+        const double first_sum = first_sums[ix];
+        const double second_sum = second_sums[ix];
+        const double means_product = first_sum * second_sum;
+        const double means_squared = first_sum * first_sum + second_sum * second_sum;
+        const double covariance = window_count * product_sums[ix] - means_product;
+        const double variances = window_count * (static_cast<double>(first_squared_sums[ix]) + second_squared_sums[ix]) - means_squared;
+
+        total += ((2.0 * means_product + c1) * (2.0 * covariance + c2)) / ((means_squared + c1) * (variances + c2));
+    }
+
+    return total;
+}
+
+// Column sums over the window height slide down each range of window rows, so each row is added and removed
+// once regardless of the window size.  The total for each window row is kept separately and the rows are summed
+// in order, so the result does not depend on how the rows are divided.
+double compute_ssim(const Bitmap& first, const Bitmap& second)
+{
+    const size_t row_size = validate_compared_bitmaps(first, second);
+    if(row_size * first.height == 0)
+    {
+        return 1.0;
+    }
+
+    const size_t channel_count = get_bytes_per_pixel(first.format);
+    const unsigned int window_width = std::min(ssim_window_size, first.width);
+    const unsigned int window_height = std::min(ssim_window_size, first.height);
+    const size_t window_columns = get_ssim_window_count(first.width, window_width);
+    const size_t window_rows = get_ssim_window_count(first.height, window_height);
+    const unsigned int window_count = window_width * window_height;
+
+    const unsigned int width = first.width;
+    const unsigned int height = first.height;
+    const uint8_t* first_pixels = first.bitmap.data();
+    const uint8_t* second_pixels = second.bitmap.data();
+    std::vector<double> row_totals(window_rows);
+    parallel_for(window_rows, 4, [=, &row_totals](size_t row_begin, size_t row_end)
+    {
+        Ssim_sums column_sums(row_size);
+        const size_t top_row = get_ssim_window_start(row_begin, height, window_height);
+        for(size_t row = top_row; row < top_row + window_height; ++row)
+        {
+            update_ssim_column_sums(column_sums, first_pixels + row * row_size, second_pixels + row * row_size, row_size, true);
+        }
+
+        const size_t window_sum_count = window_columns * channel_count;
+        Ssim_sums window_sums(window_sum_count);
+        for(size_t window_row = row_begin; window_row < row_end; ++window_row)
+        {
+            // Windows are at least as tall as the step whenever there is more than one window row.  The last window
+            // row may move down by less than a step.
+            const size_t previous_top = (window_row > row_begin) ? get_ssim_window_start(window_row - 1, height, window_height) : 0;
+            const size_t window_top = (window_row > row_begin) ? get_ssim_window_start(window_row, height, window_height) : 0;
+            for(size_t removed = previous_top; removed < window_top; ++removed)
+            {
+                const size_t added = removed + window_height;
+                update_ssim_column_sums(column_sums, first_pixels + removed * row_size, second_pixels + removed * row_size, row_size, false);
+                update_ssim_column_sums(column_sums, first_pixels + added * row_size, second_pixels + added * row_size, row_size, true);
+            }
+
+            compute_ssim_window_sums(column_sums.first, channel_count, width, window_width, window_columns, window_sums.first.data());
+            compute_ssim_window_sums(column_sums.second, channel_count, width, window_width, window_columns, window_sums.second.data());
+            compute_ssim_window_sums(column_sums.first_squared, channel_count, width, window_width, window_columns, window_sums.first_squared.data());
+            compute_ssim_window_sums(column_sums.second_squared, channel_count, width, window_width, window_columns, window_sums.second_squared.data());
+            compute_ssim_window_sums(column_sums.product, channel_count, width, window_width, window_columns, window_sums.product.data());
+
+            row_totals[window_row] = sum_window_ssim(window_sums, window_sum_count, static_cast<double>(window_count));
+        }
+    });
+
+    double total = 0.0;
+    for(const double row_total : row_totals)
+    {
+        total += row_total;
+    }
+
+    return total / (static_cast<double>(window_columns) * window_rows * channel_count);
+}
+
+}
+
@@ -0,0 +1,28 @@
+#pragma once
+
+namespace ImageProcessing
+{
+
+// Differences are over all channels as stored, including alpha for images that have it.
+struct Bitmap_difference
+{
+    bool identical;
+    unsigned int first_difference_x;        // First differing pixel in row order.  Zero when identical.
+    unsigned int first_difference_y;
+    uint8_t maximum_absolute_difference;
+    double mean_absolute_difference;
+    double psnr;                            // Peak signal to noise ratio in decibels.  Infinite when identical.
+};
+
+// Both bitmaps must have the same width, height and format.  first_x and first_y may be null, and are
+// set to the first differing pixel in row order when the bitmaps differ.
+bool bitmaps_are_identical(const struct Bitmap& first, const struct Bitmap& second, _Out_opt_ unsigned int* first_x, _Out_opt_ unsigned int* first_y);
+Bitmap_difference compare_bitmaps(const struct Bitmap& first, const struct Bitmap& second);
+
+// Mean structural similarity over 8x8 windows starting every 4 pixels, averaged over the channels.  Where the
+// steps do not reach the right or bottom edge, a last window is aligned to it, so every pixel counts.  One for
+// identical bitmaps.  Windows are clipped to images smaller than 8 pixels.
+double compute_ssim(const struct Bitmap& first, const struct Bitmap& second);
+
+}
+
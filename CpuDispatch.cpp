@@ -0,0 +1,151 @@
+#include "PreCompile.h"
+#include "CpuDispatch.h"        // Pick up forward declarations to ensure correctness.
+#include <PortableRuntime/CheckException.h>
+
+#if defined(IMAGEPROCESSING_X86) && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+namespace ImageProcessing
+{
+
+#if defined(IMAGEPROCESSING_X86)
+struct Cpuid_registers
+{
+    unsigned int eax;
+    unsigned int ebx;
+    unsigned int ecx;
+    unsigned int edx;
+};
+
+static Cpuid_registers get_cpuid(unsigned int leaf, unsigned int subleaf) noexcept
+{
+    Cpuid_registers registers = {};
+
+#if defined(_MSC_VER)
+    int values[4];
+    __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+    registers = {static_cast<unsigned int>(values[0]), static_cast<unsigned int>(values[1]),
+                 static_cast<unsigned int>(values[2]), static_cast<unsigned int>(values[3])};
+#else
+    __cpuid_count(leaf, subleaf, registers.eax, registers.ebx, registers.ecx, registers.edx);
+#endif
+
+    return registers;
+}
+
+// Returns the register state the operating system saves on context switch.
+static uint64_t get_enabled_xsave_features() noexcept
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+static Simd_level detect_simd_level() noexcept
+{
+    Simd_level level = Simd_level::Scalar;
+
+#if defined(IMAGEPROCESSING_X86)
+    const unsigned int max_leaf = get_cpuid(0, 0).eax;
+    const Cpuid_registers leaf1 = get_cpuid(1, 0);
+
+    const bool has_ssse3 = (leaf1.ecx & (1u << 9)) != 0;
+    const bool has_sse4_1 = (leaf1.ecx & (1u << 19)) != 0;
+    if(!has_ssse3 || !has_sse4_1)
+    {
+        return level;
+    }
+    level = Simd_level::Sse4_1;
+
+    // AVX state must be enabled by the operating system, not just supported by the CPU.
+    const bool has_osxsave = (leaf1.ecx & (1u << 27)) != 0;
+    const bool has_avx = (leaf1.ecx & (1u << 28)) != 0;
+    if(!has_osxsave || !has_avx || (max_leaf < 7))
+    {
+        return level;
+    }
+
+    const uint64_t xsave_features = get_enabled_xsave_features();
+    const uint64_t ymm_state = 0x6;                 // XMM and YMM.
+    const uint64_t zmm_state = ymm_state | 0xe0;    // Opmask, and the upper halves of ZMM0-15 and ZMM16-31.
+
+    const Cpuid_registers leaf7 = get_cpuid(7, 0);
+    const bool has_avx2 = (leaf7.ebx & (1u << 5)) != 0;
+    if(!has_avx2 || ((xsave_features & ymm_state) != ymm_state))
+    {
+        return level;
+    }
+    level = Simd_level::Avx2;
+
+    const bool has_avx512f = (leaf7.ebx & (1u << 16)) != 0;
+    const bool has_avx512bw = (leaf7.ebx & (1u << 30)) != 0;
+    if(has_avx512f && has_avx512bw && ((xsave_features & zmm_state) == zmm_state))
+    {
+        level = Simd_level::Avx512;
+    }
+#endif
+
+    return level;
+}
+
+static Simd_level get_environment_simd_level(Simd_level detected_level) noexcept
+{
+    // Unknown values are ignored, and levels above the detected level are lowered to it.
+    const char* value = std::getenv("IMAGEPROCESSING_SIMD_LEVEL");
+    if(value == nullptr)
+    {
+        return detected_level;
+    }
+
+    Simd_level level = detected_level;
+    if(std::strcmp(value, u8"scalar") == 0)
+    {
+        level = Simd_level::Scalar;
+    }
+    else if(std::strcmp(value, u8"sse4.1") == 0)
+    {
+        level = Simd_level::Sse4_1;
+    }
+    else if(std::strcmp(value, u8"avx2") == 0)
+    {
+        level = Simd_level::Avx2;
+    }
+    else if(std::strcmp(value, u8"avx512") == 0)
+    {
+        level = Simd_level::Avx512;
+    }
+
+    return std::min(level, detected_level);
+}
+
+static std::atomic<Simd_level>& get_active_simd_level() noexcept
+{
+    static std::atomic<Simd_level> active_level(get_environment_simd_level(get_detected_simd_level()));
+    return active_level;
+}
+
+Simd_level get_detected_simd_level() noexcept
+{
+    static const Simd_level detected_level = detect_simd_level();
+    return detected_level;
+}
+
+Simd_level get_simd_level() noexcept
+{
+    return get_active_simd_level().load(std::memory_order_relaxed);
+}
+
+void set_simd_level(Simd_level level)
+{
+    CHECK_EXCEPTION(level <= get_detected_simd_level(), u8"SIMD level is not supported by this CPU.");
+    get_active_simd_level().store(level, std::memory_order_relaxed);
+}
+
+}
+
@@ -0,0 +1,27 @@
+#pragma once
+
+namespace ImageProcessing
+{
+
+// Instruction set levels that pixel kernels are specialized for.  Each level implies the ones before it.
+enum class Simd_level
+{
+    Scalar,
+    Sse4_1,
+    Avx2,
+    Avx512,     // AVX-512 F and BW.
+};
+
+// Returns the highest level supported by the CPU and operating system.  Detection runs once.
+Simd_level get_detected_simd_level() noexcept;
+
+// Returns the level that kernels are currently bound to.  This is the detected level, unless
+// lowered by the IMAGEPROCESSING_SIMD_LEVEL environment variable (scalar, sse4.1, avx2 or avx512)
+// or by set_simd_level.
+Simd_level get_simd_level() noexcept;
+
+// Forces kernels to a specific level.  The level must not be above the detected level.
+void set_simd_level(Simd_level level);
+
+}
+
@@ -5,8 +5,40 @@ namespace ImageProcessing
 
 std::vector<float> generate_simple_box_filter(unsigned int dimension);
 Bitmap apply_box_filter(const std::vector<float>& filter, unsigned int dimension, const Bitmap& source);
+Bitmap apply_box_filter(const std::vector<float>& filter, unsigned int dimension, const Bitmap& source, Blend_space blend_space);
+
+// Updates target, the box filter of source, after the pixels of source in dirty_rectangles have changed.  Only the
+// pixels of target within dimension / 2 of a dirty rectangle are filtered again, so the cost depends on the size of
+// the change, and the result is identical to filtering the whole image again.
+void update_box_filtered_bitmap(const std::vector<float>& filter, unsigned int dimension, const Bitmap& source,
+                                const std::vector<Bitmap_rectangle>& dirty_rectangles, Bitmap& target, Blend_space blend_space);
+
+// Out-of-core version for images of any size.  target must have the same dimensions as source.
+void apply_box_filter(const std::vector<float>& filter, unsigned int dimension, const class Tiled_bitmap& source, class Tiled_bitmap& target, Blend_space blend_space);
+
+// Version for the blocked layout, which keeps the rows a filter reads close together in memory.  Each region is
+// filtered from a padded copy, so only large filters are faster than on a Bitmap.  As with the other versions,
+// source must be Rgb.
+class Blocked_bitmap apply_box_filter(const std::vector<float>& filter, unsigned int dimension, const class Blocked_bitmap& source, Blend_space blend_space);
+
+// Median of each channel over a square window of dimension by dimension pixels, which must be odd.  Samples
+// outside the image repeat the edge pixels, as in apply_box_filter.  The median does not depend on the blend
+// space, because the conversion between sRGB and linear light preserves order.  The cost per pixel does not
+// depend on the dimension.
+Bitmap apply_median_filter(const Bitmap& source, unsigned int dimension);
+
+// Morphology with a square window of dimension by dimension pixels, which must be odd.  Each channel is
+// processed independently, so gray images, which are decoded as Rgb with equal channels, stay gray.  Windows
+// are clipped to the image.  The cost per pixel does not depend on the dimension.
+Bitmap erode_bitmap(const Bitmap& source, unsigned int dimension);
+Bitmap dilate_bitmap(const Bitmap& source, unsigned int dimension);
+Bitmap open_bitmap(const Bitmap& source, unsigned int dimension);       // Erode, then dilate.
+Bitmap close_bitmap(const Bitmap& source, unsigned int dimension);      // Dilate, then erode.
+
 void generate_topdown_gradient_in_place(Bitmap& target, const Color_rgb& start_color, const Color_rgb& end_color);
+void generate_topdown_gradient_in_place(Bitmap& target, const Color_rgb& start_color, const Color_rgb& end_color, Blend_space blend_space);
 void generate_bottomup_gradient_in_place(Bitmap& target, const Color_rgb& start_color, const Color_rgb& end_color);
+void generate_bottomup_gradient_in_place(Bitmap& target, const Color_rgb& start_color, const Color_rgb& end_color, Blend_space blend_space);
 
 }
 
@@ -0,0 +1,63 @@
+#include "PreCompile.h"
+#include "Gamma.h"              // Pick up forward declarations to ensure correctness.
+
+// sRGB transfer function:
+// https://en.wikipedia.org/wiki/SRGB
+namespace ImageProcessing
+{
+
+static double srgb_to_linear_exact(double value) noexcept
+{
+    return value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+}
+
+static double linear_to_srgb_exact(double value) noexcept
+{
+    return value <= 0.0031308 ? value * 12.92 : 1.055 * std::pow(value, 1.0 / 2.4) - 0.055;
+}
+
+struct Gamma_tables
+{
+    Gamma_tables() noexcept
+    {
+        for(unsigned int ix = 0; ix < 256; ++ix)
+        {
+            srgb_to_linear[ix] = static_cast<uint16_t>(std::lround(srgb_to_linear_exact(ix / 255.0) * 65535.0));
+        }
+
+        // Each entry covers a range of linear values, so sample the center of the range.
+        const unsigned int entry_count = 1u << linear_to_srgb_table_bits;
+        const unsigned int entry_range = 65536u >> linear_to_srgb_table_bits;
+        for(unsigned int ix = 0; ix < entry_count; ++ix)
+        {
+            const double linear = (ix * entry_range + (entry_range - 1) / 2.0) / 65535.0;
+            linear_to_srgb[ix] = static_cast<uint8_t>(std::lround(linear_to_srgb_exact(linear) * 255.0));
+        }
+
+        // Exact black and white must survive a round trip.
+        linear_to_srgb[0] = 0;
+        linear_to_srgb[entry_count - 1] = 255;
+    }
+
+    uint16_t srgb_to_linear[256];
+    uint8_t linear_to_srgb[1u << linear_to_srgb_table_bits];
+};
+
+static const Gamma_tables& get_gamma_tables() noexcept
+{
+    static const Gamma_tables tables;
+    return tables;
+}
+
+_Ret_notnull_ const uint16_t* get_srgb_to_linear_table() noexcept
+{
+    return get_gamma_tables().srgb_to_linear;
+}
+
+_Ret_notnull_ const uint8_t* get_linear_to_srgb_table() noexcept
+{
+    return get_gamma_tables().linear_to_srgb;
+}
+
+}
+
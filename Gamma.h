@@ -0,0 +1,33 @@
+#pragma once
+
+namespace ImageProcessing
+{
+
+// Linear light values are stored as 16-bit fixed point, where 65535 is full intensity.
+const unsigned int linear_to_srgb_table_bits = 12;
+
+// Returns the 256 entry table that converts an sRGB encoded byte to linear light.
+_Ret_notnull_ const uint16_t* get_srgb_to_linear_table() noexcept;
+
+// Returns the 4096 entry table that converts linear light to an sRGB encoded byte.
+// The table is indexed by the top linear_to_srgb_table_bits bits of the linear value.
+_Ret_notnull_ const uint8_t* get_linear_to_srgb_table() noexcept;
+
+inline uint16_t srgb_to_linear(uint8_t value) noexcept
+{
+    return get_srgb_to_linear_table()[value];
+}
+
+// Rounds and clamps an accumulated linear light value.
+inline uint16_t clamp_to_linear(float value) noexcept
+{
+    return static_cast<uint16_t>(std::min(std::max(value + 0.5f, 0.0f), 65535.0f));
+}
+
+inline uint8_t linear_to_srgb(uint16_t value) noexcept
+{
+    return get_linear_to_srgb_table()[value >> (16 - linear_to_srgb_table_bits)];
+}
+
+}
+
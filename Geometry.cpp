@@ -0,0 +1,262 @@
+#include "PreCompile.h"
+#include "Bitmap.h"
+#include "BlockedBitmap.h"
+#include "CpuDispatch.h"
+#include "Geometry.h"           // Pick up forward declarations to ensure correctness.
+#include "Parallel.h"
+#include "PixelKernels.h"
+
+namespace ImageProcessing
+{
+
+// Rotations and transposition read rows of the source and write columns of the target.  Both are
+// traversed in square tiles, so the rows of a tile in the target stay in cache until the tile is done.
+// Thirty-two by thirty-two pixels is 4KB of Color_rgba for each of the source and the target.
+const unsigned int tile_size = 32;
+
+static Bitmap make_target_bitmap(const Bitmap& bitmap, unsigned int width, unsigned int height)
+{
+    assert(bitmap.bitmap.size() >= static_cast<size_t>(bitmap.width) * bitmap.height * get_bytes_per_pixel(bitmap.format));
+
+    // Return value optimization expected.
+    return Bitmap{std::vector<uint8_t>(static_cast<size_t>(width) * height * get_bytes_per_pixel(bitmap.format)),
+                  width, height, bitmap.filtered, bitmap.format};
+}
+
+void reverse_pixel_row(_In_ const uint8_t* source, _Out_ uint8_t* target, size_t count, Pixel_format format)
+{
+    if(format == Pixel_format::Rgb)
+    {
+        get_pixel_kernels().reverse_pixels(reinterpret_cast<const Color_rgb*>(source), reinterpret_cast<Color_rgb*>(target), count);
+    }
+    else
+    {
+        // Four byte pixels need no shuffle, and the compiler vectorizes the reversal.
+        const auto source_rgba = reinterpret_cast<const Color_rgba*>(source);
+        std::reverse_copy(source_rgba, source_rgba + count, reinterpret_cast<Color_rgba*>(target));
+    }
+}
+
+// The pixel at (x, y) of the source is written to target[origin + x * x_step + y * y_step].
+template<typename Pixel>
+static void transform_tiled(const Bitmap& source, Bitmap& target, ptrdiff_t origin, ptrdiff_t x_step, ptrdiff_t y_step)
+{
+    const auto source_pixels = reinterpret_cast<const Pixel*>(source.bitmap.data());
+    const auto target_pixels = reinterpret_cast<Pixel*>(target.bitmap.data());
+    const unsigned int width = source.width;
+    const unsigned int height = source.height;
+
+    const size_t tile_rows = (height + tile_size - 1) / tile_size;
+    parallel_for(tile_rows, 1, [=](size_t tile_row_begin, size_t tile_row_end)
+    {
+        for(size_t tile_row = tile_row_begin; tile_row < tile_row_end; ++tile_row)
+        {
+            const unsigned int y_begin = static_cast<unsigned int>(tile_row * tile_size);
+            const unsigned int y_end = std::min(y_begin + tile_size, height);
+            for(unsigned int x_begin = 0; x_begin < width; x_begin += tile_size)
+            {
+                const unsigned int x_end = std::min(x_begin + tile_size, width);
+                for(unsigned int y = y_begin; y < y_end; ++y)
+                {
+                    const Pixel* source_row = source_pixels + static_cast<size_t>(y) * width;
+                    Pixel* target_pixel = target_pixels + origin + x_begin * x_step + y * y_step;
+                    for(unsigned int x = x_begin; x < x_end; ++x)
+                    {
+                        *target_pixel = source_row[x];
+                        target_pixel += x_step;
+                    }
+                }
+            }
+        }
+    });
+}
+
+static Bitmap transform_bitmap(const Bitmap& bitmap, bool swap_dimensions, ptrdiff_t origin, ptrdiff_t x_step, ptrdiff_t y_step)
+{
+    Bitmap target = swap_dimensions ? make_target_bitmap(bitmap, bitmap.height, bitmap.width) :
+                                      make_target_bitmap(bitmap, bitmap.width, bitmap.height);
+
+    if(bitmap.format == Pixel_format::Rgb)
+    {
+        transform_tiled<Color_rgb>(bitmap, target, origin, x_step, y_step);
+    }
+    else
+    {
+        transform_tiled<Color_rgba>(bitmap, target, origin, x_step, y_step);
+    }
+
+    // Return value optimization expected.
+    return target;
+}
+
+// Rows are independent, so each is copied or reversed in place of its mirror.
+static Bitmap mirror_rows(const Bitmap& bitmap, bool reverse_rows, bool reverse_pixels)
+{
+    Bitmap target = make_target_bitmap(bitmap, bitmap.width, bitmap.height);
+
+    const size_t row_size = static_cast<size_t>(bitmap.width) * get_bytes_per_pixel(bitmap.format);
+    const uint8_t* source_pixels = bitmap.bitmap.data();
+    uint8_t* target_pixels = target.bitmap.data();
+    const unsigned int width = bitmap.width;
+    const unsigned int height = bitmap.height;
+    const Pixel_format format = bitmap.format;
+
+    parallel_for(height, 16, [=](size_t row_begin, size_t row_end)
+    {
+        for(size_t row = row_begin; row < row_end; ++row)
+        {
+            const uint8_t* source_row = source_pixels + row * row_size;
+            uint8_t* target_row = target_pixels + (reverse_rows ? height - row - 1 : row) * row_size;
+            if(reverse_pixels)
+            {
+                reverse_pixel_row(source_row, target_row, width, format);
+            }
+            else
+            {
+                std::copy(source_row, source_row + row_size, target_row);
+            }
+        }
+    });
+
+    // Return value optimization expected.
+    return target;
+}
+
+Bitmap flip_bitmap_horizontally(const Bitmap& bitmap)
+{
+    return mirror_rows(bitmap, false, true);
+}
+
+Bitmap flip_bitmap_vertically(const Bitmap& bitmap)
+{
+    return mirror_rows(bitmap, true, false);
+}
+
+Bitmap rotate_bitmap_180(const Bitmap& bitmap)
+{
+    return mirror_rows(bitmap, true, true);
+}
+
+// The target is height pixels wide.  Source (x, y) moves to target (height - y - 1, x).
+Bitmap rotate_bitmap_90(const Bitmap& bitmap)
+{
+    const ptrdiff_t target_width = bitmap.height;
+    return transform_bitmap(bitmap, true, target_width - 1, target_width, -1);
+}
+
+// Source (x, y) moves to target (y, width - x - 1).
+Bitmap rotate_bitmap_270(const Bitmap& bitmap)
+{
+    const ptrdiff_t target_width = bitmap.height;
+    return transform_bitmap(bitmap, true, (static_cast<ptrdiff_t>(bitmap.width) - 1) * target_width, -target_width, 1);
+}
+
+// Source (x, y) moves to target (y, x).
+Bitmap transpose_bitmap(const Bitmap& bitmap)
+{
+    const ptrdiff_t target_width = bitmap.height;
+    return transform_bitmap(bitmap, true, 0, target_width, 1);
+}
+
+// Blocked images are transformed one target block at a time.  The source pixels of a target block are a
+// block sized square of the source, spanning at most four blocks, which is read into a small buffer first.
+// Target (x, y) is read from source (x_origin + x * x_x + y * x_y, y_origin + x * y_x + y * y_y).
+template<typename Pixel>
+static void transform_blocked(const Blocked_bitmap& source, Blocked_bitmap& target,
+                              ptrdiff_t x_origin, ptrdiff_t x_x, ptrdiff_t x_y, ptrdiff_t y_origin, ptrdiff_t y_x, ptrdiff_t y_y)
+{
+    const unsigned int block_size = Blocked_bitmap::block_size;
+    const unsigned int width = target.width();
+    const unsigned int height = target.height();
+
+    const size_t block_rows = (height + block_size - 1) / block_size;
+    parallel_for(block_rows, 1, [&, block_size, width, height](size_t block_row_begin, size_t block_row_end)
+    {
+        Pixel square[Blocked_bitmap::block_size * Blocked_bitmap::block_size];
+        for(size_t block_row = block_row_begin; block_row < block_row_end; ++block_row)
+        {
+            const unsigned int y_begin = static_cast<unsigned int>(block_row * block_size);
+            const unsigned int y_end = std::min(y_begin + block_size, height);
+            for(unsigned int x_begin = 0; x_begin < width; x_begin += block_size)
+            {
+                const unsigned int x_end = std::min(x_begin + block_size, width);
+
+                // The corners of the target block are corners of the source square.
+                const ptrdiff_t corner_x[2] = {x_origin + x_begin * x_x + y_begin * x_y, x_origin + (x_end - 1) * x_x + (y_end - 1) * x_y};
+                const ptrdiff_t corner_y[2] = {y_origin + x_begin * y_x + y_begin * y_y, y_origin + (x_end - 1) * y_x + (y_end - 1) * y_y};
+                const ptrdiff_t left = std::min(corner_x[0], corner_x[1]);
+                const ptrdiff_t top = std::min(corner_y[0], corner_y[1]);
+                const ptrdiff_t square_width = std::max(corner_x[0], corner_x[1]) - left + 1;
+                const ptrdiff_t square_height = std::max(corner_y[0], corner_y[1]) - top + 1;
+                source.read_region(static_cast<int>(left), static_cast<int>(top), static_cast<unsigned int>(square_width), static_cast<unsigned int>(square_height),
+                                   reinterpret_cast<uint8_t*>(square), square_width * sizeof(Pixel));
+
+                const ptrdiff_t x_step = x_x + y_x * square_width;
+                for(unsigned int y = y_begin; y < y_end; ++y)
+                {
+                    // Each row of a block is contiguous.
+                    Pixel* target_pixel = reinterpret_cast<Pixel*>(target.get_pixel(x_begin, y));
+                    ptrdiff_t source_index = (x_origin + x_begin * x_x + y * x_y - left) + (y_origin + x_begin * y_x + y * y_y - top) * square_width;
+                    for(unsigned int x = x_begin; x < x_end; ++x)
+                    {
+                        *target_pixel++ = square[source_index];
+                        source_index += x_step;
+                    }
+                }
+            }
+        }
+    });
+}
+
+static Blocked_bitmap transform_blocked_bitmap(const Blocked_bitmap& bitmap, bool swap_dimensions,
+                                               ptrdiff_t x_origin, ptrdiff_t x_x, ptrdiff_t x_y, ptrdiff_t y_origin, ptrdiff_t y_x, ptrdiff_t y_y)
+{
+    Blocked_bitmap target(swap_dimensions ? bitmap.height() : bitmap.width(), swap_dimensions ? bitmap.width() : bitmap.height(), bitmap.format());
+
+    if(bitmap.format() == Pixel_format::Rgb)
+    {
+        transform_blocked<Color_rgb>(bitmap, target, x_origin, x_x, x_y, y_origin, y_x, y_y);
+    }
+    else
+    {
+        transform_blocked<Color_rgba>(bitmap, target, x_origin, x_x, x_y, y_origin, y_x, y_y);
+    }
+
+    // Return value optimization expected.
+    return target;
+}
+
+Blocked_bitmap flip_bitmap_horizontally(const Blocked_bitmap& bitmap)
+{
+    return transform_blocked_bitmap(bitmap, false, static_cast<ptrdiff_t>(bitmap.width()) - 1, -1, 0, 0, 0, 1);
+}
+
+Blocked_bitmap flip_bitmap_vertically(const Blocked_bitmap& bitmap)
+{
+    return transform_blocked_bitmap(bitmap, false, 0, 1, 0, static_cast<ptrdiff_t>(bitmap.height()) - 1, 0, -1);
+}
+
+// The target is height pixels wide.  Target (x, y) is source (y, height - x - 1).
+Blocked_bitmap rotate_bitmap_90(const Blocked_bitmap& bitmap)
+{
+    return transform_blocked_bitmap(bitmap, true, 0, 0, 1, static_cast<ptrdiff_t>(bitmap.height()) - 1, -1, 0);
+}
+
+Blocked_bitmap rotate_bitmap_180(const Blocked_bitmap& bitmap)
+{
+    return transform_blocked_bitmap(bitmap, false, static_cast<ptrdiff_t>(bitmap.width()) - 1, -1, 0, static_cast<ptrdiff_t>(bitmap.height()) - 1, 0, -1);
+}
+
+// Target (x, y) is source (width - y - 1, x).
+Blocked_bitmap rotate_bitmap_270(const Blocked_bitmap& bitmap)
+{
+    return transform_blocked_bitmap(bitmap, true, static_cast<ptrdiff_t>(bitmap.width()) - 1, 0, -1, 0, 1, 0);
+}
+
+Blocked_bitmap transpose_bitmap(const Blocked_bitmap& bitmap)
+{
+    return transform_blocked_bitmap(bitmap, true, 0, 0, 1, 0, 1, 0);
+}
+
+}
+
@@ -0,0 +1,26 @@
+#pragma once
+
+namespace ImageProcessing
+{
+
+// Each returns a new image in the same Pixel_format as the source.  Rotations are clockwise.
+struct Bitmap flip_bitmap_horizontally(const struct Bitmap& bitmap);
+struct Bitmap flip_bitmap_vertically(const struct Bitmap& bitmap);
+struct Bitmap rotate_bitmap_90(const struct Bitmap& bitmap);
+struct Bitmap rotate_bitmap_180(const struct Bitmap& bitmap);
+struct Bitmap rotate_bitmap_270(const struct Bitmap& bitmap);
+struct Bitmap transpose_bitmap(const struct Bitmap& bitmap);
+
+// Versions for the blocked layout, which return a new blocked image.
+class Blocked_bitmap flip_bitmap_horizontally(const class Blocked_bitmap& bitmap);
+class Blocked_bitmap flip_bitmap_vertically(const class Blocked_bitmap& bitmap);
+class Blocked_bitmap rotate_bitmap_90(const class Blocked_bitmap& bitmap);
+class Blocked_bitmap rotate_bitmap_180(const class Blocked_bitmap& bitmap);
+class Blocked_bitmap rotate_bitmap_270(const class Blocked_bitmap& bitmap);
+class Blocked_bitmap transpose_bitmap(const class Blocked_bitmap& bitmap);
+
+// Copies a row of count pixels of the given format in reverse order.  source and target must not overlap.
+void reverse_pixel_row(_In_ const uint8_t* source, _Out_ uint8_t* target, size_t count, Pixel_format format);
+
+}
+
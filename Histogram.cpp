@@ -0,0 +1,220 @@
+#include "PreCompile.h"
+#include "Histogram.h"          // Pick up forward declarations to ensure correctness.
+#include "Bitmap.h"
+#include "Parallel.h"
+#include <PortableRuntime/CheckException.h>
+
+namespace ImageProcessing
+{
+
+// One lookup table per channel.
+typedef uint8_t Channel_lookup_tables[4][256];
+
+static unsigned int get_channel_count(Pixel_format format) noexcept
+{
+    return static_cast<unsigned int>(get_bytes_per_pixel(format));
+}
+
+// Each range of rows fills private histograms, which avoids contention on the bins, and the private
+// histograms are merged at the end of each range.  Minimum, maximum and mean are derived from the
+// merged histograms, so the image is read once.
+Bitmap_statistics compute_bitmap_statistics(const Bitmap& bitmap)
+{
+    const unsigned int channel_count = get_channel_count(bitmap.format);
+    const size_t row_size = static_cast<size_t>(bitmap.width) * channel_count;
+    assert(bitmap.bitmap.size() >= row_size * bitmap.height);
+
+    Bitmap_statistics statistics = {};
+    statistics.channel_count = channel_count;
+    statistics.pixel_count = static_cast<uint64_t>(bitmap.width) * bitmap.height;
+
+    const uint8_t* pixels = bitmap.bitmap.data();
+    std::mutex statistics_mutex;
+    parallel_for(bitmap.height, 16, [=, &statistics, &statistics_mutex](size_t row_begin, size_t row_end)
+    {
+        // Two histograms per channel are filled alternately, so that runs of equal values do not
+        // serialize on a single counter.
+        std::vector<uint64_t> private_histograms(2 * 4 * 256);
+        uint64_t* even_histograms = &private_histograms[0];
+        uint64_t* odd_histograms = &private_histograms[4 * 256];
+
+        for(size_t row = row_begin; row < row_end; ++row)
+        {
+            const uint8_t* source = pixels + row * row_size;
+            size_t ix = 0;
+            for(; ix + 2 * channel_count <= row_size; ix += 2 * channel_count)
+            {
+                for(unsigned int channel = 0; channel < channel_count; ++channel)
+                {
+                    ++even_histograms[channel * 256 + source[ix + channel]];
+                    ++odd_histograms[channel * 256 + source[ix + channel_count + channel]];
+                }
+            }
+            for(; ix < row_size; ix += channel_count)
+            {
+                for(unsigned int channel = 0; channel < channel_count; ++channel)
+                {
+                    ++even_histograms[channel * 256 + source[ix + channel]];
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(statistics_mutex);
+        for(unsigned int channel = 0; channel < channel_count; ++channel)
+        {
+            for(size_t value = 0; value < 256; ++value)
+            {
+                statistics.channels[channel].histogram[value] += even_histograms[channel * 256 + value] + odd_histograms[channel * 256 + value];
+            }
+        }
+    });
+
+    for(unsigned int channel = 0; channel < channel_count; ++channel)
+    {
+        Channel_statistics& channel_statistics = statistics.channels[channel];
+
+        uint64_t sum = 0;
+        bool found = false;
+        for(unsigned int value = 0; value < 256; ++value)
+        {
+            const uint64_t count = channel_statistics.histogram[value];
+            if(count > 0)
+            {
+                if(!found)
+                {
+                    channel_statistics.minimum = static_cast<uint8_t>(value);
+                    found = true;
+                }
+                channel_statistics.maximum = static_cast<uint8_t>(value);
+                sum += count * value;
+            }
+        }
+
+        channel_statistics.mean = (statistics.pixel_count > 0) ? static_cast<double>(sum) / statistics.pixel_count : 0.0;
+    }
+
+    return statistics;
+}
+
+// Applies a lookup table to every channel in a single pass over the image.
+static void apply_lookup_tables_in_place(Bitmap& bitmap, const Channel_lookup_tables& tables)
+{
+    const unsigned int channel_count = get_channel_count(bitmap.format);
+    const size_t row_size = static_cast<size_t>(bitmap.width) * channel_count;
+    assert(bitmap.bitmap.size() >= row_size * bitmap.height);
+
+    uint8_t* pixels = bitmap.bitmap.data();
+    parallel_for(bitmap.height, 16, [=, &tables](size_t row_begin, size_t row_end)
+    {
+        uint8_t* target = pixels + row_begin * row_size;
+        const size_t count = (row_end - row_begin) * row_size;
+        if(channel_count == 3)
+        {
+            for(size_t ix = 0; ix < count; ix += 3)
+            {
+                target[ix] = tables[0][target[ix]];
+                target[ix + 1] = tables[1][target[ix + 1]];
+                target[ix + 2] = tables[2][target[ix + 2]];
+            }
+        }
+        else
+        {
+            for(size_t ix = 0; ix < count; ix += 4)
+            {
+                target[ix] = tables[0][target[ix]];
+                target[ix + 1] = tables[1][target[ix + 1]];
+                target[ix + 2] = tables[2][target[ix + 2]];
+                target[ix + 3] = tables[3][target[ix + 3]];
+            }
+        }
+    });
+}
+
+static void fill_identity_tables(Channel_lookup_tables& tables) noexcept
+{
+    for(unsigned int channel = 0; channel < 4; ++channel)
+    {
+        for(unsigned int value = 0; value < 256; ++value)
+        {
+            tables[channel][value] = static_cast<uint8_t>(value);
+        }
+    }
+}
+
+// Remapping the color channels of premultiplied images would let color exceed alpha.
+static void validate_statistics(const Bitmap& bitmap, const Bitmap_statistics& statistics)
+{
+    CHECK_EXCEPTION(bitmap.format != Pixel_format::Rgba_premultiplied, u8"Image data is invalid.");
+    CHECK_EXCEPTION(statistics.channel_count == get_channel_count(bitmap.format), u8"Image data is invalid.");
+    CHECK_EXCEPTION(statistics.pixel_count == static_cast<uint64_t>(bitmap.width) * bitmap.height, u8"Image data is invalid.");
+}
+
+void apply_auto_levels_in_place(Bitmap& bitmap)
+{
+    apply_auto_levels_in_place(bitmap, compute_bitmap_statistics(bitmap));
+}
+
+void apply_auto_levels_in_place(Bitmap& bitmap, const Bitmap_statistics& statistics)
+{
+    validate_statistics(bitmap, statistics);
+
+    Channel_lookup_tables tables;
+    fill_identity_tables(tables);
+
+    // A channel with a single value is left unchanged.
+    for(unsigned int channel = 0; channel < 3; ++channel)
+    {
+        const unsigned int minimum = statistics.channels[channel].minimum;
+        const unsigned int maximum = statistics.channels[channel].maximum;
+        if(minimum < maximum)
+        {
+            const unsigned int range = maximum - minimum;
+            for(unsigned int value = 0; value < 256; ++value)
+            {
+                const unsigned int clamped = std::min(std::max(value, minimum), maximum);
+                tables[channel][value] = static_cast<uint8_t>(((clamped - minimum) * 255 + range / 2) / range);
+            }
+        }
+    }
+
+    apply_lookup_tables_in_place(bitmap, tables);
+}
+
+void equalize_histogram_in_place(Bitmap& bitmap)
+{
+    equalize_histogram_in_place(bitmap, compute_bitmap_statistics(bitmap));
+}
+
+// The lowest value present maps to 0 and the highest maps to 255.
+// http://en.wikipedia.org/wiki/Histogram_equalization
+void equalize_histogram_in_place(Bitmap& bitmap, const Bitmap_statistics& statistics)
+{
+    validate_statistics(bitmap, statistics);
+
+    Channel_lookup_tables tables;
+    fill_identity_tables(tables);
+
+    for(unsigned int channel = 0; channel < 3; ++channel)
+    {
+        const Channel_statistics& channel_statistics = statistics.channels[channel];
+        const uint64_t minimum_count = channel_statistics.histogram[channel_statistics.minimum];
+        const uint64_t range = statistics.pixel_count - minimum_count;
+
+        // A channel with a single value is left unchanged.
+        if(range > 0)
+        {
+            uint64_t cumulative_count = 0;
+            for(unsigned int value = 0; value < 256; ++value)
+            {
+                cumulative_count += channel_statistics.histogram[value];
+                const uint64_t above_minimum = (cumulative_count > minimum_count) ? cumulative_count - minimum_count : 0;
+                tables[channel][value] = static_cast<uint8_t>((above_minimum * 255 + range / 2) / range);
+            }
+        }
+    }
+
+    apply_lookup_tables_in_place(bitmap, tables);
+}
+
+}
+
@@ -0,0 +1,38 @@
+#pragma once
+
+namespace ImageProcessing
+{
+
+struct Channel_statistics
+{
+    uint64_t histogram[256];
+    uint8_t minimum;
+    uint8_t maximum;
+    double mean;
+};
+
+// Channels are red, green, blue and, for images with alpha, alpha.  Color channels are counted as stored,
+// so for premultiplied images they include the premultiplication.
+struct Bitmap_statistics
+{
+    Channel_statistics channels[4];
+    unsigned int channel_count;
+    uint64_t pixel_count;
+};
+
+Bitmap_statistics compute_bitmap_statistics(const struct Bitmap& bitmap);
+
+// Stretches each color channel linearly so that its minimum maps to 0 and its maximum maps to 255.
+// Alpha is unchanged.  The overloads without statistics compute them first.
+// Premultiplied images, and statistics that do not match the bitmap, throw.
+void apply_auto_levels_in_place(struct Bitmap& bitmap);
+void apply_auto_levels_in_place(struct Bitmap& bitmap, const Bitmap_statistics& statistics);
+
+// Remaps each color channel through its cumulative histogram so that its values are spread evenly.
+// Alpha is unchanged.  The overloads without statistics compute them first.
+// Premultiplied images, and statistics that do not match the bitmap, throw.
+void equalize_histogram_in_place(struct Bitmap& bitmap);
+void equalize_histogram_in_place(struct Bitmap& bitmap, const Bitmap_statistics& statistics);
+
+}
+
@@ -0,0 +1,70 @@
+#include "PreCompile.h"
+#include "Parallel.h"           // Pick up forward declarations to ensure correctness.
+
+namespace ImageProcessing
+{
+
+static size_t get_worker_count(size_t count, size_t minimum_range_size) noexcept
+{
+    // hardware_concurrency is allowed to return zero if the value is not computable.
+    const size_t hardware_thread_count = std::max(1u, std::thread::hardware_concurrency());
+    const size_t range_count = std::max<size_t>(1, count / std::max<size_t>(1, minimum_range_size));
+
+    return std::min(hardware_thread_count, range_count);
+}
+
+void parallel_for(size_t count, size_t minimum_range_size, const std::function<void (size_t, size_t)>& body)
+{
+    const size_t worker_count = get_worker_count(count, minimum_range_size);
+    if(worker_count <= 1)
+    {
+        if(count > 0)
+        {
+            body(0, count);
+        }
+
+        return;
+    }
+
+    std::vector<std::exception_ptr> exceptions(worker_count);
+    std::vector<std::thread> threads;
+    threads.reserve(worker_count - 1);
+
+    const auto run_range = [count, worker_count, &body, &exceptions](size_t worker)
+    {
+        const size_t begin = count * worker / worker_count;
+        const size_t end = count * (worker + 1) / worker_count;
+
+        try
+        {
+            body(begin, end);
+        }
+        catch(...)
+        {
+            exceptions[worker] = std::current_exception();
+        }
+    };
+
+    for(size_t worker = 1; worker < worker_count; ++worker)
+    {
+        threads.emplace_back(run_range, worker);
+    }
+
+    run_range(0);
+
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for(const auto& exception : exceptions)
+    {
+        if(exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+}
+
+}
+
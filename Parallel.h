@@ -0,0 +1,11 @@
+#pragma once
+
+namespace ImageProcessing
+{
+
+// Splits [0, count) into contiguous ranges and runs body(begin, end) for each range on its own thread.
+// The calling thread processes the first range.  Exceptions thrown by any range are rethrown on the calling thread.
+void parallel_for(size_t count, size_t minimum_range_size, const std::function<void (size_t, size_t)>& body);
+
+}
+
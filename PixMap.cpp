@@ -1,9 +1,21 @@
 #include "PreCompile.h"
 #include "PixMap.h"             // Pick up forward declarations to ensure correctness.
 #include "Bitmap.h"
+#include "CpuDispatch.h"
 #include "FileExtensionTest.h"
+#include "Parallel.h"
+#include "PixelKernels.h"
+#include "TiledBitmap.h"
 #include <PortableRuntime/CheckException.h>
 
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <cerrno>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
 // Portable PixMap specs:
 // https://en.wikipedia.org/wiki/Netpbm_format
 namespace ImageProcessing
@@ -11,12 +23,10 @@ namespace ImageProcessing
 
 enum class PixMap_format {P1, P2, P3, P4, P5, P6};
 
-constexpr char whitespace[] = {u8'\t', u8'\n', u8'\v', u8'\f', u8'\r', u8' '};
-
 static bool is_ascii_whitespace_character(char ch) noexcept
 {
-    constexpr char const* whitespace_end = whitespace + sizeof(whitespace);
-    return std::find(whitespace, whitespace_end, ch) != whitespace_end;
+    // Whitespace is \t, \n, \v, \f, \r and space.
+    return (ch == u8' ') || ((ch >= u8'\t') && (ch <= u8'\r'));
 }
 
 static bool is_valid_token_character(char ch) noexcept
@@ -45,7 +55,7 @@ static int parse_int32(_In_reads_to_ptr_(buffer_end) const char* buffer_start, c
     if(token_begin != token_end)
     {
         // The end of the token is the first whitespace character.
-        token_end = std::find_first_of(token_begin, token_end, whitespace, whitespace + sizeof(whitespace));
+        token_end = std::find_if(token_begin, token_end, is_ascii_whitespace_character);
 
         // Check for negative sign.
         bool negate = false;
@@ -101,7 +111,7 @@ static std::string parse_string(_In_reads_to_ptr_(buffer_end) const char* buffer
     if(token_begin != token_end)
     {
         // The end of the token is the first whitespace character.
-        token_end = std::find_first_of(token_begin, token_end, whitespace, whitespace + sizeof(whitespace));
+        token_end = std::find_if(token_begin, token_end, is_ascii_whitespace_character);
 
         // Add the characters into the result buffer.
         while((token_begin != token_end) && is_valid_token_character(*token_begin))
@@ -133,7 +143,7 @@ static void find_first_line_end(_In_reads_to_ptr_(buffer_end) const char* buffer
 
         // Eat the \n if the file has \r\n as the delimiter as on Windows.
         // NOTE: This will also eat \n\n, which is an optimization in scenarios of concern.
-        if(**line_end == u8'\n')
+        if((*line_end != buffer_end) && (**line_end == u8'\n'))
         {
             ++(*line_end);
         }
@@ -184,6 +194,155 @@ static PixMap_format pixmap_format_from_string(const std::string& value)
     return format;
 }
 
+// Calls handler(token_begin, token_end) for each token, skipping whitespace and comments, which run from a # at
+// the start of a token to the end of the line.  This matches the tokenization of the header parser.
+template<typename Handler>
+static void for_each_pixmap_token(_In_reads_to_ptr_(buffer_end) const char* buffer_start, const char* buffer_end, Handler handler)
+{
+    // Explicit loops, rather than searches with a predicate, let the compiler inline the character tests.
+    const char* iterator = buffer_start;
+    for(;;)
+    {
+        while((iterator != buffer_end) && is_ascii_whitespace_character(*iterator))
+        {
+            ++iterator;
+        }
+
+        if(iterator == buffer_end)
+        {
+            break;
+        }
+
+        if(*iterator == u8'#')
+        {
+            while((iterator != buffer_end) && (*iterator != u8'\r') && (*iterator != u8'\n'))
+            {
+                ++iterator;
+            }
+        }
+        else
+        {
+            const char* token_begin = iterator;
+            while((iterator != buffer_end) && !is_ascii_whitespace_character(*iterator))
+            {
+                ++iterator;
+            }
+            handler(token_begin, iterator);
+        }
+    }
+}
+
+// Parses the whitespace separated values of P1/P2/P3 data in parallel.  The data is split into chunks at points
+// where a token or comment cannot continue: after a newline, or after any whitespace if there are no comments.
+// The tokens in each chunk are counted, the counts are summed to find where each chunk's values go, and then
+// each chunk is parsed straight into the bitmap.
+static void parse_ascii_pixmap_data(_In_reads_to_ptr_(buffer_end) const char* buffer_start, const char* buffer_end, PixMap_format format,
+                                    size_t pixel_count, uint8_t image_max_value, std::vector<uint8_t>& data)
+{
+    const bool has_comments = std::find(buffer_start, buffer_end, u8'#') != buffer_end;
+    const auto is_chunk_boundary = [has_comments](char ch)
+    {
+        return has_comments ? ((ch == u8'\r') || (ch == u8'\n')) : is_ascii_whitespace_character(ch);
+    };
+
+    const size_t chunk_size = 256 * 1024;
+    const size_t buffer_size = buffer_end - buffer_start;
+    const size_t chunk_count = std::max<size_t>(1, buffer_size / chunk_size);
+
+    std::vector<const char*> chunk_starts(chunk_count + 1);
+    chunk_starts[0] = buffer_start;
+    chunk_starts[chunk_count] = buffer_end;
+    for(size_t ix = 1; ix < chunk_count; ++ix)
+    {
+        const char* split = std::max(chunk_starts[ix - 1], buffer_start + ix * (buffer_size / chunk_count));
+        split = std::find_if(split, buffer_end, is_chunk_boundary);
+        chunk_starts[ix] = (split != buffer_end) ? split + 1 : buffer_end;
+    }
+
+    std::vector<size_t> token_offsets(chunk_count + 1);
+    parallel_for(chunk_count, 1, [&chunk_starts, &token_offsets, has_comments](size_t chunk_begin, size_t chunk_end)
+    {
+        for(size_t ix = chunk_begin; ix < chunk_end; ++ix)
+        {
+            size_t token_count = 0;
+            if(has_comments)
+            {
+                for_each_pixmap_token(chunk_starts[ix], chunk_starts[ix + 1], [&token_count](const char*, const char*)
+                {
+                    ++token_count;
+                });
+            }
+            else
+            {
+                // Without comments, tokens begin wherever whitespace is followed by anything else.  Chunks begin
+                // after whitespace, or at the start of the data, which follows the whitespace delimited header.
+                bool previous_whitespace = true;
+                for(const char* iterator = chunk_starts[ix]; iterator != chunk_starts[ix + 1]; ++iterator)
+                {
+                    const bool current_whitespace = is_ascii_whitespace_character(*iterator);
+                    token_count += previous_whitespace && !current_whitespace;
+                    previous_whitespace = current_whitespace;
+                }
+            }
+            token_offsets[ix + 1] = token_count;
+        }
+    });
+
+    for(size_t ix = 0; ix < chunk_count; ++ix)
+    {
+        token_offsets[ix + 1] += token_offsets[ix];
+    }
+
+    // P1/P2 specify one value per pixel, and P3 three.
+    const bool is_gray = (format == PixMap_format::P1) || (format == PixMap_format::P2);
+    CHECK_EXCEPTION(token_offsets[chunk_count] == (is_gray ? pixel_count : pixel_count * sizeof(Color_rgb)), u8"Image data is invalid.");
+    data.resize(pixel_count * sizeof(Color_rgb));
+
+    parallel_for(chunk_count, 1, [&, is_gray, image_max_value](size_t chunk_begin, size_t chunk_end)
+    {
+        const uint8_t scale = 255 / image_max_value;
+        for(size_t ix = chunk_begin; ix < chunk_end; ++ix)
+        {
+            uint8_t* target = data.data() + token_offsets[ix] * (is_gray ? sizeof(Color_rgb) : 1);
+            for_each_pixmap_token(chunk_starts[ix], chunk_starts[ix + 1], [&target, is_gray, image_max_value, scale](const char* token_begin, const char* token_end)
+            {
+                // Short tokens of digits cannot overflow, so only other tokens need the full parser.
+                int token = 0;
+                const char* iterator = token_begin;
+                if(token_end - token_begin <= 9)
+                {
+                    for(; (iterator != token_end) && is_valid_integer_character(*iterator); ++iterator)
+                    {
+                        token = token * 10 + (*iterator - u8'0');
+                    }
+                }
+
+                if(iterator != token_end)
+                {
+                    bool success;
+                    token = parse_int32(token_begin, token_end, &iterator, &success);
+                    CHECK_EXCEPTION(success, u8"Image data is invalid.");
+                }
+
+                CHECK_EXCEPTION((token >= 0) && (token <= image_max_value), u8"Image data is invalid.");
+
+                if(is_gray)
+                {
+                    // P1/P2 only specify a single channel.  Expand to three channels here (R/G/B).
+                    const uint8_t value = static_cast<uint8_t>(token) * scale;
+                    *target++ = value;
+                    *target++ = value;
+                    *target++ = value;
+                }
+                else
+                {
+                    *target++ = static_cast<uint8_t>(token);
+                }
+            });
+        }
+    });
+}
+
 bool is_pixmap_file_name(_In_z_ const char* file_name)
 {
     return file_has_extension_case_sensitive(file_name, ".pbm") ||
@@ -209,26 +368,36 @@ Bitmap decode_bitmap_from_pixmap_memory(_In_reads_(size) const uint8_t* pixmap_m
 
     while(line_begin != buffer_end)
     {
+        if((mode == Parse_mode::data) &&
+           ((format == PixMap_format::P1) || (format == PixMap_format::P2) || (format == PixMap_format::P3)))
+        {
+            CHECK_EXCEPTION((image_width >= 0) && (image_height >= 0), u8"Image data is invalid.");
+            parse_ascii_pixmap_data(line_begin, buffer_end, format, static_cast<size_t>(image_width) * image_height, image_max_value, data);
+            break;
+        }
+
         if(line_begin == line_end)
         {
             find_first_line_end(line_begin, buffer_end, &line_end);
         }
 
-        if((mode != Parse_mode::data) || (format == PixMap_format::P1) || (format == PixMap_format::P2) || (format == PixMap_format::P3))
+        if(mode != Parse_mode::data)
         {
             find_first_token_begin(line_begin, line_end, &line_begin);
         }
         else
         {
-            // P4/P5/P6 data.
-            find_first_line_end(line_begin, buffer_end, &line_begin);
+            // P4/P5/P6 data follows exactly one whitespace character after the last header value.
+            // The data may begin with bytes that look like newlines or comments, so it must not be skipped as text.
+            CHECK_EXCEPTION(is_ascii_whitespace_character(line_begin[0]), u8"Image data is invalid.");
+            ++line_begin;
             line_end = buffer_end;
         }
 
         if(line_begin != line_end)
         {
             bool success;
-            if(line_begin[0] == u8'#')
+            if((mode != Parse_mode::data) && (line_begin[0] == u8'#'))
             {
                 line_begin = line_end;
             }
@@ -275,90 +444,54 @@ Bitmap decode_bitmap_from_pixmap_memory(_In_reads_(size) const uint8_t* pixmap_m
             }
             else if(mode == Parse_mode::data)
             {
-                if((format == PixMap_format::P1) ||
-                   (format == PixMap_format::P2) ||
-                   (format == PixMap_format::P3))
+                // Black and white.
+                if(format == PixMap_format::P4)
                 {
-                    int token = parse_int32(line_begin, line_end, &line_begin, &success);
-                    CHECK_EXCEPTION(success, u8"Image data is invalid.");
-                    CHECK_EXCEPTION((token >= 0) && (token <= image_max_value), u8"Image data is invalid.");
+                    CHECK_EXCEPTION(line_end == (line_begin + (image_width * image_height) / 8), u8"Image data is invalid.");
 
-                    if((format == PixMap_format::P1) ||
-                       (format == PixMap_format::P2))
+                    std::for_each(line_begin, line_end, [image_max_value, &data](uint8_t value)
                     {
-                        // Black and white / Grayscale.
-                        CHECK_EXCEPTION((data.size() <= image_width * image_height * sizeof(Color_rgb) - 3), u8"Image data is invalid.");
+                        for(int i = 0; i < 8; ++i)
+                        {
+                            uint8_t color = 255 - (((value & 0x80) >> 7) * 255);
 
-                        const uint8_t scale = 255 / image_max_value;
+                            // P4 only specifies a single channel.  Expand to three channels here (R/G/B).
+                            data.push_back(color);
+                            data.push_back(color);
+                            data.push_back(color);
 
-                        // P1/P2 only specify a single channel.  Expand to three channels here (R/G/B).
-                        data.push_back(static_cast<uint8_t>(token) * scale);
-                        data.push_back(static_cast<uint8_t>(token) * scale);
-                        data.push_back(static_cast<uint8_t>(token) * scale);
-                    }
-                    else
-                    {
-                        // RGB.
-                        assert(format == PixMap_format::P3);
-                        CHECK_EXCEPTION((data.size() < image_width * image_height * sizeof(Color_rgb)), u8"Image data is invalid.");
-                        data.push_back(static_cast<uint8_t>(token));
-                    }
+                            value <<= 1;
+                        }
+                    });
                 }
-                else
+                // Grayscale.
+                else if(format == PixMap_format::P5)
                 {
-                    // Black and white.
-                    if(format == PixMap_format::P4)
-                    {
-                        CHECK_EXCEPTION(line_end == (line_begin + (image_width * image_height) / 8), u8"Image data is invalid.");
+                    CHECK_EXCEPTION(line_end == (line_begin + (image_width * image_height)), u8"Image data is invalid.");
 
-                        std::for_each(line_begin, line_end, [image_max_value, &data](uint8_t value)
-                        {
-                            for(int i = 0; i < 8; ++i)
-                            {
-                                uint8_t color = 255 - (((value & 0x80) >> 7) * 255);
-
-                                // P4 only specifies a single channel.  Expand to three channels here (R/G/B).
-                                data.push_back(color);
-                                data.push_back(color);
-                                data.push_back(color);
-
-                                value <<= 1;
-                            }
-                        });
-                    }
-                    // Grayscale.
-                    else if(format == PixMap_format::P5)
-                    {
-                        CHECK_EXCEPTION(line_end == (line_begin + (image_width * image_height)), u8"Image data is invalid.");
-
-                        const uint8_t scale = 255 / image_max_value;
+                    const uint8_t scale = 255 / image_max_value;
 
-                        std::for_each(line_begin, line_end, [image_max_value, scale, &data](const uint8_t& value)
-                        {
-                            CHECK_EXCEPTION((value >= 0) && (value <= image_max_value), u8"Image data is invalid.");
+                    // P5 only specifies a single channel.  Expand to three channels here (R/G/B).
+                    data.resize(image_width * image_height * sizeof(Color_rgb));
+                    const bool valid = get_pixel_kernels().expand_gray(reinterpret_cast<const uint8_t*>(line_begin), image_max_value, scale,
+                                                                       reinterpret_cast<Color_rgb*>(data.data()), image_width * image_height);
+                    CHECK_EXCEPTION(valid, u8"Image data is invalid.");
+                }
+                // RGB.
+                else
+                {
+                    assert(format == PixMap_format::P6);
+                    CHECK_EXCEPTION(line_end == (line_begin + (image_width * image_height * sizeof(Color_rgb))), u8"Image data is invalid.");
 
-                            // P5 only specifies a single channel.  Expand to three channels here (R/G/B).
-                            data.push_back(value * scale);
-                            data.push_back(value * scale);
-                            data.push_back(value * scale);
-                        });
-                    }
                     // RGB.
-                    else
+                    std::copy_if(line_begin, line_end, std::back_inserter(data), [image_max_value](const uint8_t& value) -> bool
                     {
-                        assert(format == PixMap_format::P6);
-                        CHECK_EXCEPTION(line_end == (line_begin + (image_width * image_height * sizeof(Color_rgb))), u8"Image data is invalid.");
-
-                        // RGB.
-                        std::copy_if(line_begin, line_end, std::back_inserter(data), [image_max_value](const uint8_t& value) -> bool
-                        {
-                            CHECK_EXCEPTION((value >= 0) && (value <= image_max_value), u8"Image data is invalid.");
-                            return true;
-                        });
-                    }
-
-                    line_begin = line_end;
+                        CHECK_EXCEPTION((value >= 0) && (value <= image_max_value), u8"Image data is invalid.");
+                        return true;
+                    });
                 }
+
+                line_begin = line_end;
             }
         }
     }
@@ -370,5 +503,388 @@ Bitmap decode_bitmap_from_pixmap_memory(_In_reads_(size) const uint8_t* pixmap_m
     return bitmap;
 }
 
+// Parses the header of a binary pixmap, skipping comments, and returns the offset of the pixel data.
+// As in the in-memory decoder, the data starts after the single whitespace character that follows the maximum value.
+static size_t parse_binary_pixmap_header(_In_reads_to_ptr_(buffer_end) const char* buffer_start, const char* buffer_end,
+                                         _Out_ PixMap_format* format, _Out_ int* image_width, _Out_ int* image_height, _Out_ uint8_t* image_max_value)
+{
+    int values[3] = {};
+    size_t value_count = 0;
+    bool has_format = false;
+
+    const char* iterator = buffer_start;
+    while(value_count < 3)
+    {
+        find_first_token_begin(iterator, buffer_end, &iterator);
+        CHECK_EXCEPTION(iterator != buffer_end, u8"Image data is invalid.");
+
+        bool success;
+        if(iterator[0] == u8'#')
+        {
+            find_first_line_end(iterator, buffer_end, &iterator);
+        }
+        else if(!has_format)
+        {
+            const auto token = parse_string(iterator, buffer_end, &iterator, &success);
+            CHECK_EXCEPTION(success, u8"Image data is invalid.");
+
+            *format = pixmap_format_from_string(token);
+            CHECK_EXCEPTION((*format == PixMap_format::P5) || (*format == PixMap_format::P6), u8"Image data is invalid.");
+            has_format = true;
+        }
+        else
+        {
+            values[value_count++] = parse_int32(iterator, buffer_end, &iterator, &success);
+            CHECK_EXCEPTION(success, u8"Image data is invalid.");
+        }
+    }
+
+    CHECK_EXCEPTION((values[0] > 0) && (values[1] > 0), u8"Image data is invalid.");
+    CHECK_EXCEPTION((values[2] > 0) && (values[2] <= 255), u8"Image data is invalid.");
+    *image_width = values[0];
+    *image_height = values[1];
+    *image_max_value = static_cast<uint8_t>(values[2]);
+
+    // Exactly one whitespace character separates the maximum value from the data.
+    CHECK_EXCEPTION((iterator != buffer_end) && is_ascii_whitespace_character(iterator[0]), u8"Image data is invalid.");
+    return iterator + 1 - buffer_start;
+}
+
+// Converts count pixels of a P5 or P6 row to Rgb, checking that no value is above max_value.
+static void convert_binary_pixmap_row(PixMap_format format, _In_ const uint8_t* source, uint8_t max_value, _Out_writes_(count) Color_rgb* target, size_t count)
+{
+    if(format == PixMap_format::P5)
+    {
+        // P5 only specifies a single channel.  Expand to three channels here (R/G/B).
+        const bool valid = get_pixel_kernels().expand_gray(source, max_value, 255 / max_value, target, count);
+        CHECK_EXCEPTION(valid, u8"Image data is invalid.");
+    }
+    else
+    {
+        const uint8_t* source_end = source + count * sizeof(Color_rgb);
+        CHECK_EXCEPTION(std::all_of(source, source_end, [max_value](uint8_t value)
+        {
+            return value <= max_value;
+        }), u8"Image data is invalid.");
+        std::copy(source, source_end, reinterpret_cast<uint8_t*>(target));
+    }
+}
+
+// Only the binary P5/P6 formats are streamed, as their rows have a fixed size and can be read in place.
+Tiled_bitmap decode_tiled_bitmap_from_pixmap_file(_In_z_ const char* file_name, const Tiled_bitmap_options& options)
+{
+    std::ifstream file(file_name, std::ios::in | std::ios::binary | std::ios::ate);
+    CHECK_EXCEPTION(file.good(), u8"Could not open image file.");
+    const auto file_size = static_cast<uint64_t>(file.tellg());
+    file.seekg(0, std::ios::beg);
+
+    // Headers are a few dozen bytes, but comments may make them longer.
+    std::vector<char> header(static_cast<size_t>(std::min<uint64_t>(file_size, 65536)));
+    file.read(header.data(), header.size());
+    CHECK_EXCEPTION(file.good(), u8"Could not read image file.");
+
+    PixMap_format format;
+    int image_width, image_height;
+    uint8_t image_max_value;
+    const size_t data_offset = parse_binary_pixmap_header(header.data(), header.data() + header.size(), &format, &image_width, &image_height, &image_max_value);
+
+    const size_t file_pixel_size = (format == PixMap_format::P5) ? 1 : sizeof(Color_rgb);
+    const size_t row_size = image_width * file_pixel_size;
+    CHECK_EXCEPTION(file_size - data_offset == static_cast<uint64_t>(row_size) * image_height, u8"Image data is invalid.");
+
+    Tiled_bitmap bitmap(image_width, image_height, Pixel_format::Rgb, options);
+
+    file.seekg(static_cast<std::streamoff>(data_offset), std::ios::beg);
+    std::vector<uint8_t> file_row(row_size);
+    std::vector<Color_rgb> target_row(image_width);
+    for(int iy = 0; iy < image_height; ++iy)
+    {
+        file.read(reinterpret_cast<char*>(file_row.data()), row_size);
+        CHECK_EXCEPTION(file.good(), u8"Could not read image file.");
+
+        convert_binary_pixmap_row(format, file_row.data(), image_max_value, target_row.data(), image_width);
+        bitmap.write_region(0, iy, image_width, 1, reinterpret_cast<const uint8_t*>(target_row.data()), image_width * sizeof(Color_rgb));
+    }
+
+    // Return value optimization expected.
+    return bitmap;
+}
+
+// Returns true for the P5/P6 formats, whose rows have a fixed size and can be found without parsing the data.
+static bool is_binary_pixmap(_In_reads_to_ptr_(buffer_end) const char* buffer_start, const char* buffer_end) noexcept
+{
+    const char* magic;
+    find_first_token_begin(buffer_start, buffer_end, &magic);
+    return (buffer_end - magic >= 2) && (magic[0] == u8'P') && ((magic[1] == u8'5') || (magic[1] == u8'6'));
+}
+
+// Binary P5/P6 rows have a fixed size, so only the sampled pixels are read and validated.  The ASCII
+// formats must be parsed in full to find any pixel, so they are decoded and then sampled.
+Bitmap decode_preview_from_pixmap_memory(_In_reads_(size) const uint8_t* pixmap_memory, size_t size, unsigned int preview_size)
+{
+    const char* buffer_start = reinterpret_cast<const char*>(pixmap_memory);
+    const char* buffer_end = buffer_start + size;
+
+    if(!is_binary_pixmap(buffer_start, buffer_end))
+    {
+        Bitmap bitmap = decode_bitmap_from_pixmap_memory(pixmap_memory, size);
+        const unsigned int reduction = get_preview_reduction(bitmap.width, bitmap.height, preview_size);
+        if(reduction == 1)
+        {
+            return bitmap;
+        }
+
+        const unsigned int preview_width = get_reduced_size(bitmap.width, reduction);
+        const unsigned int preview_height = get_reduced_size(bitmap.height, reduction);
+        Bitmap preview{std::vector<uint8_t>(static_cast<size_t>(preview_width) * preview_height * sizeof(Color_rgb)), preview_width, preview_height, true};
+
+        const auto pixels = reinterpret_cast<const Color_rgb*>(bitmap.bitmap.data());
+        auto preview_pixels = reinterpret_cast<Color_rgb*>(preview.bitmap.data());
+        for(unsigned int iy = 0; iy < preview_height; ++iy)
+        {
+            for(unsigned int ix = 0; ix < preview_width; ++ix)
+            {
+                *preview_pixels++ = pixels[static_cast<size_t>(iy) * reduction * bitmap.width + ix * reduction];
+            }
+        }
+
+        // Return value optimization expected.
+        return preview;
+    }
+
+    PixMap_format format;
+    int image_width, image_height;
+    uint8_t image_max_value;
+    const size_t data_offset = parse_binary_pixmap_header(buffer_start, buffer_end, &format, &image_width, &image_height, &image_max_value);
+
+    const size_t file_pixel_size = (format == PixMap_format::P5) ? 1 : sizeof(Color_rgb);
+    const size_t row_size = image_width * file_pixel_size;
+    CHECK_EXCEPTION(size - data_offset == row_size * image_height, u8"Image data is invalid.");
+
+    const unsigned int reduction = get_preview_reduction(image_width, image_height, preview_size);
+    if(reduction == 1)
+    {
+        return decode_bitmap_from_pixmap_memory(pixmap_memory, size);
+    }
+
+    const unsigned int preview_width = get_reduced_size(image_width, reduction);
+    const unsigned int preview_height = get_reduced_size(image_height, reduction);
+    Bitmap bitmap{std::vector<uint8_t>(static_cast<size_t>(preview_width) * preview_height * sizeof(Color_rgb)), preview_width, preview_height, true};
+
+    std::vector<uint8_t> sampled_row(preview_width * file_pixel_size);
+    for(unsigned int iy = 0; iy < preview_height; ++iy)
+    {
+        const uint8_t* file_row = pixmap_memory + data_offset + static_cast<size_t>(iy) * reduction * row_size;
+        for(unsigned int ix = 0; ix < preview_width; ++ix)
+        {
+            const uint8_t* file_pixel = file_row + static_cast<size_t>(ix) * reduction * file_pixel_size;
+            std::copy(file_pixel, file_pixel + file_pixel_size, &sampled_row[ix * file_pixel_size]);
+        }
+
+        auto target_row = reinterpret_cast<Color_rgb*>(bitmap.bitmap.data()) + static_cast<size_t>(iy) * preview_width;
+        convert_binary_pixmap_row(format, sampled_row.data(), image_max_value, target_row, preview_width);
+    }
+
+    // Return value optimization expected.
+    return bitmap;
+}
+
+// Binary P5/P6 rows are found by their offsets, so only the rows of the region are read, and only the pixels
+// of the region are validated.  The ASCII formats are decoded in full and then cropped.
+Bitmap decode_region_from_pixmap_memory(_In_reads_(size) const uint8_t* pixmap_memory, size_t size,
+                                        unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+{
+    const char* buffer_start = reinterpret_cast<const char*>(pixmap_memory);
+    const char* buffer_end = buffer_start + size;
+
+    // The region is allocated only after it is checked against the image, so a bad region can not request a huge allocation.
+    const size_t region_row_size = static_cast<size_t>(width) * sizeof(Color_rgb);
+
+    if(!is_binary_pixmap(buffer_start, buffer_end))
+    {
+        const Bitmap bitmap = decode_bitmap_from_pixmap_memory(pixmap_memory, size);
+        CHECK_EXCEPTION((static_cast<uint64_t>(x) + width <= bitmap.width) && (static_cast<uint64_t>(y) + height <= bitmap.height), u8"Region is outside the image.");
+
+        Bitmap region{std::vector<uint8_t>(region_row_size * height), width, height, true};
+
+        const size_t row_size = static_cast<size_t>(bitmap.width) * sizeof(Color_rgb);
+        for(unsigned int iy = 0; iy < height; ++iy)
+        {
+            const uint8_t* source_row = bitmap.bitmap.data() + (y + iy) * row_size + x * sizeof(Color_rgb);
+            std::copy(source_row, source_row + region_row_size, region.bitmap.data() + iy * region_row_size);
+        }
+
+        // Return value optimization expected.
+        return region;
+    }
+
+    PixMap_format format;
+    int image_width, image_height;
+    uint8_t image_max_value;
+    const size_t data_offset = parse_binary_pixmap_header(buffer_start, buffer_end, &format, &image_width, &image_height, &image_max_value);
+
+    const size_t file_pixel_size = (format == PixMap_format::P5) ? 1 : sizeof(Color_rgb);
+    const size_t row_size = image_width * file_pixel_size;
+    CHECK_EXCEPTION(size - data_offset == row_size * image_height, u8"Image data is invalid.");
+    CHECK_EXCEPTION((static_cast<uint64_t>(x) + width <= static_cast<unsigned int>(image_width)) &&
+                    (static_cast<uint64_t>(y) + height <= static_cast<unsigned int>(image_height)), u8"Region is outside the image.");
+
+    Bitmap region{std::vector<uint8_t>(region_row_size * height), width, height, true};
+    for(unsigned int iy = 0; iy < height; ++iy)
+    {
+        const uint8_t* file_row = pixmap_memory + data_offset + (y + iy) * row_size + x * file_pixel_size;
+        convert_binary_pixmap_row(format, file_row, image_max_value, reinterpret_cast<Color_rgb*>(region.bitmap.data() + iy * region_row_size), width);
+    }
+
+    // Return value optimization expected.
+    return region;
+}
+
+static bool is_bitmap_grayscale(const Bitmap& bitmap) noexcept
+{
+    const auto pixels = reinterpret_cast<const Color_rgb*>(bitmap.bitmap.data());
+    const auto pixels_end = pixels + bitmap.bitmap.size() / sizeof(Color_rgb);
+
+    return std::all_of(pixels, pixels_end, [](const Color_rgb& color)
+    {
+        return (color.red == color.green) && (color.green == color.blue);
+    });
+}
+
+static std::vector<uint8_t> extract_gray_channel(const Bitmap& bitmap)
+{
+    const auto pixels = reinterpret_cast<const Color_rgb*>(bitmap.bitmap.data());
+    const auto pixels_end = pixels + bitmap.bitmap.size() / sizeof(Color_rgb);
+
+    std::vector<uint8_t> gray(pixels_end - pixels);
+    std::transform(pixels, pixels_end, gray.begin(), [](const Color_rgb& color)
+    {
+        return color.red;
+    });
+
+    return gray;
+}
+
+static std::string make_pixmap_header(PixMap_format format, unsigned int width, unsigned int height)
+{
+    assert((format == PixMap_format::P5) || (format == PixMap_format::P6));
+
+    std::string header(format == PixMap_format::P5 ? u8"P5\n" : u8"P6\n");
+    header += std::to_string(width);
+    header += u8' ';
+    header += std::to_string(height);
+    header += u8"\n255\n";
+
+    return header;
+}
+
+static void validate_bitmap_for_pixmap(const Bitmap& bitmap)
+{
+    CHECK_EXCEPTION(bitmap.bitmap.size() == static_cast<size_t>(bitmap.width) * bitmap.height * sizeof(Color_rgb), u8"Image data is invalid.");
+}
+
+std::vector<uint8_t> encode_pixmap_from_bitmap(const Bitmap& bitmap, bool detect_grayscale)
+{
+    validate_bitmap_for_pixmap(bitmap);
+
+    const bool grayscale = detect_grayscale && is_bitmap_grayscale(bitmap);
+    const std::string header = make_pixmap_header(grayscale ? PixMap_format::P5 : PixMap_format::P6, bitmap.width, bitmap.height);
+    const size_t pixel_count = static_cast<size_t>(bitmap.width) * bitmap.height;
+
+    std::vector<uint8_t> pixmap(header.size() + (grayscale ? pixel_count : pixel_count * sizeof(Color_rgb)));
+    const auto data_start = std::copy(header.cbegin(), header.cend(), pixmap.begin());
+    if(grayscale)
+    {
+        const auto pixels = reinterpret_cast<const Color_rgb*>(bitmap.bitmap.data());
+        std::transform(pixels, pixels + pixel_count, data_start, [](const Color_rgb& color)
+        {
+            return color.red;
+        });
+    }
+    else
+    {
+        std::copy(bitmap.bitmap.cbegin(), bitmap.bitmap.cend(), data_start);
+    }
+
+    // Return value optimization expected.
+    return pixmap;
+}
+
+// Writes the header and the pixel data without concatenating them, so the pixel data is never copied.
+// Short writes are resumed where they left off.
+static void write_buffers(int file_descriptor, _In_reads_(buffer_count) const std::pair<const uint8_t*, size_t>* buffers, size_t buffer_count)
+{
+#if defined(_WIN32)
+    // Windows has no writev on CRT file descriptors, so issue one write per buffer.
+    for(size_t ix = 0; ix < buffer_count; ++ix)
+    {
+        const uint8_t* start = buffers[ix].first;
+        size_t remaining = buffers[ix].second;
+        while(remaining > 0)
+        {
+            const unsigned int chunk_size = static_cast<unsigned int>(std::min<size_t>(remaining, INT_MAX));
+            const int written = _write(file_descriptor, start, chunk_size);
+            CHECK_EXCEPTION(written > 0, u8"Could not write image data.");
+
+            start += written;
+            remaining -= written;
+        }
+    }
+#else
+    std::vector<iovec> vectors(buffer_count);
+    std::transform(buffers, buffers + buffer_count, vectors.begin(), [](const std::pair<const uint8_t*, size_t>& buffer)
+    {
+        return iovec{const_cast<uint8_t*>(buffer.first), buffer.second};
+    });
+
+    iovec* vector = vectors.data();
+    iovec* vector_end = vector + vectors.size();
+    while(vector != vector_end)
+    {
+        const ssize_t written = writev(file_descriptor, vector, static_cast<int>(vector_end - vector));
+        if((written < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        CHECK_EXCEPTION(written >= 0, u8"Could not write image data.");
+
+        // Skip fully written buffers and advance into a partially written one.
+        size_t advance = static_cast<size_t>(written);
+        while((vector != vector_end) && (advance >= vector->iov_len))
+        {
+            advance -= vector->iov_len;
+            ++vector;
+        }
+        if(vector != vector_end)
+        {
+            vector->iov_base = static_cast<uint8_t*>(vector->iov_base) + advance;
+            vector->iov_len -= advance;
+        }
+    }
+#endif
+}
+
+void write_pixmap_from_bitmap(int file_descriptor, const Bitmap& bitmap, bool detect_grayscale)
+{
+    validate_bitmap_for_pixmap(bitmap);
+
+    const bool grayscale = detect_grayscale && is_bitmap_grayscale(bitmap);
+    const std::string header = make_pixmap_header(grayscale ? PixMap_format::P5 : PixMap_format::P6, bitmap.width, bitmap.height);
+
+    // P6 data is written straight from the bitmap.  P5 data requires a single channel, which is a third of the size.
+    std::vector<uint8_t> gray;
+    if(grayscale)
+    {
+        gray = extract_gray_channel(bitmap);
+    }
+
+    const std::pair<const uint8_t*, size_t> buffers[] =
+    {
+        {reinterpret_cast<const uint8_t*>(header.data()), header.size()},
+        grayscale ? std::make_pair(gray.data(), gray.size()) : std::make_pair(bitmap.bitmap.data(), bitmap.bitmap.size()),
+    };
+    write_buffers(file_descriptor, buffers, sizeof(buffers) / sizeof(buffers[0]));
+}
+
 }
 
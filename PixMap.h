@@ -6,5 +6,15 @@ namespace ImageProcessing
 bool is_pixmap_file_name(_In_z_ const char* file_name);
 struct Bitmap decode_bitmap_from_pixmap_memory(_In_reads_(size) const uint8_t* pixmap_memory, size_t size);
 
+// Decodes the image at a reduced size, see get_preview_reduction.
+struct Bitmap decode_preview_from_pixmap_memory(_In_reads_(size) const uint8_t* pixmap_memory, size_t size, unsigned int preview_size);
+
+// Decodes the width by height pixels at x, y, which must be inside the image.
+struct Bitmap decode_region_from_pixmap_memory(_In_reads_(size) const uint8_t* pixmap_memory, size_t size,
+                                               unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+class Tiled_bitmap decode_tiled_bitmap_from_pixmap_file(_In_z_ const char* file_name, const struct Tiled_bitmap_options& options);
+std::vector<uint8_t> encode_pixmap_from_bitmap(const struct Bitmap& bitmap, bool detect_grayscale);
+void write_pixmap_from_bitmap(int file_descriptor, const struct Bitmap& bitmap, bool detect_grayscale);
+
 }
 
@@ -0,0 +1,180 @@
+#include "PreCompile.h"
+#include "Bitmap.h"
+#include "CpuDispatch.h"
+#include "PixelKernels.h"       // Pick up forward declarations to ensure correctness.
+
+namespace ImageProcessing
+{
+
+static void accumulate_filter_tap_scalar(_In_reads_(count) const uint8_t* source, float tap, _Inout_updates_(count) uint32_t* accumulator, size_t count) noexcept
+{
+    for(size_t ix = 0; ix < count; ++ix)
+    {
+        accumulator[ix] += static_cast<unsigned char>(source[ix] * tap);
+    }
+}
+
+template<unsigned int Dimension>
+static void filter_fixed_row_scalar(_In_ const uint8_t* const* rows, _In_ const float* taps, _Out_writes_(count) uint8_t* target, size_t count) noexcept
+{
+    const ptrdiff_t half_dimension = Dimension / 2;
+    for(size_t ix = 0; ix < count; ++ix)
+    {
+        uint32_t sum = 0;
+        for(ptrdiff_t d_h = 0; d_h < static_cast<ptrdiff_t>(Dimension); ++d_h)
+        {
+            for(ptrdiff_t d_w = 0; d_w < static_cast<ptrdiff_t>(Dimension); ++d_w)
+            {
+                const uint8_t sample = rows[d_h][static_cast<ptrdiff_t>(ix) + (d_w - half_dimension) * 3];
+                sum += static_cast<unsigned char>(sample * taps[Dimension * d_h + d_w]);
+            }
+        }
+
+        target[ix] = static_cast<uint8_t>(sum);
+    }
+}
+
+static void gather_pixels_scalar(_In_reads_(source_count) const Color_rgb* source, size_t source_count,
+                                 _In_reads_(count) const unsigned int* source_indices, _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    // Only referenced by the assert.
+    static_cast<void>(source_count);
+
+    for(size_t ix = 0; ix < count; ++ix)
+    {
+        assert(source_indices[ix] < source_count);
+        target[ix] = source[source_indices[ix]];
+    }
+}
+
+static void fill_pixels_scalar(_Out_writes_(count) Color_rgb* target, Color_rgb color, size_t count) noexcept
+{
+    for(size_t ix = 0; ix < count; ++ix)
+    {
+        target[ix] = color;
+    }
+}
+
+static void interleave_planes_scalar(_In_reads_(count) const uint8_t* red, _In_reads_(count) const uint8_t* green, _In_reads_(count) const uint8_t* blue,
+                                     _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    for(size_t ix = 0; ix < count; ++ix)
+    {
+        target[ix] = Color_rgb(red[ix], green[ix], blue[ix]);
+    }
+}
+
+static bool expand_gray_scalar(_In_reads_(count) const uint8_t* source, uint8_t max_value, uint8_t scale, _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    bool valid = true;
+    for(size_t ix = 0; ix < count; ++ix)
+    {
+        valid &= (source[ix] <= max_value);
+
+        const auto value = static_cast<uint8_t>(source[ix] * scale);
+        target[ix] = Color_rgb(value, value, value);
+    }
+
+    return valid;
+}
+
+static void convert_bgr_scalar(_In_reads_(count * 3) const uint8_t* source, _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    for(size_t ix = 0; ix < count; ++ix)
+    {
+        target[ix] = Color_rgb(source[2], source[1], source[0]);
+        source += 3;
+    }
+}
+
+static void convert_bgr_reversed_scalar(_In_reads_(count * 3) const uint8_t* source, _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    std::reverse_copy(source, source + count * 3, reinterpret_cast<uint8_t*>(target));
+}
+
+static void reverse_pixels_scalar(_In_reads_(count) const Color_rgb* source, _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    for(size_t ix = 0; ix < count; ++ix)
+    {
+        target[ix] = source[count - ix - 1];
+    }
+}
+
+static void minimum_bytes_scalar(_In_reads_(count) const uint8_t* first, _In_reads_(count) const uint8_t* second, _Out_writes_(count) uint8_t* target, size_t count) noexcept
+{
+    for(size_t ix = 0; ix < count; ++ix)
+    {
+        target[ix] = std::min(first[ix], second[ix]);
+    }
+}
+
+static void maximum_bytes_scalar(_In_reads_(count) const uint8_t* first, _In_reads_(count) const uint8_t* second, _Out_writes_(count) uint8_t* target, size_t count) noexcept
+{
+    for(size_t ix = 0; ix < count; ++ix)
+    {
+        target[ix] = std::max(first[ix], second[ix]);
+    }
+}
+
+static uint8_t accumulate_differences_scalar(_In_reads_(count) const uint8_t* first, _In_reads_(count) const uint8_t* second, size_t count,
+                                             _Inout_ uint64_t* absolute_sum, _Inout_ uint64_t* squared_sum) noexcept
+{
+    uint8_t maximum = 0;
+    uint64_t row_absolute_sum = 0;
+    uint64_t row_squared_sum = 0;
+    for(size_t ix = 0; ix < count; ++ix)
+    {
+        const uint8_t difference = (first[ix] > second[ix]) ? first[ix] - second[ix] : second[ix] - first[ix];
+        maximum = std::max(maximum, difference);
+        row_absolute_sum += difference;
+        row_squared_sum += difference * difference;
+    }
+
+    *absolute_sum += row_absolute_sum;
+    *squared_sum += row_squared_sum;
+    return maximum;
+}
+
+struct Pixel_kernel_tables
+{
+    Pixel_kernel_tables() noexcept
+    {
+        tables[static_cast<size_t>(Simd_level::Scalar)] =
+        {
+            accumulate_filter_tap_scalar,
+            { filter_fixed_row_scalar<3>, filter_fixed_row_scalar<5>, filter_fixed_row_scalar<7> },
+            gather_pixels_scalar,
+            fill_pixels_scalar,
+            interleave_planes_scalar,
+            expand_gray_scalar,
+            convert_bgr_scalar,
+            convert_bgr_reversed_scalar,
+            reverse_pixels_scalar,
+            minimum_bytes_scalar,
+            maximum_bytes_scalar,
+            accumulate_differences_scalar,
+        };
+
+        tables[static_cast<size_t>(Simd_level::Sse4_1)] = make_sse4_1_pixel_kernels(tables[static_cast<size_t>(Simd_level::Scalar)]);
+        tables[static_cast<size_t>(Simd_level::Avx2)] = make_avx2_pixel_kernels(tables[static_cast<size_t>(Simd_level::Sse4_1)]);
+        tables[static_cast<size_t>(Simd_level::Avx512)] = make_avx512_pixel_kernels(tables[static_cast<size_t>(Simd_level::Avx2)]);
+    }
+
+    Pixel_kernels tables[4];
+};
+
+const Pixel_kernels& get_pixel_kernels() noexcept
+{
+    return get_pixel_kernels(get_simd_level());
+}
+
+const Pixel_kernels& get_pixel_kernels(Simd_level level) noexcept
+{
+    assert(level <= get_detected_simd_level());
+
+    static const Pixel_kernel_tables kernel_tables;
+    return kernel_tables.tables[static_cast<size_t>(level)];
+}
+
+}
+
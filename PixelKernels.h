@@ -0,0 +1,67 @@
+#pragma once
+
+namespace ImageProcessing
+{
+
+// Inner loops of the pixel processing functions.  Each Simd_level has its own table, and entries
+// without a specialized implementation at a level use the implementation from the level below.
+// All implementations produce output identical to the scalar implementations.
+struct Pixel_kernels
+{
+    // Box filter: accumulator[ix] += (uint8_t)(source[ix] * tap).  Only the low byte of the accumulator is meaningful.
+    void (*accumulate_filter_tap)(_In_reads_(count) const uint8_t* source, float tap, _Inout_updates_(count) uint32_t* accumulator, size_t count);
+
+    // Box filter with a fixed dimension of 3, 5 or 7, indexed by dimension / 2 - 1.  For each ix:
+    // target[ix] = (uint8_t)sum((uint8_t)(rows[d_h][ix + (d_w - dimension / 2) * 3] * taps[dimension * d_h + d_w])).
+    // rows must point at least dimension / 2 pixels into each source row, and count must be at least fixed_filter_minimum_count.
+    void (*filter_fixed_row[3])(_In_ const uint8_t* const* rows, _In_ const float* taps, _Out_writes_(count) uint8_t* target, size_t count);
+
+    // Point sampled resize: target[ix] = source[source_indices[ix]].  source_indices must be non-decreasing.
+    void (*gather_pixels)(_In_reads_(source_count) const Color_rgb* source, size_t source_count,
+                          _In_reads_(count) const unsigned int* source_indices, _Out_writes_(count) Color_rgb* target, size_t count);
+
+    // Gradient fill.
+    void (*fill_pixels)(_Out_writes_(count) Color_rgb* target, Color_rgb color, size_t count);
+
+    // PCX: interleave the red, green and blue planes of a scanline.
+    void (*interleave_planes)(_In_reads_(count) const uint8_t* red, _In_reads_(count) const uint8_t* green, _In_reads_(count) const uint8_t* blue,
+                              _Out_writes_(count) Color_rgb* target, size_t count);
+
+    // PNM: target[ix] = gray(source[ix] * scale).  Returns false if any source value is above max_value.
+    bool (*expand_gray)(_In_reads_(count) const uint8_t* source, uint8_t max_value, uint8_t scale, _Out_writes_(count) Color_rgb* target, size_t count);
+
+    // Targa: swap BGR to RGB.
+    void (*convert_bgr)(_In_reads_(count * 3) const uint8_t* source, _Out_writes_(count) Color_rgb* target, size_t count);
+
+    // Targa right to left rows: swap BGR to RGB and reverse, so target[ix] is source pixel count - ix - 1.  This is
+    // the row's bytes in reverse order.  source and target must not overlap.
+    void (*convert_bgr_reversed)(_In_reads_(count * 3) const uint8_t* source, _Out_writes_(count) Color_rgb* target, size_t count);
+
+    // Horizontal flip: target[ix] = source[count - ix - 1].  source and target must not overlap.
+    void (*reverse_pixels)(_In_reads_(count) const Color_rgb* source, _Out_writes_(count) Color_rgb* target, size_t count);
+
+    // Morphology: target[ix] = min(first[ix], second[ix]) and max(first[ix], second[ix]).  target may be first or second.
+    void (*minimum_bytes)(_In_reads_(count) const uint8_t* first, _In_reads_(count) const uint8_t* second, _Out_writes_(count) uint8_t* target, size_t count);
+    void (*maximum_bytes)(_In_reads_(count) const uint8_t* first, _In_reads_(count) const uint8_t* second, _Out_writes_(count) uint8_t* target, size_t count);
+
+    // Comparison: adds sum(abs(first[ix] - second[ix])) to absolute_sum and sum((first[ix] - second[ix])^2) to squared_sum.
+    // Returns max(abs(first[ix] - second[ix])).
+    uint8_t (*accumulate_differences)(_In_reads_(count) const uint8_t* first, _In_reads_(count) const uint8_t* second, size_t count,
+                                      _Inout_ uint64_t* absolute_sum, _Inout_ uint64_t* squared_sum);
+};
+
+const size_t fixed_filter_minimum_count = 64;
+
+// Returns the kernels for the level returned by get_simd_level.
+const Pixel_kernels& get_pixel_kernels() noexcept;
+
+// Returns the kernels for a specific level, which must not be above get_detected_simd_level.
+const Pixel_kernels& get_pixel_kernels(Simd_level level) noexcept;
+
+// Each returns fallback with the entries specialized for that level replaced.
+Pixel_kernels make_sse4_1_pixel_kernels(const Pixel_kernels& fallback) noexcept;
+Pixel_kernels make_avx2_pixel_kernels(const Pixel_kernels& fallback) noexcept;
+Pixel_kernels make_avx512_pixel_kernels(const Pixel_kernels& fallback) noexcept;
+
+}
+
@@ -0,0 +1,428 @@
+#include "PreCompile.h"
+#include "Bitmap.h"
+#include "CpuDispatch.h"
+#include "PixelKernels.h"       // Pick up forward declarations to ensure correctness.
+
+#if defined(IMAGEPROCESSING_X86)
+#include <immintrin.h>
+#endif
+
+// These functions are only called when CPU detection reports AVX2 support.  See PixelKernelsSse41.cpp
+// for why each function opts in to the instruction set and avoids Standard Library templates.
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace ImageProcessing
+{
+
+#if defined(IMAGEPROCESSING_X86)
+
+// AVX2 byte shuffles do not cross 128-bit lanes.  Kernels that interleave sixteen pixels per lane produce
+// three registers whose low lanes hold the first forty-eight output bytes and whose high lanes hold the next
+// forty-eight, so the lanes are recombined in order before storing.
+TARGET_AVX2
+static void store_interleaved_lanes(__m256i block0, __m256i block1, __m256i block2, _Out_writes_bytes_(96) uint8_t* output) noexcept
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output), _mm256_permute2x128_si256(block0, block1, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + 32), _mm256_permute2x128_si256(block2, block0, 0x30));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + 64), _mm256_permute2x128_si256(block1, block2, 0x31));
+}
+
+TARGET_AVX2
+static __m256i load_lane_mask(_In_reads_(16) const uint8_t* mask) noexcept
+{
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask)));
+}
+
+TARGET_AVX2
+static void accumulate_filter_tap_avx2(_In_reads_(count) const uint8_t* source, float tap, _Inout_updates_(count) uint32_t* accumulator, size_t count) noexcept
+{
+    const __m256 taps = _mm256_set1_ps(tap);
+    const __m256i byte_mask = _mm256_set1_epi32(0xff);
+
+    size_t ix = 0;
+    for(; ix + 32 <= count; ix += 32)
+    {
+        __m256i* target = reinterpret_cast<__m256i*>(accumulator + ix);
+        for(unsigned int group = 0; group < 4; ++group)
+        {
+            const __m256i values = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + ix + group * 8)));
+
+            // Truncate the product to a byte as the scalar conversion does.
+            const __m256i products = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(values), taps)), byte_mask);
+            _mm256_storeu_si256(target + group, _mm256_add_epi32(_mm256_loadu_si256(target + group), products));
+        }
+    }
+
+    for(; ix < count; ++ix)
+    {
+        accumulator[ix] += static_cast<unsigned char>(source[ix] * tap);
+    }
+}
+
+// Sums a block of thirty-two bytes over every tap of a filter with a fixed dimension.  See Filter_taps_sse4_1.
+template<unsigned int Dimension, unsigned int Tap>
+struct Filter_taps_avx2
+{
+    TARGET_AVX2
+    static void accumulate(_In_ const uint8_t* const* rows, _In_ const __m256* taps, ptrdiff_t ix, _Inout_updates_(4) __m256i* sums) noexcept
+    {
+        const ptrdiff_t offset = (static_cast<ptrdiff_t>(Tap % Dimension) - static_cast<ptrdiff_t>(Dimension / 2)) * 3;
+        const uint8_t* source = rows[Tap / Dimension] + ix + offset;
+        for(unsigned int group = 0; group < 4; ++group)
+        {
+            const __m256i values = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + group * 8)));
+            sums[group] = _mm256_add_epi32(sums[group], _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(values), taps[Tap])));
+        }
+
+        Filter_taps_avx2<Dimension, Tap + 1>::accumulate(rows, taps, ix, sums);
+    }
+};
+
+template<unsigned int Dimension>
+struct Filter_taps_avx2<Dimension, Dimension * Dimension>
+{
+    TARGET_AVX2
+    static void accumulate(_In_ const uint8_t* const*, _In_ const __m256*, ptrdiff_t, _Inout_updates_(4) __m256i*) noexcept
+    {
+    }
+};
+
+template<unsigned int Dimension>
+TARGET_AVX2
+static void filter_fixed_row_avx2(_In_ const uint8_t* const* rows, _In_ const float* taps, _Out_writes_(count) uint8_t* target, size_t count) noexcept
+{
+    assert(count >= 32);
+
+    __m256 tap_vectors[Dimension * Dimension];
+    for(unsigned int ix = 0; ix < Dimension * Dimension; ++ix)
+    {
+        tap_vectors[ix] = _mm256_set1_ps(taps[ix]);
+    }
+
+    const __m256i byte_mask = _mm256_set1_epi32(0xff);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for(size_t ix = 0; ix < count; ix += 32)
+    {
+        // The last partial block is recomputed as a full block that ends at count.
+        const size_t block_ix = (ix + 32 <= count) ? ix : count - 32;
+
+        __m256i sums[4] = { _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256() };
+        Filter_taps_avx2<Dimension, 0>::accumulate(rows, tap_vectors, static_cast<ptrdiff_t>(block_ix), sums);
+
+        // The packs interleave the 128-bit lanes, and the permute restores the order.
+        const __m256i low = _mm256_packus_epi32(_mm256_and_si256(sums[0], byte_mask), _mm256_and_si256(sums[1], byte_mask));
+        const __m256i high = _mm256_packus_epi32(_mm256_and_si256(sums[2], byte_mask), _mm256_and_si256(sums[3], byte_mask));
+        const __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(low, high), order);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + block_ix), bytes);
+    }
+}
+
+TARGET_AVX2
+static void gather_pixels_avx2(_In_reads_(source_count) const Color_rgb* source, size_t source_count,
+                               _In_reads_(count) const unsigned int* source_indices, _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    // Each pixel is gathered as four bytes, and the fourth byte is dropped by the shuffle.
+    const __m256i pack_mask = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                               0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i pixel_size = _mm256_set1_epi32(sizeof(Color_rgb));
+    const auto source_bytes = reinterpret_cast<const int*>(source);
+    auto output = reinterpret_cast<uint8_t*>(target);
+
+    // Gathers read one byte past the last pixel, and stores write four bytes past the eighth, so stop
+    // before reaching the last source pixel or the last two target pixels.  Indices are non-decreasing,
+    // so checking the eighth index checks all of them.
+    size_t ix = 0;
+    for(; (ix + 10 <= count) && (source_indices[ix + 7] + 1 < source_count); ix += 8)
+    {
+        const __m256i offsets = _mm256_mullo_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source_indices + ix)), pixel_size);
+        const __m256i pixels = _mm256_shuffle_epi8(_mm256_i32gather_epi32(source_bytes, offsets, 1), pack_mask);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + ix * 3), _mm256_castsi256_si128(pixels));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + ix * 3 + 12), _mm256_extracti128_si256(pixels, 1));
+    }
+
+    for(; ix < count; ++ix)
+    {
+        target[ix] = source[source_indices[ix]];
+    }
+}
+
+TARGET_AVX2
+static void fill_pixels_avx2(_Out_writes_(count) Color_rgb* target, Color_rgb color, size_t count) noexcept
+{
+    // Thirty-two pixels are exactly three registers.
+    uint8_t pattern[96];
+    for(unsigned int ix = 0; ix < 32; ++ix)
+    {
+        pattern[ix * 3] = color.red;
+        pattern[ix * 3 + 1] = color.green;
+        pattern[ix * 3 + 2] = color.blue;
+    }
+
+    const __m256i pattern0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pattern));
+    const __m256i pattern1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pattern + 32));
+    const __m256i pattern2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pattern + 64));
+
+    size_t ix = 0;
+    for(; ix + 32 <= count; ix += 32)
+    {
+        __m256i* output = reinterpret_cast<__m256i*>(target + ix);
+        _mm256_storeu_si256(output, pattern0);
+        _mm256_storeu_si256(output + 1, pattern1);
+        _mm256_storeu_si256(output + 2, pattern2);
+    }
+
+    for(; ix < count; ++ix)
+    {
+        target[ix] = color;
+    }
+}
+
+TARGET_AVX2
+static void interleave_planes_avx2(_In_reads_(count) const uint8_t* red, _In_reads_(count) const uint8_t* green, _In_reads_(count) const uint8_t* blue,
+                                   _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    uint8_t masks[3][3][16];
+    for(unsigned int block = 0; block < 3; ++block)
+    {
+        for(unsigned int channel = 0; channel < 3; ++channel)
+        {
+            for(unsigned int ix = 0; ix < 16; ++ix)
+            {
+                const unsigned int output_index = block * 16 + ix;
+                masks[block][channel][ix] = (output_index % 3 == channel) ? static_cast<uint8_t>(output_index / 3) : 0x80;
+            }
+        }
+    }
+
+    size_t ix = 0;
+    for(; ix + 32 <= count; ix += 32)
+    {
+        const __m256i planes[3] =
+        {
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(red + ix)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(green + ix)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blue + ix)),
+        };
+
+        __m256i blocks[3];
+        for(unsigned int block = 0; block < 3; ++block)
+        {
+            blocks[block] = _mm256_setzero_si256();
+            for(unsigned int channel = 0; channel < 3; ++channel)
+            {
+                blocks[block] = _mm256_or_si256(blocks[block], _mm256_shuffle_epi8(planes[channel], load_lane_mask(masks[block][channel])));
+            }
+        }
+
+        store_interleaved_lanes(blocks[0], blocks[1], blocks[2], reinterpret_cast<uint8_t*>(target + ix));
+    }
+
+    for(; ix < count; ++ix)
+    {
+        target[ix] = Color_rgb(red[ix], green[ix], blue[ix]);
+    }
+}
+
+TARGET_AVX2
+static bool expand_gray_avx2(_In_reads_(count) const uint8_t* source, uint8_t max_value, uint8_t scale, _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    uint8_t masks[3][16];
+    for(unsigned int block = 0; block < 3; ++block)
+    {
+        for(unsigned int ix = 0; ix < 16; ++ix)
+        {
+            masks[block][ix] = static_cast<uint8_t>((block * 16 + ix) / 3);
+        }
+    }
+
+    const __m256i max_values = _mm256_set1_epi8(static_cast<char>(max_value));
+    const __m256i scales = _mm256_set1_epi16(scale);
+    const __m256i low_mask = _mm256_set1_epi16(0xff);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i invalid = _mm256_setzero_si256();
+
+    size_t ix = 0;
+    for(; ix + 32 <= count; ix += 32)
+    {
+        const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + ix));
+        invalid = _mm256_or_si256(invalid, _mm256_xor_si256(_mm256_max_epu8(values, max_values), max_values));
+
+        // Unpack and pack both operate within lanes, so the byte order is preserved.
+        const __m256i scaled = _mm256_packus_epi16(_mm256_and_si256(_mm256_mullo_epi16(_mm256_unpacklo_epi8(values, zero), scales), low_mask),
+                                                   _mm256_and_si256(_mm256_mullo_epi16(_mm256_unpackhi_epi8(values, zero), scales), low_mask));
+
+        store_interleaved_lanes(_mm256_shuffle_epi8(scaled, load_lane_mask(masks[0])),
+                                _mm256_shuffle_epi8(scaled, load_lane_mask(masks[1])),
+                                _mm256_shuffle_epi8(scaled, load_lane_mask(masks[2])),
+                                reinterpret_cast<uint8_t*>(target + ix));
+    }
+
+    bool valid = _mm256_testz_si256(invalid, invalid) != 0;
+    for(; ix < count; ++ix)
+    {
+        valid &= (source[ix] <= max_value);
+
+        const auto value = static_cast<uint8_t>(source[ix] * scale);
+        target[ix] = Color_rgb(value, value, value);
+    }
+
+    return valid;
+}
+
+TARGET_AVX2
+static void convert_bgr_avx2(_In_reads_(count * 3) const uint8_t* source, _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    // Each lane holds four pixels.  The high lane is stored last, so it overwrites the pass through bytes of the low lane.
+    const __m256i mask = _mm256_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15,
+                                          2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15);
+    auto output = reinterpret_cast<uint8_t*>(target);
+
+    size_t ix = 0;
+    for(; ix + 10 <= count; ix += 8)
+    {
+        const __m256i pixels = _mm256_setr_m128i(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + ix * 3)),
+                                                 _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + ix * 3 + 12)));
+        const __m256i swapped = _mm256_shuffle_epi8(pixels, mask);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + ix * 3), _mm256_castsi256_si128(swapped));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + ix * 3 + 12), _mm256_extracti128_si256(swapped, 1));
+    }
+
+    for(; ix < count; ++ix)
+    {
+        target[ix] = Color_rgb(source[ix * 3 + 2], source[ix * 3 + 1], source[ix * 3]);
+    }
+}
+
+TARGET_AVX2
+static void minimum_bytes_avx2(_In_reads_(count) const uint8_t* first, _In_reads_(count) const uint8_t* second, _Out_writes_(count) uint8_t* target, size_t count) noexcept
+{
+    size_t ix = 0;
+    for(; ix + 32 <= count; ix += 32)
+    {
+        const __m256i minimum = _mm256_min_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + ix)),
+                                                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + ix)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + ix), minimum);
+    }
+
+    for(; ix < count; ++ix)
+    {
+        target[ix] = (first[ix] < second[ix]) ? first[ix] : second[ix];
+    }
+}
+
+TARGET_AVX2
+static void maximum_bytes_avx2(_In_reads_(count) const uint8_t* first, _In_reads_(count) const uint8_t* second, _Out_writes_(count) uint8_t* target, size_t count) noexcept
+{
+    size_t ix = 0;
+    for(; ix + 32 <= count; ix += 32)
+    {
+        const __m256i maximum = _mm256_max_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + ix)),
+                                                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + ix)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + ix), maximum);
+    }
+
+    for(; ix < count; ++ix)
+    {
+        target[ix] = (first[ix] > second[ix]) ? first[ix] : second[ix];
+    }
+}
+
+// The absolute differences are summed with SAD against zero, and their squares with multiply-add into 32-bit lanes,
+// which are widened every block of iterations before they can overflow.
+TARGET_AVX2
+static uint8_t accumulate_differences_avx2(_In_reads_(count) const uint8_t* first, _In_reads_(count) const uint8_t* second, size_t count,
+                                          _Inout_ uint64_t* absolute_sum, _Inout_ uint64_t* squared_sum) noexcept
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i maximum = zero;
+    __m256i absolute = zero;
+    __m256i squared = zero;
+
+    // Each iteration adds at most 4 * 255^2 to each 32-bit lane.
+    const size_t block_size = 4096 * 32;
+
+    size_t ix = 0;
+    while(ix + 32 <= count)
+    {
+        __m256i block_squared = zero;
+        const size_t remaining = (count - ix) / 32 * 32;
+        const size_t block_end = ix + ((remaining < block_size) ? remaining : block_size);
+        for(; ix < block_end; ix += 32)
+        {
+            const __m256i first_values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + ix));
+            const __m256i second_values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + ix));
+            const __m256i difference = _mm256_or_si256(_mm256_subs_epu8(first_values, second_values), _mm256_subs_epu8(second_values, first_values));
+
+            maximum = _mm256_max_epu8(maximum, difference);
+            absolute = _mm256_add_epi64(absolute, _mm256_sad_epu8(difference, zero));
+
+            const __m256i low = _mm256_unpacklo_epi8(difference, zero);
+            const __m256i high = _mm256_unpackhi_epi8(difference, zero);
+            block_squared = _mm256_add_epi32(block_squared, _mm256_add_epi32(_mm256_madd_epi16(low, low), _mm256_madd_epi16(high, high)));
+        }
+
+        squared = _mm256_add_epi64(squared, _mm256_add_epi64(_mm256_unpacklo_epi32(block_squared, zero), _mm256_unpackhi_epi32(block_squared, zero)));
+    }
+
+    alignas(32) uint64_t absolute_lanes[4];
+    alignas(32) uint64_t squared_lanes[4];
+    alignas(32) uint8_t maximum_lanes[32];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(absolute_lanes), absolute);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(squared_lanes), squared);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(maximum_lanes), maximum);
+
+    uint8_t maximum_difference = 0;
+    for(size_t lane = 0; lane < 32; ++lane)
+    {
+        maximum_difference = (maximum_lanes[lane] > maximum_difference) ? maximum_lanes[lane] : maximum_difference;
+    }
+
+    for(size_t lane = 0; lane < 4; ++lane)
+    {
+        *absolute_sum += absolute_lanes[lane];
+        *squared_sum += squared_lanes[lane];
+    }
+
+    for(; ix < count; ++ix)
+    {
+        const uint8_t difference = (first[ix] > second[ix]) ? first[ix] - second[ix] : second[ix] - first[ix];
+        maximum_difference = (difference > maximum_difference) ? difference : maximum_difference;
+        *absolute_sum += difference;
+        *squared_sum += difference * difference;
+    }
+
+    return maximum_difference;
+}
+
+#endif
+
+Pixel_kernels make_avx2_pixel_kernels(const Pixel_kernels& fallback) noexcept
+{
+    Pixel_kernels kernels = fallback;
+
+#if defined(IMAGEPROCESSING_X86)
+    kernels.accumulate_filter_tap = accumulate_filter_tap_avx2;
+    kernels.filter_fixed_row[0] = filter_fixed_row_avx2<3>;
+    kernels.filter_fixed_row[1] = filter_fixed_row_avx2<5>;
+    kernels.filter_fixed_row[2] = filter_fixed_row_avx2<7>;
+    kernels.gather_pixels = gather_pixels_avx2;
+    kernels.fill_pixels = fill_pixels_avx2;
+    kernels.interleave_planes = interleave_planes_avx2;
+    kernels.expand_gray = expand_gray_avx2;
+    kernels.convert_bgr = convert_bgr_avx2;
+    kernels.minimum_bytes = minimum_bytes_avx2;
+    kernels.maximum_bytes = maximum_bytes_avx2;
+    kernels.accumulate_differences = accumulate_differences_avx2;
+#endif
+
+    return kernels;
+}
+
+}
+
@@ -0,0 +1,125 @@
+#include "PreCompile.h"
+#include "Bitmap.h"
+#include "CpuDispatch.h"
+#include "PixelKernels.h"       // Pick up forward declarations to ensure correctness.
+
+#if defined(IMAGEPROCESSING_X86)
+#include <immintrin.h>
+#endif
+
+// These functions are only called when CPU detection reports AVX-512 F and BW support.  See PixelKernelsSse41.cpp
+// for why each function opts in to the instruction set and avoids Standard Library templates.
+#if defined(__GNUC__)
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#else
+#define TARGET_AVX512
+#endif
+
+namespace ImageProcessing
+{
+
+#if defined(IMAGEPROCESSING_X86)
+
+TARGET_AVX512
+static void accumulate_filter_tap_avx512(_In_reads_(count) const uint8_t* source, float tap, _Inout_updates_(count) uint32_t* accumulator, size_t count) noexcept
+{
+    const __m512 taps = _mm512_set1_ps(tap);
+    const __m512i byte_mask = _mm512_set1_epi32(0xff);
+
+    size_t ix = 0;
+    for(; ix + 64 <= count; ix += 64)
+    {
+        for(unsigned int group = 0; group < 4; ++group)
+        {
+            const __m512i values = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + ix + group * 16)));
+
+            // Truncate the product to a byte as the scalar conversion does.
+            const __m512i products = _mm512_and_si512(_mm512_cvttps_epi32(_mm512_mul_ps(_mm512_cvtepi32_ps(values), taps)), byte_mask);
+
+            uint32_t* target = accumulator + ix + group * 16;
+            _mm512_storeu_si512(target, _mm512_add_epi32(_mm512_loadu_si512(target), products));
+        }
+    }
+
+    for(; ix < count; ++ix)
+    {
+        accumulator[ix] += static_cast<unsigned char>(source[ix] * tap);
+    }
+}
+
+// Sums a block of sixty-four bytes over every tap of a filter with a fixed dimension.  See Filter_taps_sse4_1.
+template<unsigned int Dimension, unsigned int Tap>
+struct Filter_taps_avx512
+{
+    TARGET_AVX512
+    static void accumulate(_In_ const uint8_t* const* rows, _In_ const __m512* taps, ptrdiff_t ix, _Inout_updates_(4) __m512i* sums) noexcept
+    {
+        const ptrdiff_t offset = (static_cast<ptrdiff_t>(Tap % Dimension) - static_cast<ptrdiff_t>(Dimension / 2)) * 3;
+        const uint8_t* source = rows[Tap / Dimension] + ix + offset;
+        for(unsigned int group = 0; group < 4; ++group)
+        {
+            const __m512i values = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + group * 16)));
+            sums[group] = _mm512_add_epi32(sums[group], _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_cvtepi32_ps(values), taps[Tap])));
+        }
+
+        Filter_taps_avx512<Dimension, Tap + 1>::accumulate(rows, taps, ix, sums);
+    }
+};
+
+template<unsigned int Dimension>
+struct Filter_taps_avx512<Dimension, Dimension * Dimension>
+{
+    TARGET_AVX512
+    static void accumulate(_In_ const uint8_t* const*, _In_ const __m512*, ptrdiff_t, _Inout_updates_(4) __m512i*) noexcept
+    {
+    }
+};
+
+template<unsigned int Dimension>
+TARGET_AVX512
+static void filter_fixed_row_avx512(_In_ const uint8_t* const* rows, _In_ const float* taps, _Out_writes_(count) uint8_t* target, size_t count) noexcept
+{
+    assert(count >= 64);
+
+    __m512 tap_vectors[Dimension * Dimension];
+    for(unsigned int ix = 0; ix < Dimension * Dimension; ++ix)
+    {
+        tap_vectors[ix] = _mm512_set1_ps(taps[ix]);
+    }
+
+    for(size_t ix = 0; ix < count; ix += 64)
+    {
+        // The last partial block is recomputed as a full block that ends at count.
+        const size_t block_ix = (ix + 64 <= count) ? ix : count - 64;
+
+        __m512i sums[4] = { _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512() };
+        Filter_taps_avx512<Dimension, 0>::accumulate(rows, tap_vectors, static_cast<ptrdiff_t>(block_ix), sums);
+
+        // The narrowing store keeps the low byte of each sum.
+        for(unsigned int group = 0; group < 4; ++group)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + block_ix + group * 16), _mm512_cvtepi32_epi8(sums[group]));
+        }
+    }
+}
+
+#endif
+
+// Kernels that are bound by memory bandwidth or byte shuffles gain little from wider registers, so
+// only the filter kernels are specialized.  The rest use the AVX2 implementations.
+Pixel_kernels make_avx512_pixel_kernels(const Pixel_kernels& fallback) noexcept
+{
+    Pixel_kernels kernels = fallback;
+
+#if defined(IMAGEPROCESSING_X86)
+    kernels.accumulate_filter_tap = accumulate_filter_tap_avx512;
+    kernels.filter_fixed_row[0] = filter_fixed_row_avx512<3>;
+    kernels.filter_fixed_row[1] = filter_fixed_row_avx512<5>;
+    kernels.filter_fixed_row[2] = filter_fixed_row_avx512<7>;
+#endif
+
+    return kernels;
+}
+
+}
+
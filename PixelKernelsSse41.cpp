@@ -0,0 +1,475 @@
+#include "PreCompile.h"
+#include "Bitmap.h"
+#include "CpuDispatch.h"
+#include "PixelKernels.h"       // Pick up forward declarations to ensure correctness.
+
+#if defined(IMAGEPROCESSING_X86)
+#include <immintrin.h>
+#endif
+
+// These functions are only called when CPU detection reports SSE4.1 support.  GCC and Clang require
+// each function to opt in to the instruction set; MSVC allows the intrinsics anywhere.
+// Standard Library templates are avoided here, so that no copies built for SSE4.1 are shared with other code.
+#if defined(__GNUC__)
+#define TARGET_SSE4_1 __attribute__((target("sse4.1")))
+#else
+#define TARGET_SSE4_1
+#endif
+
+namespace ImageProcessing
+{
+
+#if defined(IMAGEPROCESSING_X86)
+
+// Builds the byte shuffle that gathers bytes of channel from sixteen pixels of planar data
+// into output block (0-2) of the forty-eight byte interleaved output.
+static void make_interleave_mask(unsigned int block, unsigned int channel, _Out_writes_(16) uint8_t* mask) noexcept
+{
+    for(unsigned int ix = 0; ix < 16; ++ix)
+    {
+        const unsigned int output_index = block * 16 + ix;
+        mask[ix] = (output_index % 3 == channel) ? static_cast<uint8_t>(output_index / 3) : 0x80;
+    }
+}
+
+TARGET_SSE4_1
+static void accumulate_filter_tap_sse4_1(_In_reads_(count) const uint8_t* source, float tap, _Inout_updates_(count) uint32_t* accumulator, size_t count) noexcept
+{
+    const __m128 taps = _mm_set1_ps(tap);
+    const __m128i byte_mask = _mm_set1_epi32(0xff);
+
+    size_t ix = 0;
+    for(; ix + 16 <= count; ix += 16)
+    {
+        const __m128i source_bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + ix));
+        const __m128i values[4] =
+        {
+            _mm_cvtepu8_epi32(source_bytes),
+            _mm_cvtepu8_epi32(_mm_srli_si128(source_bytes, 4)),
+            _mm_cvtepu8_epi32(_mm_srli_si128(source_bytes, 8)),
+            _mm_cvtepu8_epi32(_mm_srli_si128(source_bytes, 12)),
+        };
+
+        __m128i* target = reinterpret_cast<__m128i*>(accumulator + ix);
+        for(unsigned int group = 0; group < 4; ++group)
+        {
+            // Truncate the product to a byte as the scalar conversion does.
+            const __m128i products = _mm_and_si128(_mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(values[group]), taps)), byte_mask);
+            _mm_storeu_si128(target + group, _mm_add_epi32(_mm_loadu_si128(target + group), products));
+        }
+    }
+
+    for(; ix < count; ++ix)
+    {
+        accumulator[ix] += static_cast<unsigned char>(source[ix] * tap);
+    }
+}
+
+// Sums a block of sixteen bytes over every tap of a filter with a fixed dimension.  The recursion unrolls the
+// taps at compile time.  Only the low byte of the sum is kept, and the low byte of a sum depends only on the
+// low bytes of its terms, so the products are truncated once after the last tap rather than once per tap.
+template<unsigned int Dimension, unsigned int Tap>
+struct Filter_taps_sse4_1
+{
+    TARGET_SSE4_1
+    static void accumulate(_In_ const uint8_t* const* rows, _In_ const __m128* taps, ptrdiff_t ix, _Inout_updates_(4) __m128i* sums) noexcept
+    {
+        const ptrdiff_t offset = (static_cast<ptrdiff_t>(Tap % Dimension) - static_cast<ptrdiff_t>(Dimension / 2)) * 3;
+        const __m128i source_bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[Tap / Dimension] + ix + offset));
+        const __m128i values[4] =
+        {
+            _mm_cvtepu8_epi32(source_bytes),
+            _mm_cvtepu8_epi32(_mm_srli_si128(source_bytes, 4)),
+            _mm_cvtepu8_epi32(_mm_srli_si128(source_bytes, 8)),
+            _mm_cvtepu8_epi32(_mm_srli_si128(source_bytes, 12)),
+        };
+
+        for(unsigned int group = 0; group < 4; ++group)
+        {
+            sums[group] = _mm_add_epi32(sums[group], _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(values[group]), taps[Tap])));
+        }
+
+        Filter_taps_sse4_1<Dimension, Tap + 1>::accumulate(rows, taps, ix, sums);
+    }
+};
+
+template<unsigned int Dimension>
+struct Filter_taps_sse4_1<Dimension, Dimension * Dimension>
+{
+    TARGET_SSE4_1
+    static void accumulate(_In_ const uint8_t* const*, _In_ const __m128*, ptrdiff_t, _Inout_updates_(4) __m128i*) noexcept
+    {
+    }
+};
+
+template<unsigned int Dimension>
+TARGET_SSE4_1
+static void filter_fixed_row_sse4_1(_In_ const uint8_t* const* rows, _In_ const float* taps, _Out_writes_(count) uint8_t* target, size_t count) noexcept
+{
+    assert(count >= 16);
+
+    __m128 tap_vectors[Dimension * Dimension];
+    for(unsigned int ix = 0; ix < Dimension * Dimension; ++ix)
+    {
+        tap_vectors[ix] = _mm_set1_ps(taps[ix]);
+    }
+
+    const __m128i byte_mask = _mm_set1_epi32(0xff);
+    for(size_t ix = 0; ix < count; ix += 16)
+    {
+        // The last partial block is recomputed as a full block that ends at count.
+        const size_t block_ix = (ix + 16 <= count) ? ix : count - 16;
+
+        __m128i sums[4] = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+        Filter_taps_sse4_1<Dimension, 0>::accumulate(rows, tap_vectors, static_cast<ptrdiff_t>(block_ix), sums);
+
+        const __m128i low = _mm_packus_epi32(_mm_and_si128(sums[0], byte_mask), _mm_and_si128(sums[1], byte_mask));
+        const __m128i high = _mm_packus_epi32(_mm_and_si128(sums[2], byte_mask), _mm_and_si128(sums[3], byte_mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(target + block_ix), _mm_packus_epi16(low, high));
+    }
+}
+
+TARGET_SSE4_1
+static void fill_pixels_sse4_1(_Out_writes_(count) Color_rgb* target, Color_rgb color, size_t count) noexcept
+{
+    // Sixteen pixels are exactly three registers.
+    uint8_t pattern[48];
+    for(unsigned int ix = 0; ix < 16; ++ix)
+    {
+        pattern[ix * 3] = color.red;
+        pattern[ix * 3 + 1] = color.green;
+        pattern[ix * 3 + 2] = color.blue;
+    }
+
+    const __m128i pattern0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+    const __m128i pattern1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern + 16));
+    const __m128i pattern2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern + 32));
+
+    size_t ix = 0;
+    for(; ix + 16 <= count; ix += 16)
+    {
+        __m128i* output = reinterpret_cast<__m128i*>(target + ix);
+        _mm_storeu_si128(output, pattern0);
+        _mm_storeu_si128(output + 1, pattern1);
+        _mm_storeu_si128(output + 2, pattern2);
+    }
+
+    for(; ix < count; ++ix)
+    {
+        target[ix] = color;
+    }
+}
+
+TARGET_SSE4_1
+static void interleave_planes_sse4_1(_In_reads_(count) const uint8_t* red, _In_reads_(count) const uint8_t* green, _In_reads_(count) const uint8_t* blue,
+                                     _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    uint8_t masks[3][3][16];
+    for(unsigned int block = 0; block < 3; ++block)
+    {
+        for(unsigned int channel = 0; channel < 3; ++channel)
+        {
+            make_interleave_mask(block, channel, masks[block][channel]);
+        }
+    }
+
+    size_t ix = 0;
+    for(; ix + 16 <= count; ix += 16)
+    {
+        const __m128i planes[3] =
+        {
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(red + ix)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(green + ix)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(blue + ix)),
+        };
+
+        __m128i* output = reinterpret_cast<__m128i*>(target + ix);
+        for(unsigned int block = 0; block < 3; ++block)
+        {
+            __m128i interleaved = _mm_setzero_si128();
+            for(unsigned int channel = 0; channel < 3; ++channel)
+            {
+                const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(masks[block][channel]));
+                interleaved = _mm_or_si128(interleaved, _mm_shuffle_epi8(planes[channel], mask));
+            }
+
+            _mm_storeu_si128(output + block, interleaved);
+        }
+    }
+
+    for(; ix < count; ++ix)
+    {
+        target[ix] = Color_rgb(red[ix], green[ix], blue[ix]);
+    }
+}
+
+TARGET_SSE4_1
+static bool expand_gray_sse4_1(_In_reads_(count) const uint8_t* source, uint8_t max_value, uint8_t scale, _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    // Each gray byte is replicated to three output bytes.
+    uint8_t masks[3][16];
+    for(unsigned int block = 0; block < 3; ++block)
+    {
+        for(unsigned int ix = 0; ix < 16; ++ix)
+        {
+            masks[block][ix] = static_cast<uint8_t>((block * 16 + ix) / 3);
+        }
+    }
+
+    const __m128i max_values = _mm_set1_epi8(static_cast<char>(max_value));
+    const __m128i scales = _mm_set1_epi16(scale);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i invalid = _mm_setzero_si128();
+
+    size_t ix = 0;
+    for(; ix + 16 <= count; ix += 16)
+    {
+        const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + ix));
+
+        // Any value above max_value leaves a lane where max(value, max_value) differs from max_value.
+        invalid = _mm_or_si128(invalid, _mm_xor_si128(_mm_max_epu8(values, max_values), max_values));
+
+        // Products of valid values fit in a byte, so only the low byte is kept, as in the scalar version.
+        const __m128i low_mask = _mm_set1_epi16(0xff);
+        const __m128i scaled = _mm_packus_epi16(_mm_and_si128(_mm_mullo_epi16(_mm_unpacklo_epi8(values, zero), scales), low_mask),
+                                                _mm_and_si128(_mm_mullo_epi16(_mm_unpackhi_epi8(values, zero), scales), low_mask));
+
+        __m128i* output = reinterpret_cast<__m128i*>(target + ix);
+        for(unsigned int block = 0; block < 3; ++block)
+        {
+            _mm_storeu_si128(output + block, _mm_shuffle_epi8(scaled, _mm_loadu_si128(reinterpret_cast<const __m128i*>(masks[block]))));
+        }
+    }
+
+    bool valid = _mm_testz_si128(invalid, invalid) != 0;
+    for(; ix < count; ++ix)
+    {
+        valid &= (source[ix] <= max_value);
+
+        const auto value = static_cast<uint8_t>(source[ix] * scale);
+        target[ix] = Color_rgb(value, value, value);
+    }
+
+    return valid;
+}
+
+TARGET_SSE4_1
+static void convert_bgr_sse4_1(_In_reads_(count * 3) const uint8_t* source, _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    // Swaps the first and third byte of the first four pixels in a register.  The last four bytes are
+    // passed through, and are overwritten by the next iteration's store.
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15);
+    auto output = reinterpret_cast<uint8_t*>(target);
+
+    // Loads and stores are sixteen bytes, so stop while at least six pixels remain.
+    size_t ix = 0;
+    for(; ix + 6 <= count; ix += 4)
+    {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + ix * 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + ix * 3), _mm_shuffle_epi8(pixels, mask));
+    }
+
+    for(; ix < count; ++ix)
+    {
+        target[ix] = Color_rgb(source[ix * 3 + 2], source[ix * 3 + 1], source[ix * 3]);
+    }
+}
+
+TARGET_SSE4_1
+static void convert_bgr_reversed_sse4_1(_In_reads_(count * 3) const uint8_t* source, _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    const __m128i mask = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    auto output = reinterpret_cast<uint8_t*>(target);
+    const size_t size = count * 3;
+
+    size_t ix = 0;
+    for(; ix + 16 <= size; ix += 16)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + size - ix - 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + ix), _mm_shuffle_epi8(bytes, mask));
+    }
+
+    for(; ix < size; ++ix)
+    {
+        output[ix] = source[size - ix - 1];
+    }
+}
+
+TARGET_SSE4_1
+static void reverse_pixels_sse4_1(_In_reads_(count) const Color_rgb* source, _Out_writes_(count) Color_rgb* target, size_t count) noexcept
+{
+    // Sixteen pixels are exactly three registers.  masks[output_block][source_block] gathers the bytes of
+    // output_block that come from source_block.
+    uint8_t masks[3][3][16];
+    for(unsigned int output_block = 0; output_block < 3; ++output_block)
+    {
+        for(unsigned int ix = 0; ix < 16; ++ix)
+        {
+            const unsigned int output_index = output_block * 16 + ix;
+            const unsigned int source_index = (15 - output_index / 3) * 3 + output_index % 3;
+            for(unsigned int source_block = 0; source_block < 3; ++source_block)
+            {
+                masks[output_block][source_block][ix] = (source_index / 16 == source_block) ? static_cast<uint8_t>(source_index % 16) : 0x80;
+            }
+        }
+    }
+
+    size_t ix = 0;
+    for(; ix + 16 <= count; ix += 16)
+    {
+        const __m128i* input = reinterpret_cast<const __m128i*>(source + count - ix - 16);
+        const __m128i blocks[3] =
+        {
+            _mm_loadu_si128(input),
+            _mm_loadu_si128(input + 1),
+            _mm_loadu_si128(input + 2),
+        };
+
+        __m128i* output = reinterpret_cast<__m128i*>(target + ix);
+        for(unsigned int output_block = 0; output_block < 3; ++output_block)
+        {
+            __m128i reversed = _mm_setzero_si128();
+            for(unsigned int source_block = 0; source_block < 3; ++source_block)
+            {
+                const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(masks[output_block][source_block]));
+                reversed = _mm_or_si128(reversed, _mm_shuffle_epi8(blocks[source_block], mask));
+            }
+
+            _mm_storeu_si128(output + output_block, reversed);
+        }
+    }
+
+    for(; ix < count; ++ix)
+    {
+        target[ix] = source[count - ix - 1];
+    }
+}
+
+TARGET_SSE4_1
+static void minimum_bytes_sse4_1(_In_reads_(count) const uint8_t* first, _In_reads_(count) const uint8_t* second, _Out_writes_(count) uint8_t* target, size_t count) noexcept
+{
+    size_t ix = 0;
+    for(; ix + 16 <= count; ix += 16)
+    {
+        const __m128i minimum = _mm_min_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first + ix)),
+                                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + ix)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(target + ix), minimum);
+    }
+
+    for(; ix < count; ++ix)
+    {
+        target[ix] = (first[ix] < second[ix]) ? first[ix] : second[ix];
+    }
+}
+
+TARGET_SSE4_1
+static void maximum_bytes_sse4_1(_In_reads_(count) const uint8_t* first, _In_reads_(count) const uint8_t* second, _Out_writes_(count) uint8_t* target, size_t count) noexcept
+{
+    size_t ix = 0;
+    for(; ix + 16 <= count; ix += 16)
+    {
+        const __m128i maximum = _mm_max_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first + ix)),
+                                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + ix)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(target + ix), maximum);
+    }
+
+    for(; ix < count; ++ix)
+    {
+        target[ix] = (first[ix] > second[ix]) ? first[ix] : second[ix];
+    }
+}
+
+// The absolute differences are summed with SAD against zero, and their squares with multiply-add into 32-bit lanes,
+// which are widened every block of iterations before they can overflow.
+TARGET_SSE4_1
+static uint8_t accumulate_differences_sse4_1(_In_reads_(count) const uint8_t* first, _In_reads_(count) const uint8_t* second, size_t count,
+                                          _Inout_ uint64_t* absolute_sum, _Inout_ uint64_t* squared_sum) noexcept
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i maximum = zero;
+    __m128i absolute = zero;
+    __m128i squared = zero;
+
+    // Each iteration adds at most 4 * 255^2 to each 32-bit lane.
+    const size_t block_size = 4096 * 16;
+
+    size_t ix = 0;
+    while(ix + 16 <= count)
+    {
+        __m128i block_squared = zero;
+        const size_t remaining = (count - ix) / 16 * 16;
+        const size_t block_end = ix + ((remaining < block_size) ? remaining : block_size);
+        for(; ix < block_end; ix += 16)
+        {
+            const __m128i first_values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + ix));
+            const __m128i second_values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + ix));
+            const __m128i difference = _mm_or_si128(_mm_subs_epu8(first_values, second_values), _mm_subs_epu8(second_values, first_values));
+
+            maximum = _mm_max_epu8(maximum, difference);
+            absolute = _mm_add_epi64(absolute, _mm_sad_epu8(difference, zero));
+
+            const __m128i low = _mm_unpacklo_epi8(difference, zero);
+            const __m128i high = _mm_unpackhi_epi8(difference, zero);
+            block_squared = _mm_add_epi32(block_squared, _mm_add_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high)));
+        }
+
+        squared = _mm_add_epi64(squared, _mm_add_epi64(_mm_unpacklo_epi32(block_squared, zero), _mm_unpackhi_epi32(block_squared, zero)));
+    }
+
+    alignas(16) uint64_t absolute_lanes[2];
+    alignas(16) uint64_t squared_lanes[2];
+    alignas(16) uint8_t maximum_lanes[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(absolute_lanes), absolute);
+    _mm_store_si128(reinterpret_cast<__m128i*>(squared_lanes), squared);
+    _mm_store_si128(reinterpret_cast<__m128i*>(maximum_lanes), maximum);
+
+    uint8_t maximum_difference = 0;
+    for(size_t lane = 0; lane < 16; ++lane)
+    {
+        maximum_difference = (maximum_lanes[lane] > maximum_difference) ? maximum_lanes[lane] : maximum_difference;
+    }
+
+    for(size_t lane = 0; lane < 2; ++lane)
+    {
+        *absolute_sum += absolute_lanes[lane];
+        *squared_sum += squared_lanes[lane];
+    }
+
+    for(; ix < count; ++ix)
+    {
+        const uint8_t difference = (first[ix] > second[ix]) ? first[ix] - second[ix] : second[ix] - first[ix];
+        maximum_difference = (difference > maximum_difference) ? difference : maximum_difference;
+        *absolute_sum += difference;
+        *squared_sum += difference * difference;
+    }
+
+    return maximum_difference;
+}
+
+#endif
+
+Pixel_kernels make_sse4_1_pixel_kernels(const Pixel_kernels& fallback) noexcept
+{
+    Pixel_kernels kernels = fallback;
+
+#if defined(IMAGEPROCESSING_X86)
+    kernels.accumulate_filter_tap = accumulate_filter_tap_sse4_1;
+    kernels.filter_fixed_row[0] = filter_fixed_row_sse4_1<3>;
+    kernels.filter_fixed_row[1] = filter_fixed_row_sse4_1<5>;
+    kernels.filter_fixed_row[2] = filter_fixed_row_sse4_1<7>;
+    kernels.fill_pixels = fill_pixels_sse4_1;
+    kernels.interleave_planes = interleave_planes_sse4_1;
+    kernels.expand_gray = expand_gray_sse4_1;
+    kernels.convert_bgr = convert_bgr_sse4_1;
+    kernels.convert_bgr_reversed = convert_bgr_reversed_sse4_1;
+    kernels.reverse_pixels = reverse_pixels_sse4_1;
+    kernels.minimum_bytes = minimum_bytes_sse4_1;
+    kernels.maximum_bytes = maximum_bytes_sse4_1;
+    kernels.accumulate_differences = accumulate_differences_sse4_1;
+#endif
+
+    return kernels;
+}
+
+}
+
@@ -3,13 +3,36 @@
 // C++ Standard Library.
 #include <cassert>
 #include <algorithm>
+#include <atomic>
 #include <climits>
+#include <cmath>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
 #include <functional>
+#include <future>
 #include <iterator>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
+// Intrinsics.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define IMAGEPROCESSING_X86
+#endif
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define IMAGEPROCESSING_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 #include <PortableRuntime/StaticAnalysis.h>
 
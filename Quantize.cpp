@@ -0,0 +1,404 @@
+#include "PreCompile.h"
+#include "Quantize.h"           // Pick up forward declarations to ensure correctness.
+#include "Bitmap.h"
+#include "Parallel.h"
+#include <PortableRuntime/CheckException.h>
+
+// Median cut:
+// http://en.wikipedia.org/wiki/Median_cut
+namespace ImageProcessing
+{
+
+// Colors are histogrammed and cached at five bits per channel.
+const unsigned int histogram_bits = 5;
+const unsigned int histogram_channel_size = 1u << histogram_bits;
+const unsigned int histogram_size = histogram_channel_size * histogram_channel_size * histogram_channel_size;
+
+// Upper bound on the number of pixels sampled to build the histogram.
+const size_t max_histogram_samples = 1u << 20;
+
+struct Histogram_bin
+{
+    uint64_t count;
+    uint64_t red_sum;
+    uint64_t green_sum;
+    uint64_t blue_sum;
+};
+
+static unsigned int get_histogram_index(uint8_t red, uint8_t green, uint8_t blue) noexcept
+{
+    const unsigned int shift = 8 - histogram_bits;
+    return ((red >> shift) << (histogram_bits * 2)) | ((green >> shift) << histogram_bits) | (blue >> shift);
+}
+
+static unsigned int get_histogram_channel(unsigned int index, unsigned int channel) noexcept
+{
+    return (index >> (histogram_bits * (2 - channel))) & (histogram_channel_size - 1);
+}
+
+// Builds the histogram in parallel.  Each range fills a private histogram, which avoids contention
+// on the bins, and the private histograms are merged at the end of each range.
+static std::vector<Histogram_bin> build_sampled_histogram(_In_reads_(pixel_count) const Color_rgb* pixels, size_t pixel_count)
+{
+    const size_t stride = std::max<size_t>(1, pixel_count / max_histogram_samples);
+    const size_t sample_count = (pixel_count + stride - 1) / stride;
+
+    std::vector<Histogram_bin> histogram(histogram_size, Histogram_bin{});
+    std::mutex histogram_mutex;
+    parallel_for(sample_count, 1u << 16, [=, &histogram, &histogram_mutex](size_t begin, size_t end)
+    {
+        std::vector<Histogram_bin> private_histogram(histogram_size, Histogram_bin{});
+        for(size_t ix = begin; ix < end; ++ix)
+        {
+            const Color_rgb& color = pixels[ix * stride];
+            Histogram_bin& bin = private_histogram[get_histogram_index(color.red, color.green, color.blue)];
+            ++bin.count;
+            bin.red_sum += color.red;
+            bin.green_sum += color.green;
+            bin.blue_sum += color.blue;
+        }
+
+        std::lock_guard<std::mutex> lock(histogram_mutex);
+        for(size_t ix = 0; ix < histogram_size; ++ix)
+        {
+            histogram[ix].count += private_histogram[ix].count;
+            histogram[ix].red_sum += private_histogram[ix].red_sum;
+            histogram[ix].green_sum += private_histogram[ix].green_sum;
+            histogram[ix].blue_sum += private_histogram[ix].blue_sum;
+        }
+    });
+
+    return histogram;
+}
+
+struct Color_box
+{
+    std::vector<unsigned int> bins;     // Indices of non-empty histogram bins.
+    uint64_t count;                     // Number of samples in the box.
+    unsigned int split_channel;         // Channel with the largest range.
+    unsigned int split_range;
+};
+
+static Color_box make_color_box(std::vector<unsigned int>&& bins, const std::vector<Histogram_bin>& histogram)
+{
+    Color_box box{std::move(bins), 0, 0, 0};
+
+    unsigned int minimum[3] = {histogram_channel_size, histogram_channel_size, histogram_channel_size};
+    unsigned int maximum[3] = {0, 0, 0};
+    for(const auto bin : box.bins)
+    {
+        box.count += histogram[bin].count;
+        for(unsigned int channel = 0; channel < 3; ++channel)
+        {
+            const unsigned int value = get_histogram_channel(bin, channel);
+            minimum[channel] = std::min(minimum[channel], value);
+            maximum[channel] = std::max(maximum[channel], value);
+        }
+    }
+
+    for(unsigned int channel = 0; channel < 3; ++channel)
+    {
+        if(maximum[channel] >= minimum[channel] && maximum[channel] - minimum[channel] > box.split_range)
+        {
+            box.split_channel = channel;
+            box.split_range = maximum[channel] - minimum[channel];
+        }
+    }
+
+    return box;
+}
+
+static std::vector<Color_rgb> median_cut(const std::vector<Histogram_bin>& histogram, unsigned int color_count)
+{
+    std::vector<unsigned int> occupied_bins;
+    for(unsigned int ix = 0; ix < histogram_size; ++ix)
+    {
+        if(histogram[ix].count > 0)
+        {
+            occupied_bins.push_back(ix);
+        }
+    }
+
+    std::vector<Color_box> boxes;
+    boxes.push_back(make_color_box(std::move(occupied_bins), histogram));
+
+    while(boxes.size() < color_count)
+    {
+        // Split the most populous box that still spans more than one bin.
+        const auto box_iterator = std::max_element(boxes.begin(), boxes.end(), [](const Color_box& first, const Color_box& second)
+        {
+            return (first.split_range > 0 ? first.count : 0) < (second.split_range > 0 ? second.count : 0);
+        });
+        if(box_iterator->split_range == 0)
+        {
+            break;
+        }
+
+        Color_box box = std::move(*box_iterator);
+        boxes.erase(box_iterator);
+
+        const unsigned int channel = box.split_channel;
+        std::sort(box.bins.begin(), box.bins.end(), [channel](unsigned int first, unsigned int second)
+        {
+            return get_histogram_channel(first, channel) < get_histogram_channel(second, channel);
+        });
+
+        // Split at the weighted median.
+        uint64_t running_count = 0;
+        size_t median = 0;
+        while((median < box.bins.size() - 1) && (running_count * 2 < box.count))
+        {
+            running_count += histogram[box.bins[median]].count;
+            ++median;
+        }
+
+        // Bins with equal values on the split channel must stay together, or the boxes would overlap.
+        // The box spans more than one value on the split channel, so one of the two candidates is interior.
+        const auto compare_value = [channel](unsigned int value, unsigned int bin)
+        {
+            return value < get_histogram_channel(bin, channel);
+        };
+        const auto compare_bin = [channel](unsigned int bin, unsigned int value)
+        {
+            return get_histogram_channel(bin, channel) < value;
+        };
+        const unsigned int median_value = get_histogram_channel(box.bins[std::max<size_t>(median, 1) - 1], channel);
+        auto split_iterator = std::upper_bound(box.bins.begin(), box.bins.end(), median_value, compare_value);
+        if(split_iterator == box.bins.end())
+        {
+            split_iterator = std::lower_bound(box.bins.begin(), box.bins.end(), median_value, compare_bin);
+        }
+        const size_t split = split_iterator - box.bins.begin();
+        assert((split > 0) && (split < box.bins.size()));
+
+        boxes.push_back(make_color_box(std::vector<unsigned int>(box.bins.begin(), box.bins.begin() + split), histogram));
+        boxes.push_back(make_color_box(std::vector<unsigned int>(box.bins.begin() + split, box.bins.end()), histogram));
+    }
+
+    // Each palette entry is the mean of the samples in its box.
+    std::vector<Color_rgb> palette;
+    palette.reserve(boxes.size());
+    for(const auto& box : boxes)
+    {
+        uint64_t red_sum = 0, green_sum = 0, blue_sum = 0;
+        for(const auto bin : box.bins)
+        {
+            red_sum += histogram[bin].red_sum;
+            green_sum += histogram[bin].green_sum;
+            blue_sum += histogram[bin].blue_sum;
+        }
+
+        const uint64_t count = std::max<uint64_t>(1, box.count);
+        palette.push_back(Color_rgb(static_cast<uint8_t>((red_sum + count / 2) / count),
+                                    static_cast<uint8_t>((green_sum + count / 2) / count),
+                                    static_cast<uint8_t>((blue_sum + count / 2) / count)));
+    }
+
+    return palette;
+}
+
+static uint8_t find_nearest_color(const std::vector<Color_rgb>& palette, int red, int green, int blue) noexcept
+{
+    int best_distance = INT_MAX;
+    size_t best_index = 0;
+    for(size_t ix = 0; ix < palette.size(); ++ix)
+    {
+        const int red_delta = palette[ix].red - red;
+        const int green_delta = palette[ix].green - green;
+        const int blue_delta = palette[ix].blue - blue;
+        const int distance = red_delta * red_delta + green_delta * green_delta + blue_delta * blue_delta;
+        if(distance < best_distance)
+        {
+            best_distance = distance;
+            best_index = ix;
+        }
+    }
+
+    return static_cast<uint8_t>(best_index);
+}
+
+// Precomputes the nearest palette entry for the center of every histogram cell, so that mapping
+// a pixel is a single table lookup.
+static std::vector<uint8_t> build_nearest_color_cache(const std::vector<Color_rgb>& palette)
+{
+    std::vector<uint8_t> cache(histogram_size);
+    parallel_for(histogram_size, 1024, [&palette, &cache](size_t begin, size_t end)
+    {
+        const int half_cell = 1 << (8 - histogram_bits - 1);
+        for(size_t ix = begin; ix < end; ++ix)
+        {
+            const auto index = static_cast<unsigned int>(ix);
+            cache[ix] = find_nearest_color(palette,
+                                           (get_histogram_channel(index, 0) << (8 - histogram_bits)) + half_cell,
+                                           (get_histogram_channel(index, 1) << (8 - histogram_bits)) + half_cell,
+                                           (get_histogram_channel(index, 2) << (8 - histogram_bits)) + half_cell);
+        }
+    });
+
+    return cache;
+}
+
+static uint8_t clamp_to_byte(int value) noexcept
+{
+    return static_cast<uint8_t>(std::min(std::max(value, 0), 255));
+}
+
+static void map_pixels_ordered(const Bitmap& bitmap, const std::vector<uint8_t>& cache, unsigned int color_count, bool dither, _Out_ uint8_t* indices)
+{
+    static const int bayer_matrix[8][8] =
+    {
+        { 0, 32,  8, 40,  2, 34, 10, 42},
+        {48, 16, 56, 24, 50, 18, 58, 26},
+        {12, 44,  4, 36, 14, 46,  6, 38},
+        {60, 28, 52, 20, 62, 30, 54, 22},
+        { 3, 35, 11, 43,  1, 33,  9, 41},
+        {51, 19, 59, 27, 49, 17, 57, 25},
+        {15, 47,  7, 39, 13, 45,  5, 37},
+        {63, 31, 55, 23, 61, 29, 53, 21},
+    };
+
+    // The dither amplitude is roughly the spacing between palette colors along each channel.
+    const int spread = dither ? static_cast<int>(256.0 / std::cbrt(static_cast<double>(color_count))) : 0;
+
+    const auto pixels = reinterpret_cast<const Color_rgb*>(bitmap.bitmap.data());
+    const unsigned int width = bitmap.width;
+
+    // Each pixel depends only on its own coordinates, so bands of rows are independent.
+    parallel_for(bitmap.height, 16, [=, &cache](size_t row_begin, size_t row_end)
+    {
+        for(size_t iy = row_begin; iy < row_end; ++iy)
+        {
+            const Color_rgb* row = pixels + iy * width;
+            uint8_t* index_row = indices + iy * width;
+            for(unsigned int ix = 0; ix < width; ++ix)
+            {
+                const int offset = ((bayer_matrix[iy & 7][ix & 7] * 2 - 63) * spread) / 128;
+                index_row[ix] = cache[get_histogram_index(clamp_to_byte(row[ix].red + offset),
+                                                          clamp_to_byte(row[ix].green + offset),
+                                                          clamp_to_byte(row[ix].blue + offset))];
+            }
+        }
+    });
+}
+
+// Error diffusion carries error from each pixel to the next row, so it runs serially.
+static void map_pixels_error_diffusion(const Bitmap& bitmap, const std::vector<uint8_t>& cache, const std::vector<Color_rgb>& palette, _Out_ uint8_t* indices)
+{
+    const auto pixels = reinterpret_cast<const Color_rgb*>(bitmap.bitmap.data());
+    const size_t width = bitmap.width;
+
+    // Errors are kept in sixteenths, with a pixel of padding on each side.
+    std::vector<int> current_errors((width + 2) * 3);
+    std::vector<int> next_errors((width + 2) * 3);
+
+    for(size_t iy = 0; iy < bitmap.height; ++iy)
+    {
+        std::fill(next_errors.begin(), next_errors.end(), 0);
+
+        const Color_rgb* row = pixels + iy * width;
+        for(size_t ix = 0; ix < width; ++ix)
+        {
+            int* error = &current_errors[(ix + 1) * 3];
+            const int red = clamp_to_byte(row[ix].red + error[0] / 16);
+            const int green = clamp_to_byte(row[ix].green + error[1] / 16);
+            const int blue = clamp_to_byte(row[ix].blue + error[2] / 16);
+
+            const uint8_t index = cache[get_histogram_index(static_cast<uint8_t>(red), static_cast<uint8_t>(green), static_cast<uint8_t>(blue))];
+            indices[iy * width + ix] = index;
+
+            const int channel_errors[3] = {red - palette[index].red, green - palette[index].green, blue - palette[index].blue};
+            int* next_error = &next_errors[(ix + 1) * 3];
+            for(int channel = 0; channel < 3; ++channel)
+            {
+                error[3 + channel] += channel_errors[channel] * 7;
+                next_error[channel - 3] += channel_errors[channel] * 3;
+                next_error[channel] += channel_errors[channel] * 5;
+                next_error[channel + 3] += channel_errors[channel];
+            }
+        }
+
+        std::swap(current_errors, next_errors);
+    }
+}
+
+static uint32_t pack_color(const Color_rgb& color) noexcept
+{
+    return (static_cast<uint32_t>(color.red) << 16) | (static_cast<uint32_t>(color.green) << 8) | color.blue;
+}
+
+// Images with no more distinct colors than the palette holds keep their exact colors, which median cut would
+// otherwise merge when they share a histogram cell.  Returns false as soon as color_count + 1 distinct colors
+// are found, which for most photographs is within the first few pixels.  colors is sorted.
+static bool find_exact_palette(_In_reads_(pixel_count) const Color_rgb* pixels, size_t pixel_count, unsigned int color_count,
+                               _Out_ std::vector<uint32_t>* colors)
+{
+    colors->clear();
+    for(size_t ix = 0; ix < pixel_count; ++ix)
+    {
+        const uint32_t color = pack_color(pixels[ix]);
+        const auto position = std::lower_bound(colors->begin(), colors->end(), color);
+        if((position == colors->end()) || (*position != color))
+        {
+            if(colors->size() == color_count)
+            {
+                return false;
+            }
+
+            colors->insert(position, color);
+        }
+    }
+
+    return true;
+}
+
+Paletted_bitmap quantize_bitmap(const Bitmap& bitmap, unsigned int color_count, Dither_mode dither_mode)
+{
+    CHECK_EXCEPTION((color_count > 0) && (color_count <= 256), u8"Color count is invalid.");
+    CHECK_EXCEPTION(bitmap.format == Pixel_format::Rgb, u8"Image data is invalid.");
+
+    const size_t pixel_count = static_cast<size_t>(bitmap.width) * bitmap.height;
+    CHECK_EXCEPTION(bitmap.bitmap.size() == pixel_count * sizeof(Color_rgb), u8"Image data is invalid.");
+
+    const auto pixels = reinterpret_cast<const Color_rgb*>(bitmap.bitmap.data());
+
+    // No color needs to be approximated, so there is no error to dither.
+    std::vector<uint32_t> exact_colors;
+    if(find_exact_palette(pixels, pixel_count, color_count, &exact_colors))
+    {
+        Paletted_bitmap paletted{std::vector<uint8_t>(pixel_count), std::vector<Color_rgb>(), bitmap.width, bitmap.height};
+        paletted.palette.reserve(exact_colors.size());
+        for(const uint32_t color : exact_colors)
+        {
+            paletted.palette.push_back(Color_rgb(static_cast<uint8_t>(color >> 16), static_cast<uint8_t>(color >> 8), static_cast<uint8_t>(color)));
+        }
+
+        parallel_for(pixel_count, 1u << 16, [pixels, &exact_colors, &paletted](size_t begin, size_t end)
+        {
+            for(size_t ix = begin; ix < end; ++ix)
+            {
+                const auto position = std::lower_bound(exact_colors.cbegin(), exact_colors.cend(), pack_color(pixels[ix]));
+                paletted.indices[ix] = static_cast<uint8_t>(position - exact_colors.cbegin());
+            }
+        });
+
+        return paletted;
+    }
+
+    Paletted_bitmap paletted{std::vector<uint8_t>(pixel_count), median_cut(build_sampled_histogram(pixels, pixel_count), color_count), bitmap.width, bitmap.height};
+
+    const std::vector<uint8_t> cache = build_nearest_color_cache(paletted.palette);
+    if(dither_mode == Dither_mode::Error_diffusion)
+    {
+        map_pixels_error_diffusion(bitmap, cache, paletted.palette, paletted.indices.data());
+    }
+    else
+    {
+        map_pixels_ordered(bitmap, cache, static_cast<unsigned int>(paletted.palette.size()), dither_mode == Dither_mode::Ordered, paletted.indices.data());
+    }
+
+    // Return value optimization expected.
+    return paletted;
+}
+
+}
+
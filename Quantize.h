@@ -0,0 +1,19 @@
+#pragma once
+
+namespace ImageProcessing
+{
+
+enum class Dither_mode
+{
+    None,                   // Each pixel maps to its nearest palette color.
+    Ordered,                // 8x8 Bayer matrix.
+    Error_diffusion,        // Floyd-Steinberg.
+};
+
+// Reduces an RGB image to a palette of at most color_count (1-256) colors chosen by median cut.  Images with at most
+// color_count distinct colors are returned exactly, with a palette of those colors.
+// The result can be written with encode_pcx_from_paletted_bitmap or encode_tga_from_paletted_bitmap.
+struct Paletted_bitmap quantize_bitmap(const struct Bitmap& bitmap, unsigned int color_count, Dither_mode dither_mode);
+
+}
+
@@ -0,0 +1,91 @@
+#include "PreCompile.h"
+#include "Tests.h"
+#include "Bitmap.h"
+#include "BitmapCache.h"
+#include <cstdio>
+#include <filesystem>
+
+namespace ImageProcessing
+{
+
+static Bitmap make_filled_bitmap(uint8_t value)
+{
+    Bitmap bitmap{std::vector<uint8_t>(16 * 16 * sizeof(Color_rgb), value), 16, 16, true};
+    return bitmap;
+}
+
+static Bitmap_cache_key make_test_key(uint8_t value)
+{
+    return make_bitmap_cache_key(&value, sizeof(value));
+}
+
+static void test_inserted_file_is_not_evicted(const std::string& directory)
+{
+    // Smaller than a single file, so every insert is over the maximum size.
+    const Bitmap_cache cache(Bitmap_cache_options{directory, 100});
+
+    for(uint8_t value = 1; value <= 8; ++value)
+    {
+        cache.insert(make_test_key(value), make_filled_bitmap(value));
+
+        const auto mapped_bitmap = cache.find(make_test_key(value));
+        TEST_CHECK(mapped_bitmap.is_valid() && (mapped_bitmap.pixels()[0] == value));
+        TEST_CHECK(!cache.find(make_test_key(value - 1)).is_valid());
+    }
+}
+
+static void test_least_recently_used_is_evicted(const std::string& directory)
+{
+    // Room for two files.
+    const uint64_t file_size = 64 + 16 * 16 * sizeof(Color_rgb);
+    const Bitmap_cache cache(Bitmap_cache_options{directory, file_size * 2});
+
+    cache.insert(make_test_key(11), make_filled_bitmap(11));
+    cache.insert(make_test_key(12), make_filled_bitmap(12));
+
+    // Using the older file makes the other one the least recently used.
+    TEST_CHECK(cache.find(make_test_key(11)).is_valid());
+    cache.insert(make_test_key(13), make_filled_bitmap(13));
+
+    TEST_CHECK(cache.find(make_test_key(11)).is_valid());
+    TEST_CHECK(!cache.find(make_test_key(12)).is_valid());
+    TEST_CHECK(cache.find(make_test_key(13)).is_valid());
+}
+
+// A hit only updates the time of the file.  The file itself is never replaced, as it may belong to another user.
+static void test_hit_does_not_rewrite_file(const std::string& directory)
+{
+    const Bitmap_cache cache(Bitmap_cache_options{directory, 1 << 20});
+    cache.insert(make_test_key(21), make_filled_bitmap(21));
+
+    std::filesystem::path file_name;
+    for(const auto& entry : std::filesystem::directory_iterator(directory))
+    {
+        file_name = entry.path();
+    }
+
+    // A file renamed over the cached one would no longer be the file the link refers to.
+    const auto link_name = std::filesystem::path(directory) / u8"link";
+    std::filesystem::create_hard_link(file_name, link_name);
+
+    const auto mapped_bitmap = cache.find(make_test_key(21));
+    TEST_CHECK(mapped_bitmap.is_valid() && (mapped_bitmap.pixels()[0] == 21));
+    TEST_CHECK(std::filesystem::equivalent(file_name, link_name));
+}
+
+void run_bitmap_cache_tests()
+{
+    const auto directory = std::filesystem::temp_directory_path() / u8"BitmapCacheTests";
+
+    for(const auto test : {test_inserted_file_is_not_evicted, test_least_recently_used_is_evicted, test_hit_does_not_rewrite_file})
+    {
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directory(directory);
+        test(directory.string());
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+}
+
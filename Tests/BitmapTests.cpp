@@ -0,0 +1,120 @@
+#include "PreCompile.h"
+#include "Tests.h"
+#include "Bitmap.h"
+#include "TestBitmaps.h"
+#include <cstdio>
+#include <random>
+
+namespace ImageProcessing
+{
+
+// Overlapping, adjacent, nested, empty and partly or wholly outside a 40x30 image.
+static const std::vector<Bitmap_rectangle> test_rectangles{{2, 3, 10, 9}, {8, 5, 15, 12}, {15, 5, 20, 12}, {3, 4, 5, 6}, {30, 20, 50, 40},
+                                                          {0, 25, 40, 30}, {12, 12, 12, 20}, {45, 0, 60, 10}, {35, 0, 40, 1}, {9, 9, 16, 10}};
+
+// Marks the pixels of the rectangles, after clipping, in a width by height mask.
+static std::vector<unsigned int> make_coverage(const std::vector<Bitmap_rectangle>& rectangles, unsigned int width, unsigned int height)
+{
+    std::vector<unsigned int> coverage(static_cast<size_t>(width) * height);
+    for(const Bitmap_rectangle& rectangle : rectangles)
+    {
+        for(unsigned int y = rectangle.top; y < std::min(rectangle.bottom, height); ++y)
+        {
+            for(unsigned int x = rectangle.left; x < std::min(rectangle.right, width); ++x)
+            {
+                ++coverage[static_cast<size_t>(y) * width + x];
+            }
+        }
+    }
+
+    // Return value optimization expected.
+    return coverage;
+}
+
+// Merged rectangles must cover each pixel of the union exactly once and no other pixel.
+static void check_merged_rectangles(const std::vector<Bitmap_rectangle>& rectangles, unsigned int width, unsigned int height)
+{
+    const auto merged = merge_rectangles(rectangles, width, height);
+    for(const Bitmap_rectangle& rectangle : merged)
+    {
+        TEST_CHECK((rectangle.left < rectangle.right) && (rectangle.right <= width) && (rectangle.top < rectangle.bottom) && (rectangle.bottom <= height));
+    }
+
+    const auto expected = make_coverage(rectangles, width, height);
+    const auto coverage = make_coverage(merged, width, height);
+    for(size_t ix = 0; ix < coverage.size(); ++ix)
+    {
+        TEST_CHECK(coverage[ix] == (expected[ix] > 0 ? 1u : 0u));
+    }
+}
+
+static void test_merge_rectangles()
+{
+    check_merged_rectangles(test_rectangles, 40, 30);
+    check_merged_rectangles({}, 40, 30);
+
+    // A single rectangle comes back whole.
+    const auto single = merge_rectangles({{3, 4, 17, 21}}, 40, 30);
+    TEST_CHECK((single.size() == 1) && (single[0].left == 3) && (single[0].top == 4) && (single[0].right == 17) && (single[0].bottom == 21));
+
+    // A diagonal stroke of overlapping squares covers only its own pixels, not its bounding box.
+    std::vector<Bitmap_rectangle> stroke;
+    for(unsigned int ix = 0; ix < 200; ++ix)
+    {
+        stroke.push_back({ix * 2, ix * 2, ix * 2 + 5, ix * 2 + 5});
+    }
+    check_merged_rectangles(stroke, 410, 410);
+
+    std::mt19937 generator(45);
+    std::vector<Bitmap_rectangle> random_rectangles;
+    for(int ix = 0; ix < 100; ++ix)
+    {
+        const unsigned int left = static_cast<unsigned int>(generator() % 70);
+        const unsigned int top = static_cast<unsigned int>(generator() % 50);
+        const unsigned int right = left + static_cast<unsigned int>(generator() % 20);
+        const unsigned int bottom = top + static_cast<unsigned int>(generator() % 20);
+        random_rectangles.push_back({left, top, right, bottom});
+    }
+    check_merged_rectangles(random_rectangles, 64, 48);
+}
+
+// Changes the pixels of the rectangles that are inside the image.
+static void change_pixels(Bitmap& bitmap, const std::vector<Bitmap_rectangle>& rectangles, uint8_t change)
+{
+    for(const Bitmap_rectangle& rectangle : rectangles)
+    {
+        for(unsigned int y = rectangle.top; y < std::min(rectangle.bottom, bitmap.height); ++y)
+        {
+            for(unsigned int x = rectangle.left; x < std::min(rectangle.right, bitmap.width); ++x)
+            {
+                for(size_t channel = 0; channel < sizeof(Color_rgb); ++channel)
+                {
+                    bitmap.bitmap[(static_cast<size_t>(y) * bitmap.width + x) * sizeof(Color_rgb) + channel] += change;
+                }
+            }
+        }
+    }
+}
+
+// Updating the scaled image after a change must give the same result as resizing the changed image.
+static void test_update_resized_bitmap_point_sampled()
+{
+    for(const auto& size : {std::make_pair(97u, 61u), std::make_pair(13u, 77u)})
+    {
+        auto unscaled = make_random_bitmap(40, 30, Pixel_format::Rgb, size.first);
+        auto scaled = resize_bitmap_point_sampled(unscaled, size.first, size.second);
+
+        change_pixels(unscaled, test_rectangles, 77);
+        update_resized_bitmap_point_sampled(unscaled, test_rectangles, scaled);
+        TEST_CHECK(scaled.bitmap == resize_bitmap_point_sampled(unscaled, size.first, size.second).bitmap);
+    }
+}
+
+void run_bitmap_tests()
+{
+    test_merge_rectangles();
+    test_update_resized_bitmap_point_sampled();
+}
+
+}
+
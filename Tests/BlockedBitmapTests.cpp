@@ -0,0 +1,101 @@
+#include "PreCompile.h"
+#include "Tests.h"
+#include "Bitmap.h"
+#include "BlockedBitmap.h"
+#include "Filter.h"
+#include "TestBitmaps.h"
+#include <cstdio>
+
+namespace ImageProcessing
+{
+
+// Sizes with partial blocks and partial groups of blocks on the right and bottom edges, and more than one group.
+static const std::pair<unsigned int, unsigned int> test_sizes[] = {{1, 1}, {17, 33}, {300, 150}};
+
+static void test_round_trip()
+{
+    for(const Pixel_format format : {Pixel_format::Rgb, Pixel_format::Rgba})
+    {
+        for(const auto& size : test_sizes)
+        {
+            const auto bitmap = make_random_bitmap(size.first, size.second, format, size.first);
+            const auto blocked_bitmap = make_blocked_bitmap(bitmap);
+            TEST_CHECK((blocked_bitmap.width() == bitmap.width) && (blocked_bitmap.height() == bitmap.height));
+
+            const auto round_trip = make_bitmap_from_blocked_bitmap(blocked_bitmap);
+            TEST_CHECK((round_trip.width == bitmap.width) && (round_trip.height == bitmap.height));
+            TEST_CHECK((round_trip.format == format) && (round_trip.bitmap == bitmap.bitmap));
+        }
+    }
+}
+
+// Regions that cross block edges and extend past the image repeat the edge pixels.
+static void test_read_region_clamps_to_edges()
+{
+    const auto bitmap = make_random_bitmap(37, 29, Pixel_format::Rgba, 39);
+    const auto blocked_bitmap = make_blocked_bitmap(bitmap);
+
+    const int x = -3;
+    const int y = 14;
+    const unsigned int width = 45;
+    const unsigned int height = 20;
+    std::vector<uint8_t> region(static_cast<size_t>(width) * height * sizeof(Color_rgba));
+    blocked_bitmap.read_region(x, y, width, height, region.data(), width * sizeof(Color_rgba));
+
+    for(unsigned int region_y = 0; region_y < height; ++region_y)
+    {
+        for(unsigned int region_x = 0; region_x < width; ++region_x)
+        {
+            const int source_x = std::min(std::max(x + static_cast<int>(region_x), 0), 36);
+            const int source_y = std::min(std::max(y + static_cast<int>(region_y), 0), 28);
+            const auto expected = bitmap.bitmap.begin() + (static_cast<size_t>(source_y) * 37 + source_x) * sizeof(Color_rgba);
+            TEST_CHECK(std::equal(expected, expected + sizeof(Color_rgba), region.begin() + (static_cast<size_t>(region_y) * width + region_x) * sizeof(Color_rgba)));
+        }
+    }
+}
+
+static void test_box_filter_matches_linear()
+{
+    const auto source = make_random_bitmap(300, 150, Pixel_format::Rgb, 40);
+    const auto blocked_source = make_blocked_bitmap(source);
+    for(const Blend_space blend_space : {Blend_space::Srgb, Blend_space::Linear})
+    {
+        for(const unsigned int dimension : {3u, 9u})
+        {
+            const auto filter = generate_simple_box_filter(dimension);
+            const auto expected = apply_box_filter(filter, dimension, source, blend_space);
+            const auto filtered = make_bitmap_from_blocked_bitmap(apply_box_filter(filter, dimension, blocked_source, blend_space));
+            TEST_CHECK(filtered.bitmap == expected.bitmap);
+        }
+    }
+}
+
+static void test_resize_matches_linear()
+{
+    const auto source = make_random_bitmap(300, 150, Pixel_format::Rgb, 41);
+    const auto blocked_source = make_blocked_bitmap(source);
+    for(const auto& size : {std::make_pair(97u, 61u), std::make_pair(611u, 151u)})
+    {
+        const auto point_sampled = resize_bitmap_point_sampled(source, size.first, size.second);
+        const auto blocked_point_sampled = make_bitmap_from_blocked_bitmap(resize_bitmap_point_sampled(blocked_source, size.first, size.second));
+        TEST_CHECK(blocked_point_sampled.bitmap == point_sampled.bitmap);
+
+        for(const Blend_space blend_space : {Blend_space::Srgb, Blend_space::Linear})
+        {
+            const auto area_averaged = resize_bitmap_area_averaged(source, size.first, size.second, blend_space);
+            const auto blocked_area_averaged = make_bitmap_from_blocked_bitmap(resize_bitmap_area_averaged(blocked_source, size.first, size.second, blend_space));
+            TEST_CHECK(blocked_area_averaged.bitmap == area_averaged.bitmap);
+        }
+    }
+}
+
+void run_blocked_bitmap_tests()
+{
+    test_round_trip();
+    test_read_region_clamps_to_edges();
+    test_box_filter_matches_linear();
+    test_resize_matches_linear();
+}
+
+}
+
@@ -0,0 +1,151 @@
+#include "PreCompile.h"
+#include "Tests.h"
+#include "Bitmap.h"
+#include "Compare.h"
+#include "TestBitmaps.h"
+#include <cstdio>
+
+namespace ImageProcessing
+{
+
+// Two differences: 10 in green at (2, 1), then 4 in blue at (3, 2), out of 36 values.
+static void test_compare_bitmaps()
+{
+    for_each_simd_level([]()
+    {
+        const Bitmap first{std::vector<uint8_t>(4 * 3 * sizeof(Color_rgb), 100), 4, 3, true};
+        auto second = first;
+
+        const auto identical = compare_bitmaps(first, second);
+        TEST_CHECK(identical.identical && (identical.first_difference_x == 0) && (identical.first_difference_y == 0));
+        TEST_CHECK((identical.maximum_absolute_difference == 0) && (identical.mean_absolute_difference == 0.0) && std::isinf(identical.psnr));
+
+        second.bitmap[(1 * 4 + 2) * sizeof(Color_rgb) + 1] = 110;
+        second.bitmap[(2 * 4 + 3) * sizeof(Color_rgb) + 2] = 96;
+
+        const auto difference = compare_bitmaps(first, second);
+        TEST_CHECK(!difference.identical && (difference.first_difference_x == 2) && (difference.first_difference_y == 1));
+        TEST_CHECK(difference.maximum_absolute_difference == 10);
+        TEST_CHECK(std::abs(difference.mean_absolute_difference - 14.0 / 36.0) < 1e-12);
+        TEST_CHECK(std::abs(difference.psnr - 10.0 * std::log10(255.0 * 255.0 / (116.0 / 36.0))) < 1e-9);
+
+        unsigned int first_x;
+        unsigned int first_y;
+        TEST_CHECK(!bitmaps_are_identical(first, second, &first_x, &first_y) && (first_x == 2) && (first_y == 1));
+        TEST_CHECK(bitmaps_are_identical(first, first, &first_x, &first_y) && (first_x == 0) && (first_y == 0));
+    });
+}
+
+// Start of each window along one direction: every 4 pixels, then one aligned to the far edge if the steps miss it.
+static std::vector<unsigned int> get_reference_window_starts(unsigned int size, unsigned int window_size)
+{
+    std::vector<unsigned int> starts;
+    for(unsigned int start = 0; start + window_size <= size; start += 4)
+    {
+        starts.push_back(start);
+    }
+    if(starts.back() + window_size != size)
+    {
+        starts.push_back(size - window_size);
+    }
+
+    // Return value optimization expected.
+    return starts;
+}
+
+// Straightforward SSIM of Wang et al., one window and channel at a time.
+static double reference_ssim(const Bitmap& first, const Bitmap& second)
+{
+    const size_t channel_count = get_bytes_per_pixel(first.format);
+    const unsigned int window_width = std::min(8u, first.width);
+    const unsigned int window_height = std::min(8u, first.height);
+    const double count = static_cast<double>(window_width) * window_height;
+    const double c1 = (0.01 * 255.0) * (0.01 * 255.0);
+    const double c2 = (0.03 * 255.0) * (0.03 * 255.0);
+
+    double total = 0.0;
+    size_t window_count = 0;
+    for(const unsigned int top : get_reference_window_starts(first.height, window_height))
+    {
+        for(const unsigned int left : get_reference_window_starts(first.width, window_width))
+        {
+            for(size_t channel = 0; channel < channel_count; ++channel)
+            {
+                double first_sum = 0.0, second_sum = 0.0, first_squared_sum = 0.0, second_squared_sum = 0.0, product_sum = 0.0;
+                for(unsigned int y = top; y < top + window_height; ++y)
+                {
+                    for(unsigned int x = left; x < left + window_width; ++x)
+                    {
+                        const size_t ix = (static_cast<size_t>(y) * first.width + x) * channel_count + channel;
+                        const double first_value = first.bitmap[ix];
+                        const double second_value = second.bitmap[ix];
+                        first_sum += first_value;
+                        second_sum += second_value;
+                        first_squared_sum += first_value * first_value;
+                        second_squared_sum += second_value * second_value;
+                        product_sum += first_value * second_value;
+                    }
+                }
+
+                const double first_mean = first_sum / count;
+                const double second_mean = second_sum / count;
+                const double first_variance = first_squared_sum / count - first_mean * first_mean;
+                const double second_variance = second_squared_sum / count - second_mean * second_mean;
+                const double covariance = product_sum / count - first_mean * second_mean;
+                total += ((2.0 * first_mean * second_mean + c1) * (2.0 * covariance + c2)) /
+                         ((first_mean * first_mean + second_mean * second_mean + c1) * (first_variance + second_variance + c2));
+                ++window_count;
+            }
+        }
+    }
+
+    return total / window_count;
+}
+
+// Sizes include images smaller than a window, and sizes where the steps stop short of the right and bottom edges.
+static void test_ssim_matches_reference()
+{
+    for(const Pixel_format format : {Pixel_format::Rgb, Pixel_format::Rgba})
+    {
+        for(const auto& size : {std::make_pair(1u, 1u), std::make_pair(5u, 3u), std::make_pair(8u, 8u), std::make_pair(18u, 13u), std::make_pair(37u, 29u)})
+        {
+            const auto first = make_random_bitmap(size.first, size.second, format, size.first);
+            TEST_CHECK(compute_ssim(first, first) == 1.0);
+
+            // A noisy copy, so the windows have a range of similarities.
+            auto second = first;
+            const auto noise = make_random_bitmap(size.first, size.second, format, size.second);
+            for(size_t ix = 0; ix < second.bitmap.size(); ++ix)
+            {
+                second.bitmap[ix] = static_cast<uint8_t>(std::min(255, second.bitmap[ix] + noise.bitmap[ix] % 32));
+            }
+
+            TEST_CHECK(std::abs(compute_ssim(first, second) - reference_ssim(first, second)) < 1e-9);
+        }
+    }
+}
+
+// With 18x13 images, the steps stop at column 15 and row 11, so the bottom right pixel is only in the edge windows.
+static void test_ssim_covers_edges()
+{
+    for(const auto& size : {std::make_pair(18u, 13u), std::make_pair(5u, 3u)})
+    {
+        const auto first = make_random_bitmap(size.first, size.second, Pixel_format::Rgb, 44);
+        auto second = first;
+        second.bitmap.back() ^= 0x80;
+
+        const double ssim = compute_ssim(first, second);
+        TEST_CHECK(ssim < 1.0);
+        TEST_CHECK(std::abs(ssim - reference_ssim(first, second)) < 1e-9);
+    }
+}
+
+void run_compare_tests()
+{
+    test_compare_bitmaps();
+    test_ssim_matches_reference();
+    test_ssim_covers_edges();
+}
+
+}
+
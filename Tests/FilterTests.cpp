@@ -0,0 +1,198 @@
+#include "PreCompile.h"
+#include "Tests.h"
+#include "Bitmap.h"
+#include "Filter.h"
+#include "TestBitmaps.h"
+#include <cstdio>
+#include <random>
+
+namespace ImageProcessing
+{
+
+static std::vector<float> make_random_filter(unsigned int dimension, std::mt19937& generator)
+{
+    std::vector<float> filter(dimension * dimension);
+    std::generate(filter.begin(), filter.end(), [&generator, dimension]() { return (generator() % 1000) / (1000.0f * dimension * dimension); });
+
+    // Return value optimization expected.
+    return filter;
+}
+
+// Dimensions 3, 5 and 7 take the unrolled kernels, and other dimensions take the general path.  Narrow images
+// are filtered without the kernels.  Every route must match the brute force filter at every level.
+static void test_box_filter_matches_reference()
+{
+    std::mt19937 generator(33);
+    for_each_simd_level([&generator]()
+    {
+        for(const unsigned int width : {17u, 30u, 97u})
+        {
+            const auto source = make_random_bitmap(width, 23, Pixel_format::Rgb, width);
+            for(const unsigned int dimension : {1u, 3u, 5u, 7u, 9u})
+            {
+                if(dimension >= width / 2)
+                {
+                    continue;
+                }
+
+                for(const auto& filter : {generate_simple_box_filter(dimension), make_random_filter(dimension, generator)})
+                {
+                    TEST_CHECK(apply_box_filter(filter, dimension, source).bitmap == reference_box_filter(filter, dimension, source, Blend_space::Srgb).bitmap);
+                }
+            }
+        }
+    });
+}
+
+// Straightforward morphology, one output channel at a time, over the window clipped to the image.
+static Bitmap reference_extreme(const Bitmap& source, unsigned int dimension, bool maximum)
+{
+    const int half_dimension = static_cast<int>(dimension / 2);
+    const size_t channel_count = get_bytes_per_pixel(source.format);
+
+    Bitmap target = source;
+    for(int y = 0; y < static_cast<int>(source.height); ++y)
+    {
+        for(int x = 0; x < static_cast<int>(source.width); ++x)
+        {
+            for(size_t channel = 0; channel < channel_count; ++channel)
+            {
+                uint8_t extreme = maximum ? 0 : 255;
+                for(int window_y = std::max(y - half_dimension, 0); window_y <= std::min(y + half_dimension, static_cast<int>(source.height) - 1); ++window_y)
+                {
+                    for(int window_x = std::max(x - half_dimension, 0); window_x <= std::min(x + half_dimension, static_cast<int>(source.width) - 1); ++window_x)
+                    {
+                        const uint8_t value = source.bitmap[(static_cast<size_t>(window_y) * source.width + window_x) * channel_count + channel];
+                        extreme = maximum ? std::max(extreme, value) : std::min(extreme, value);
+                    }
+                }
+
+                target.bitmap[(static_cast<size_t>(y) * source.width + x) * channel_count + channel] = extreme;
+            }
+        }
+    }
+
+    // Return value optimization expected.
+    return target;
+}
+
+// Sizes leave partial bands of rows and partial strips of bytes, and windows may be larger than the image.
+static void test_morphology_matches_reference()
+{
+    for_each_simd_level([]()
+    {
+        for(const Pixel_format format : {Pixel_format::Rgb, Pixel_format::Rgba})
+        {
+            for(const auto& size : {std::make_pair(1u, 1u), std::make_pair(5u, 3u), std::make_pair(37u, 23u), std::make_pair(300u, 70u)})
+            {
+                const auto source = make_random_bitmap(size.first, size.second, format, size.first * size.second);
+                for(const unsigned int dimension : {1u, 3u, 5u, 15u})
+                {
+                    const auto eroded = reference_extreme(source, dimension, false);
+                    const auto dilated = reference_extreme(source, dimension, true);
+                    const auto opened = reference_extreme(eroded, dimension, true);
+                    const auto closed = reference_extreme(dilated, dimension, false);
+
+                    TEST_CHECK(erode_bitmap(source, dimension).bitmap == eroded.bitmap);
+                    TEST_CHECK(dilate_bitmap(source, dimension).bitmap == dilated.bitmap);
+                    TEST_CHECK(open_bitmap(source, dimension).bitmap == opened.bitmap);
+                    TEST_CHECK(close_bitmap(source, dimension).bitmap == closed.bitmap);
+                }
+            }
+        }
+    });
+}
+
+// Straightforward median, one output channel at a time, with samples outside the image repeating the edge pixels.
+static Bitmap reference_median_filter(const Bitmap& source, unsigned int dimension)
+{
+    const int half_dimension = static_cast<int>(dimension / 2);
+    const size_t channel_count = get_bytes_per_pixel(source.format);
+
+    Bitmap target = source;
+    std::vector<uint8_t> samples;
+    for(int y = 0; y < static_cast<int>(source.height); ++y)
+    {
+        for(int x = 0; x < static_cast<int>(source.width); ++x)
+        {
+            for(size_t channel = 0; channel < channel_count; ++channel)
+            {
+                samples.clear();
+                for(int window_y = y - half_dimension; window_y <= y + half_dimension; ++window_y)
+                {
+                    for(int window_x = x - half_dimension; window_x <= x + half_dimension; ++window_x)
+                    {
+                        const int sample_x = std::min(std::max(window_x, 0), static_cast<int>(source.width) - 1);
+                        const int sample_y = std::min(std::max(window_y, 0), static_cast<int>(source.height) - 1);
+                        samples.push_back(source.bitmap[(static_cast<size_t>(sample_y) * source.width + sample_x) * channel_count + channel]);
+                    }
+                }
+
+                std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+                target.bitmap[(static_cast<size_t>(y) * source.width + x) * channel_count + channel] = samples[samples.size() / 2];
+            }
+        }
+    }
+
+    // Return value optimization expected.
+    return target;
+}
+
+// Dimensions 3, 5, 7 and 9 are radii of 1 to 4, both odd and even.  Sizes cover a second strip of columns and
+// windows larger than the image, where most samples are repeated edge pixels.
+static void test_median_filter_matches_reference()
+{
+    for(const Pixel_format format : {Pixel_format::Rgb, Pixel_format::Rgba})
+    {
+        for(const auto& size : {std::make_pair(1u, 1u), std::make_pair(4u, 3u), std::make_pair(37u, 23u), std::make_pair(300u, 19u)})
+        {
+            const auto source = make_random_bitmap(size.first, size.second, format, size.first + size.second);
+            for(const unsigned int dimension : {1u, 3u, 5u, 7u, 9u})
+            {
+                TEST_CHECK(apply_median_filter(source, dimension).bitmap == reference_median_filter(source, dimension).bitmap);
+            }
+        }
+    }
+}
+
+// Updating the filtered image after a change must give the same result as filtering the changed image.  The dirty
+// rectangles overlap, touch, and cross the edges of the image.
+static void test_update_box_filtered_bitmap()
+{
+    const std::vector<Bitmap_rectangle> dirty_rectangles{{2, 3, 10, 9}, {8, 5, 15, 12}, {15, 5, 20, 12}, {30, 20, 50, 40},
+                                                         {0, 25, 40, 30}, {45, 0, 60, 10}, {35, 0, 40, 1}, {21, 17, 22, 18}};
+    for(const Blend_space blend_space : {Blend_space::Srgb, Blend_space::Linear})
+    {
+        for(const unsigned int dimension : {3u, 5u, 9u})
+        {
+            const auto filter = generate_simple_box_filter(dimension);
+            auto source = make_random_bitmap(40, 30, Pixel_format::Rgb, dimension);
+            auto target = apply_box_filter(filter, dimension, source, blend_space);
+
+            for(const Bitmap_rectangle& rectangle : dirty_rectangles)
+            {
+                for(unsigned int y = rectangle.top; y < std::min(rectangle.bottom, source.height); ++y)
+                {
+                    for(unsigned int x = rectangle.left; x < std::min(rectangle.right, source.width); ++x)
+                    {
+                        source.bitmap[(static_cast<size_t>(y) * source.width + x) * sizeof(Color_rgb)] ^= 0x55;
+                    }
+                }
+            }
+
+            update_box_filtered_bitmap(filter, dimension, source, dirty_rectangles, target, blend_space);
+            TEST_CHECK(target.bitmap == apply_box_filter(filter, dimension, source, blend_space).bitmap);
+        }
+    }
+}
+
+void run_filter_tests()
+{
+    test_box_filter_matches_reference();
+    test_morphology_matches_reference();
+    test_median_filter_matches_reference();
+    test_update_box_filtered_bitmap();
+}
+
+}
+
@@ -0,0 +1,72 @@
+#include "PreCompile.h"
+#include "Tests.h"
+#include "Bitmap.h"
+#include "Filter.h"
+#include "Gamma.h"
+#include "TestBitmaps.h"
+#include <cstdio>
+
+namespace ImageProcessing
+{
+
+// Converting to linear light and back must not change any encoded value.
+static void test_srgb_round_trip()
+{
+    for(unsigned int value = 0; value < 256; ++value)
+    {
+        TEST_CHECK(linear_to_srgb(srgb_to_linear(static_cast<uint8_t>(value))) == value);
+    }
+
+    // The conversion to linear light is strictly increasing, so no two encoded values collapse.
+    for(unsigned int value = 1; value < 256; ++value)
+    {
+        TEST_CHECK(srgb_to_linear(static_cast<uint8_t>(value)) > srgb_to_linear(static_cast<uint8_t>(value - 1)));
+    }
+}
+
+static void test_linear_box_filter()
+{
+    const auto source = make_random_bitmap(37, 29, Pixel_format::Rgb, 3);
+    for(const unsigned int dimension : {1u, 3u, 5u, 9u})
+    {
+        const auto filter = generate_simple_box_filter(dimension);
+        TEST_CHECK(apply_box_filter(filter, dimension, source, Blend_space::Linear).bitmap ==
+                   reference_box_filter(filter, dimension, source, Blend_space::Linear).bitmap);
+    }
+
+    // A blur of black and white averages light, so it is brighter than the average of the encoded values.
+    Bitmap checkerboard{std::vector<uint8_t>(16 * 16 * sizeof(Color_rgb)), 16, 16, true};
+    for(size_t ix = 0; ix < 16 * 16; ++ix)
+    {
+        const uint8_t value = (((ix % 16) + (ix / 16)) % 2 == 0) ? 255 : 0;
+        std::fill_n(checkerboard.bitmap.begin() + ix * sizeof(Color_rgb), sizeof(Color_rgb), value);
+    }
+
+    const auto filter = std::vector<float>{0.25f, 0.25f, 0.0f, 0.25f, 0.25f, 0.0f, 0.0f, 0.0f, 0.0f};
+    const auto blurred = apply_box_filter(filter, 3, checkerboard, Blend_space::Linear);
+    TEST_CHECK(blurred.bitmap[(8 * 16 + 8) * sizeof(Color_rgb)] == linear_to_srgb(32768));
+    TEST_CHECK(blurred.bitmap[(8 * 16 + 8) * sizeof(Color_rgb)] == 188);
+}
+
+static void test_linear_gradient()
+{
+    Bitmap gradient{std::vector<uint8_t>(4 * 11 * sizeof(Color_rgb)), 4, 11, false};
+    generate_topdown_gradient_in_place(gradient, Color_rgb(0, 10, 255), Color_rgb(255, 200, 0), Blend_space::Linear);
+
+    // The ends are the start and end colors, and the middle row is half of the light of each channel.
+    const uint8_t first_row[] = {0, 10, 255};
+    const uint8_t last_row[] = {255, 200, 0};
+    TEST_CHECK(std::equal(first_row, first_row + 3, gradient.bitmap.begin()));
+    TEST_CHECK(std::equal(last_row, last_row + 3, gradient.bitmap.end() - 3));
+    TEST_CHECK(gradient.bitmap[5 * 4 * sizeof(Color_rgb)] == linear_to_srgb(clamp_to_linear(65535 * 0.5f)));
+}
+
+void run_gamma_tests()
+{
+    test_srgb_round_trip();
+    test_linear_box_filter();
+    test_linear_gradient();
+}
+
+}
+
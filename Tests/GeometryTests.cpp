@@ -0,0 +1,94 @@
+#include "PreCompile.h"
+#include "Tests.h"
+#include "Bitmap.h"
+#include "BlockedBitmap.h"
+#include "Geometry.h"
+#include "TestBitmaps.h"
+#include <cstdio>
+
+namespace ImageProcessing
+{
+
+// Straightforward transform, one pixel at a time, where target pixel (x, y) is source pixel source_position(x, y).
+template<typename Source_position>
+static Bitmap reference_transform(const Bitmap& source, unsigned int width, unsigned int height, const Source_position& source_position)
+{
+    const size_t pixel_size = get_bytes_per_pixel(source.format);
+    Bitmap target{std::vector<uint8_t>(static_cast<size_t>(width) * height * pixel_size), width, height, source.filtered, source.format};
+    for(unsigned int y = 0; y < height; ++y)
+    {
+        for(unsigned int x = 0; x < width; ++x)
+        {
+            const auto position = source_position(x, y);
+            const uint8_t* source_pixel = &source.bitmap[(static_cast<size_t>(position.second) * source.width + position.first) * pixel_size];
+            std::copy(source_pixel, source_pixel + pixel_size, &target.bitmap[(static_cast<size_t>(y) * width + x) * pixel_size]);
+        }
+    }
+
+    // Return value optimization expected.
+    return target;
+}
+
+// Checks one transform of the linear and blocked layouts against the reference.
+template<typename Transform_bitmap, typename Transform_blocked_bitmap>
+static void check_transform(const Bitmap& source, const Bitmap& expected, const Transform_bitmap& transform_bitmap,
+                            const Transform_blocked_bitmap& transform_blocked_bitmap)
+{
+    const Bitmap transformed = transform_bitmap(source);
+    TEST_CHECK((transformed.width == expected.width) && (transformed.height == expected.height));
+    TEST_CHECK((transformed.format == expected.format) && (transformed.bitmap == expected.bitmap));
+
+    const Bitmap blocked_transformed = make_bitmap_from_blocked_bitmap(transform_blocked_bitmap(make_blocked_bitmap(source)));
+    TEST_CHECK((blocked_transformed.width == expected.width) && (blocked_transformed.height == expected.height));
+    TEST_CHECK((blocked_transformed.format == expected.format) && (blocked_transformed.bitmap == expected.bitmap));
+}
+
+// Sizes are chosen to leave partial tiles and partial blocks on the right and bottom edges.
+static void test_transforms_match_reference()
+{
+    for_each_simd_level([]()
+    {
+        for(const Pixel_format format : {Pixel_format::Rgb, Pixel_format::Rgba})
+        {
+            for(const auto& size : {std::make_pair(1u, 1u), std::make_pair(37u, 21u), std::make_pair(70u, 45u)})
+            {
+                const unsigned int width = size.first;
+                const unsigned int height = size.second;
+                const auto source = make_random_bitmap(width, height, format, width * height);
+
+                check_transform(source, reference_transform(source, width, height, [=](unsigned int x, unsigned int y) { return std::make_pair(width - x - 1, y); }),
+                                [](const Bitmap& bitmap) { return flip_bitmap_horizontally(bitmap); },
+                                [](const Blocked_bitmap& bitmap) { return flip_bitmap_horizontally(bitmap); });
+
+                check_transform(source, reference_transform(source, width, height, [=](unsigned int x, unsigned int y) { return std::make_pair(x, height - y - 1); }),
+                                [](const Bitmap& bitmap) { return flip_bitmap_vertically(bitmap); },
+                                [](const Blocked_bitmap& bitmap) { return flip_bitmap_vertically(bitmap); });
+
+                // Clockwise, so the top left of the target is the bottom left of the source.
+                check_transform(source, reference_transform(source, height, width, [=](unsigned int x, unsigned int y) { return std::make_pair(y, height - x - 1); }),
+                                [](const Bitmap& bitmap) { return rotate_bitmap_90(bitmap); },
+                                [](const Blocked_bitmap& bitmap) { return rotate_bitmap_90(bitmap); });
+
+                check_transform(source, reference_transform(source, width, height, [=](unsigned int x, unsigned int y) { return std::make_pair(width - x - 1, height - y - 1); }),
+                                [](const Bitmap& bitmap) { return rotate_bitmap_180(bitmap); },
+                                [](const Blocked_bitmap& bitmap) { return rotate_bitmap_180(bitmap); });
+
+                check_transform(source, reference_transform(source, height, width, [=](unsigned int x, unsigned int y) { return std::make_pair(width - y - 1, x); }),
+                                [](const Bitmap& bitmap) { return rotate_bitmap_270(bitmap); },
+                                [](const Blocked_bitmap& bitmap) { return rotate_bitmap_270(bitmap); });
+
+                check_transform(source, reference_transform(source, height, width, [](unsigned int x, unsigned int y) { return std::make_pair(y, x); }),
+                                [](const Bitmap& bitmap) { return transpose_bitmap(bitmap); },
+                                [](const Blocked_bitmap& bitmap) { return transpose_bitmap(bitmap); });
+            }
+        }
+    });
+}
+
+void run_geometry_tests()
+{
+    test_transforms_match_reference();
+}
+
+}
+
@@ -0,0 +1,112 @@
+#include "PreCompile.h"
+#include "Tests.h"
+#include "Bitmap.h"
+#include "Histogram.h"
+#include "TestBitmaps.h"
+#include <cstdio>
+
+namespace ImageProcessing
+{
+
+template<typename Function>
+static bool throws_exception(Function function)
+{
+    try
+    {
+        function();
+    }
+    catch(const std::exception&)
+    {
+        return true;
+    }
+
+    return false;
+}
+
+// Remapping premultiplied color would let it exceed alpha, so premultiplied images are rejected in every build.
+static void test_premultiplied_is_rejected()
+{
+    Bitmap bitmap{std::vector<uint8_t>(4 * 4 * sizeof(Color_rgba), 64), 4, 4, true, Pixel_format::Rgba_premultiplied};
+    const auto original = bitmap.bitmap;
+
+    TEST_CHECK(throws_exception([&bitmap]() { apply_auto_levels_in_place(bitmap); }));
+    TEST_CHECK(throws_exception([&bitmap]() { equalize_histogram_in_place(bitmap); }));
+    TEST_CHECK(bitmap.bitmap == original);
+}
+
+static void test_mismatched_statistics_are_rejected()
+{
+    Bitmap bitmap{std::vector<uint8_t>(4 * 4 * sizeof(Color_rgb), 64), 4, 4, true};
+    Bitmap larger{std::vector<uint8_t>(5 * 4 * sizeof(Color_rgb), 64), 5, 4, true};
+    const auto statistics = compute_bitmap_statistics(larger);
+
+    TEST_CHECK(throws_exception([&bitmap, &statistics]() { apply_auto_levels_in_place(bitmap, statistics); }));
+    TEST_CHECK(throws_exception([&bitmap, &statistics]() { equalize_histogram_in_place(bitmap, statistics); }));
+}
+
+static void test_statistics_match_simple_histogram()
+{
+    for(const Pixel_format format : {Pixel_format::Rgb, Pixel_format::Rgba})
+    {
+        // An odd width leaves a single pixel after the pairs of each row.
+        const auto bitmap = make_random_bitmap(33, 21, format, 34);
+        const auto statistics = compute_bitmap_statistics(bitmap);
+
+        const unsigned int channel_count = static_cast<unsigned int>(get_bytes_per_pixel(format));
+        TEST_CHECK(statistics.channel_count == channel_count);
+        TEST_CHECK(statistics.pixel_count == 33 * 21);
+
+        for(unsigned int channel = 0; channel < channel_count; ++channel)
+        {
+            uint64_t histogram[256] = {};
+            uint64_t sum = 0;
+            uint8_t minimum = 255;
+            uint8_t maximum = 0;
+            for(size_t ix = channel; ix < bitmap.bitmap.size(); ix += channel_count)
+            {
+                const uint8_t value = bitmap.bitmap[ix];
+                ++histogram[value];
+                sum += value;
+                minimum = std::min(minimum, value);
+                maximum = std::max(maximum, value);
+            }
+
+            const Channel_statistics& channel_statistics = statistics.channels[channel];
+            TEST_CHECK(std::equal(histogram, histogram + 256, channel_statistics.histogram));
+            TEST_CHECK((channel_statistics.minimum == minimum) && (channel_statistics.maximum == maximum));
+            TEST_CHECK(channel_statistics.mean == static_cast<double>(sum) / statistics.pixel_count);
+        }
+    }
+}
+
+// Red is stretched from 50-200 to 0-255 with rounding, green has a single value and is unchanged, and alpha is unchanged.
+static void test_auto_levels_mapping()
+{
+    Bitmap bitmap{{50, 10, 0, 7, 100, 10, 255, 8, 150, 10, 128, 9, 200, 10, 1, 10}, 4, 1, true, Pixel_format::Rgba};
+    apply_auto_levels_in_place(bitmap);
+
+    const std::vector<uint8_t> expected{0, 10, 0, 7, 85, 10, 255, 8, 170, 10, 128, 9, 255, 10, 1, 10};
+    TEST_CHECK(bitmap.bitmap == expected);
+}
+
+// With red values 10, 20, 20 and 30, the cumulative counts above the lowest value are 0, 2 and 3 of 3.
+static void test_equalization_mapping()
+{
+    Bitmap bitmap{{10, 5, 40, 20, 5, 40, 20, 5, 40, 30, 5, 41}, 2, 2, true};
+    equalize_histogram_in_place(bitmap);
+
+    const std::vector<uint8_t> expected{0, 5, 0, 170, 5, 0, 170, 5, 0, 255, 5, 255};
+    TEST_CHECK(bitmap.bitmap == expected);
+}
+
+void run_histogram_tests()
+{
+    test_statistics_match_simple_histogram();
+    test_auto_levels_mapping();
+    test_equalization_mapping();
+    test_premultiplied_is_rejected();
+    test_mismatched_statistics_are_rejected();
+}
+
+}
+
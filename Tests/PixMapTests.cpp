@@ -0,0 +1,127 @@
+#include "PreCompile.h"
+#include "Tests.h"
+#include "Bitmap.h"
+#include "PixMap.h"
+#include "TiledBitmap.h"
+#include <cstdio>
+#include <random>
+
+namespace ImageProcessing
+{
+
+static Bitmap make_random_bitmap(unsigned int width, unsigned int height, bool grayscale, unsigned int seed)
+{
+    std::mt19937 generator(seed);
+    Bitmap bitmap{std::vector<uint8_t>(width * height * sizeof(Color_rgb)), width, height, true};
+    for(size_t ii = 0; ii < bitmap.bitmap.size(); ii += sizeof(Color_rgb))
+    {
+        bitmap.bitmap[ii] = static_cast<uint8_t>(generator());
+        bitmap.bitmap[ii + 1] = grayscale ? bitmap.bitmap[ii] : static_cast<uint8_t>(generator());
+        bitmap.bitmap[ii + 2] = grayscale ? bitmap.bitmap[ii] : static_cast<uint8_t>(generator());
+    }
+
+    // Return value optimization expected.
+    return bitmap;
+}
+
+// Binary data begins immediately after the single whitespace that ends the header, so leading data bytes
+// that look like whitespace or comments must survive an encode and decode.
+static void test_binary_round_trip()
+{
+    constexpr uint8_t first_values[] = {0x00, 0x09, 0x0a, 0x0d, 0x20, 0x23, 0x50, 0xff};
+
+    unsigned int seed = 1;
+    for(const bool grayscale : {false, true})
+    {
+        for(const uint8_t first_value : first_values)
+        {
+            auto bitmap = make_random_bitmap(13, 5, grayscale, seed++);
+            std::fill_n(bitmap.bitmap.begin(), grayscale ? sizeof(Color_rgb) : 1, first_value);
+
+            const auto encoded = encode_pixmap_from_bitmap(bitmap, true);
+            TEST_CHECK(encoded[1] == (grayscale ? u8'5' : u8'6'));
+
+            const auto decoded = decode_bitmap_from_pixmap_memory(encoded.data(), encoded.size());
+            TEST_CHECK((decoded.width == bitmap.width) && (decoded.height == bitmap.height));
+            TEST_CHECK(decoded.bitmap == bitmap.bitmap);
+        }
+    }
+}
+
+static void test_binary_header_whitespace()
+{
+    // A single space separator, with data containing a newline and a comment marker.
+    const uint8_t values[] = {u8'\n', u8'#', 3, 4, 5, 6};
+    std::string pixmap = u8"P6 2 1 255 ";
+    pixmap.append(reinterpret_cast<const char*>(values), sizeof(values));
+
+    const auto decoded = decode_bitmap_from_pixmap_memory(reinterpret_cast<const uint8_t*>(pixmap.data()), pixmap.size());
+    TEST_CHECK((decoded.width == 2) && (decoded.height == 1));
+    TEST_CHECK(std::equal(values, values + sizeof(values), decoded.bitmap.begin()));
+}
+
+// The preview, region and tiled decoders parse the header separately from the full decoder.
+static void test_partial_decoders_header_whitespace()
+{
+    auto bitmap = make_random_bitmap(4, 4, false, 7);
+    bitmap.bitmap[0] = u8'\n';
+    bitmap.bitmap[1] = u8'#';
+
+    std::string pixmap = u8"P6 4 4 255 ";
+    pixmap.append(reinterpret_cast<const char*>(bitmap.bitmap.data()), bitmap.bitmap.size());
+    const uint8_t* pixmap_memory = reinterpret_cast<const uint8_t*>(pixmap.data());
+
+    const auto preview = decode_preview_from_pixmap_memory(pixmap_memory, pixmap.size(), 4);
+    TEST_CHECK((preview.width == 4) && (preview.height == 4) && (preview.bitmap == bitmap.bitmap));
+
+    const auto region = decode_region_from_pixmap_memory(pixmap_memory, pixmap.size(), 0, 0, 2, 1);
+    TEST_CHECK(std::equal(region.bitmap.begin(), region.bitmap.end(), bitmap.bitmap.begin()));
+
+    const char file_name[] = u8"PixMapTests.ppm";
+    {
+        std::ofstream file(file_name, std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write(pixmap.data(), pixmap.size());
+        TEST_CHECK(file.good());
+    }
+
+    std::vector<uint8_t> tiled_pixels(bitmap.bitmap.size());
+    {
+        const auto tiled = decode_tiled_bitmap_from_pixmap_file(file_name, Tiled_bitmap_options{SIZE_MAX, std::string()});
+        tiled.read_region(0, 0, 4, 4, tiled_pixels.data(), 4 * sizeof(Color_rgb));
+    }
+    std::remove(file_name);
+    TEST_CHECK(tiled_pixels == bitmap.bitmap);
+}
+
+// A region far larger than the image must be rejected before the region is allocated.
+static void test_huge_region_is_rejected()
+{
+    const auto bitmap = make_random_bitmap(4, 4, false, 9);
+    const auto binary = encode_pixmap_from_bitmap(bitmap, false);
+    const std::string ascii = u8"P3 1 1 255 1 2 3";
+
+    for(const auto& pixmap : {std::string(binary.begin(), binary.end()), ascii})
+    {
+        bool rejected = false;
+        try
+        {
+            decode_region_from_pixmap_memory(reinterpret_cast<const uint8_t*>(pixmap.data()), pixmap.size(), 0, 0, 0x40000000, 0x40000000);
+        }
+        catch(const std::runtime_error&)
+        {
+            rejected = true;
+        }
+        TEST_CHECK(rejected);
+    }
+}
+
+void run_pixmap_tests()
+{
+    test_binary_round_trip();
+    test_binary_header_whitespace();
+    test_partial_decoders_header_whitespace();
+    test_huge_region_is_rejected();
+}
+
+}
+
@@ -0,0 +1,158 @@
+#include "PreCompile.h"
+#include "Tests.h"
+#include "Bitmap.h"
+#include "CpuDispatch.h"
+#include "PixelKernels.h"
+#include <cstdio>
+#include <random>
+
+namespace ImageProcessing
+{
+
+// Counts straddle the vector widths of each level, so that both the vector loops and the remainders run.
+static const size_t kernel_test_counts[] = {0, 1, 3, 7, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 127, 128, 129, 257, 1000};
+
+static std::vector<uint8_t> make_random_bytes(size_t count, std::mt19937& generator)
+{
+    std::vector<uint8_t> bytes(count);
+    std::generate(bytes.begin(), bytes.end(), [&generator]() { return static_cast<uint8_t>(generator()); });
+
+    // Return value optimization expected.
+    return bytes;
+}
+
+static bool pixels_are_equal(const std::vector<Color_rgb>& first, const std::vector<Color_rgb>& second)
+{
+    return (first.size() == second.size()) &&
+           (first.empty() || (std::memcmp(first.data(), second.data(), first.size() * sizeof(Color_rgb)) == 0));
+}
+
+static void test_kernels_match_scalar(const Pixel_kernels& scalar, const Pixel_kernels& kernels, std::mt19937& generator)
+{
+    for(const size_t count : kernel_test_counts)
+    {
+        const auto source = make_random_bytes(count * sizeof(Color_rgb), generator);
+        const auto other = make_random_bytes(count * sizeof(Color_rgb), generator);
+        const Color_rgb* source_pixels = reinterpret_cast<const Color_rgb*>(source.data());
+
+        std::vector<uint32_t> scalar_accumulator(count * sizeof(Color_rgb), 7);
+        std::vector<uint32_t> accumulator(scalar_accumulator);
+        for(const float tap : {1.0f / 9.0f, 0.5f, 1.0f, 0.04f})
+        {
+            scalar.accumulate_filter_tap(source.data(), tap, scalar_accumulator.data(), scalar_accumulator.size());
+            kernels.accumulate_filter_tap(source.data(), tap, accumulator.data(), accumulator.size());
+        }
+        TEST_CHECK(accumulator == scalar_accumulator);
+
+        std::vector<Color_rgb> scalar_pixels(count, Color_rgb(0, 0, 0));
+        std::vector<Color_rgb> pixels(scalar_pixels);
+
+        const size_t source_count = count / 2 + 7;
+        std::vector<unsigned int> source_indices(count);
+        for(size_t ix = 0; ix < count; ++ix)
+        {
+            source_indices[ix] = static_cast<unsigned int>(ix * source_count / count);
+        }
+        const auto gather_source = make_random_bytes(source_count * sizeof(Color_rgb), generator);
+        scalar.gather_pixels(reinterpret_cast<const Color_rgb*>(gather_source.data()), source_count, source_indices.data(), scalar_pixels.data(), count);
+        kernels.gather_pixels(reinterpret_cast<const Color_rgb*>(gather_source.data()), source_count, source_indices.data(), pixels.data(), count);
+        TEST_CHECK(pixels_are_equal(pixels, scalar_pixels));
+
+        scalar.fill_pixels(scalar_pixels.data(), Color_rgb(1, 2, 3), count);
+        kernels.fill_pixels(pixels.data(), Color_rgb(1, 2, 3), count);
+        TEST_CHECK(pixels_are_equal(pixels, scalar_pixels));
+
+        scalar.interleave_planes(source.data(), source.data() + count, source.data() + count * 2, scalar_pixels.data(), count);
+        kernels.interleave_planes(source.data(), source.data() + count, source.data() + count * 2, pixels.data(), count);
+        TEST_CHECK(pixels_are_equal(pixels, scalar_pixels));
+
+        std::vector<uint8_t> gray(count);
+        std::generate(gray.begin(), gray.end(), [&generator]() { return static_cast<uint8_t>(generator() % 16); });
+        TEST_CHECK(scalar.expand_gray(gray.data(), 15, 17, scalar_pixels.data(), count));
+        TEST_CHECK(kernels.expand_gray(gray.data(), 15, 17, pixels.data(), count));
+        TEST_CHECK(pixels_are_equal(pixels, scalar_pixels));
+        if(count > 0)
+        {
+            gray[count - 1 - count / 3] = 16;
+            TEST_CHECK(!scalar.expand_gray(gray.data(), 15, 17, scalar_pixels.data(), count));
+            TEST_CHECK(!kernels.expand_gray(gray.data(), 15, 17, pixels.data(), count));
+        }
+
+        scalar.convert_bgr(source.data(), scalar_pixels.data(), count);
+        kernels.convert_bgr(source.data(), pixels.data(), count);
+        TEST_CHECK(pixels_are_equal(pixels, scalar_pixels));
+
+        scalar.convert_bgr_reversed(source.data(), scalar_pixels.data(), count);
+        kernels.convert_bgr_reversed(source.data(), pixels.data(), count);
+        TEST_CHECK(pixels_are_equal(pixels, scalar_pixels));
+
+        scalar.reverse_pixels(source_pixels, scalar_pixels.data(), count);
+        kernels.reverse_pixels(source_pixels, pixels.data(), count);
+        TEST_CHECK(pixels_are_equal(pixels, scalar_pixels));
+
+        std::vector<uint8_t> scalar_bytes(source.size());
+        std::vector<uint8_t> bytes(source.size());
+        scalar.minimum_bytes(source.data(), other.data(), scalar_bytes.data(), source.size());
+        kernels.minimum_bytes(source.data(), other.data(), bytes.data(), source.size());
+        TEST_CHECK(bytes == scalar_bytes);
+
+        scalar.maximum_bytes(source.data(), other.data(), scalar_bytes.data(), source.size());
+        kernels.maximum_bytes(source.data(), other.data(), bytes.data(), source.size());
+        TEST_CHECK(bytes == scalar_bytes);
+
+        // The target may be one of the sources.
+        bytes = source;
+        kernels.minimum_bytes(bytes.data(), other.data(), bytes.data(), bytes.size());
+        scalar.minimum_bytes(source.data(), other.data(), scalar_bytes.data(), source.size());
+        TEST_CHECK(bytes == scalar_bytes);
+
+        uint64_t scalar_sums[2] = {5, 11};
+        uint64_t sums[2] = {5, 11};
+        const uint8_t scalar_maximum = scalar.accumulate_differences(source.data(), other.data(), source.size(), &scalar_sums[0], &scalar_sums[1]);
+        const uint8_t maximum = kernels.accumulate_differences(source.data(), other.data(), source.size(), &sums[0], &sums[1]);
+        TEST_CHECK((maximum == scalar_maximum) && std::equal(sums, sums + 2, scalar_sums));
+    }
+
+    // Fixed dimension box filter rows.
+    for(const size_t count : {fixed_filter_minimum_count, fixed_filter_minimum_count + 1, size_t{100}, size_t{1000}})
+    {
+        for(size_t dimension = 3; dimension <= 7; dimension += 2)
+        {
+            const size_t border = dimension / 2 * sizeof(Color_rgb);
+
+            std::vector<std::vector<uint8_t>> source_rows;
+            std::vector<const uint8_t*> rows;
+            for(size_t row = 0; row < dimension; ++row)
+            {
+                source_rows.push_back(make_random_bytes(count + border * 2, generator));
+                rows.push_back(source_rows.back().data() + border);
+            }
+
+            std::vector<float> taps(dimension * dimension);
+            std::generate(taps.begin(), taps.end(), [&generator, dimension]() { return (generator() % 1000) / (1000.0f * dimension * dimension); });
+
+            const size_t fixed_index = dimension / 2 - 1;
+            std::vector<uint8_t> scalar_target(count);
+            std::vector<uint8_t> target(count);
+            scalar.filter_fixed_row[fixed_index](rows.data(), taps.data(), scalar_target.data(), count);
+            kernels.filter_fixed_row[fixed_index](rows.data(), taps.data(), target.data(), count);
+            TEST_CHECK(target == scalar_target);
+        }
+    }
+}
+
+// Every level supported by this CPU must produce output identical to the scalar kernels.
+void run_pixel_kernels_tests()
+{
+    const auto& scalar = get_pixel_kernels(Simd_level::Scalar);
+    std::mt19937 generator(5);
+
+    const auto detected_level = get_detected_simd_level();
+    for(int level = static_cast<int>(Simd_level::Scalar); level <= static_cast<int>(detected_level); ++level)
+    {
+        test_kernels_match_scalar(scalar, get_pixel_kernels(static_cast<Simd_level>(level)), generator);
+    }
+}
+
+}
+
@@ -0,0 +1,100 @@
+#include "PreCompile.h"
+#include "Tests.h"
+#include "Bitmap.h"
+#include "pcx.h"
+#include "Quantize.h"
+#include "TestBitmaps.h"
+#include <cstdio>
+#include <random>
+
+namespace ImageProcessing
+{
+
+static const Dither_mode dither_modes[] = {Dither_mode::None, Dither_mode::Ordered, Dither_mode::Error_diffusion};
+
+static std::vector<uint8_t> expand_paletted_bitmap(const Paletted_bitmap& paletted)
+{
+    std::vector<uint8_t> pixels;
+    pixels.reserve(paletted.indices.size() * sizeof(Color_rgb));
+    for(const uint8_t index : paletted.indices)
+    {
+        const Color_rgb& color = paletted.palette[index];
+        pixels.insert(pixels.end(), {color.red, color.green, color.blue});
+    }
+
+    // Return value optimization expected.
+    return pixels;
+}
+
+static void test_palette_bounds()
+{
+    const auto bitmap = make_random_bitmap(61, 43, Pixel_format::Rgb, 21);
+    for(const unsigned int color_count : {1u, 2u, 7u, 16u, 256u})
+    {
+        for(const Dither_mode dither_mode : dither_modes)
+        {
+            const auto paletted = quantize_bitmap(bitmap, color_count, dither_mode);
+            TEST_CHECK((paletted.width == bitmap.width) && (paletted.height == bitmap.height));
+            TEST_CHECK(!paletted.palette.empty() && (paletted.palette.size() <= color_count));
+            TEST_CHECK(paletted.indices.size() == static_cast<size_t>(bitmap.width) * bitmap.height);
+            TEST_CHECK(std::all_of(paletted.indices.cbegin(), paletted.indices.cend(), [&paletted](uint8_t index)
+            {
+                return index < paletted.palette.size();
+            }));
+        }
+    }
+}
+
+// Colors are chosen to share histogram cells, which median cut alone would merge.
+static void test_few_colors_are_exact()
+{
+    std::mt19937 generator(4);
+    for(const unsigned int distinct_count : {1u, 2u, 16u, 256u})
+    {
+        std::vector<Color_rgb> colors;
+        for(unsigned int ix = 0; ix < distinct_count; ++ix)
+        {
+            colors.push_back(Color_rgb(static_cast<uint8_t>(ix), static_cast<uint8_t>(ix * 3), static_cast<uint8_t>(255 - ix)));
+        }
+
+        Bitmap bitmap{std::vector<uint8_t>(), 40, 30, true};
+        for(size_t ix = 0; ix < static_cast<size_t>(bitmap.width) * bitmap.height; ++ix)
+        {
+            const Color_rgb& color = colors[ix < distinct_count ? ix : generator() % distinct_count];
+            bitmap.bitmap.insert(bitmap.bitmap.end(), {color.red, color.green, color.blue});
+        }
+
+        for(const unsigned int color_count : {distinct_count, std::min(256u, distinct_count * 2)})
+        {
+            for(const Dither_mode dither_mode : dither_modes)
+            {
+                const auto paletted = quantize_bitmap(bitmap, color_count, dither_mode);
+                TEST_CHECK(paletted.palette.size() == distinct_count);
+                TEST_CHECK(expand_paletted_bitmap(paletted) == bitmap.bitmap);
+            }
+        }
+    }
+}
+
+static void test_pcx_round_trip()
+{
+    const auto bitmap = make_random_bitmap(37, 19, Pixel_format::Rgb, 22);
+    for(const unsigned int color_count : {2u, 16u, 256u})
+    {
+        const auto paletted = quantize_bitmap(bitmap, color_count, Dither_mode::Error_diffusion);
+        const auto encoded = encode_pcx_from_paletted_bitmap(paletted);
+        const auto decoded = decode_bitmap_from_pcx_memory(encoded.data(), encoded.size());
+        TEST_CHECK((decoded.width == bitmap.width) && (decoded.height == bitmap.height));
+        TEST_CHECK(decoded.bitmap == expand_paletted_bitmap(paletted));
+    }
+}
+
+void run_quantize_tests()
+{
+    test_palette_bounds();
+    test_few_colors_are_exact();
+    test_pcx_round_trip();
+}
+
+}
+
@@ -0,0 +1,199 @@
+#include "PreCompile.h"
+#include "Tests.h"
+#include "Bitmap.h"
+#include "targa.h"
+#include "TestBitmaps.h"
+#include <cstdio>
+
+namespace ImageProcessing
+{
+
+// A file too small to hold an extension area, whose footer still claims one, must not be read past its end.
+static void test_tiny_file_with_footer()
+{
+    Bitmap bitmap{std::vector<uint8_t>(2 * 2 * sizeof(Color_rgba)), 2, 2, true, Pixel_format::Rgba};
+    for(size_t ii = 0; ii < bitmap.bitmap.size(); ++ii)
+    {
+        bitmap.bitmap[ii] = static_cast<uint8_t>(ii * 13);
+    }
+
+    // The footer will point at the pixels, where blue and green read as an extension size of 65535.
+    bitmap.bitmap[1] = 0xff;
+    bitmap.bitmap[2] = 0xff;
+
+    // Keep the header, the pixels and the footer, dropping the extension area.
+    const auto encoded = encode_tga_from_bitmap(bitmap);
+    constexpr size_t header_size = 18;
+    constexpr size_t footer_size = 26;
+    const size_t pixels_end = header_size + bitmap.bitmap.size();
+    std::vector<uint8_t> tiny(encoded.begin(), encoded.begin() + pixels_end);
+    tiny.insert(tiny.end(), encoded.end() - footer_size, encoded.end());
+    TEST_CHECK(tiny.size() == 60);
+    tiny[pixels_end] = header_size;
+
+    const auto decoded = decode_bitmap_from_tga_memory(tiny.data(), tiny.size());
+    TEST_CHECK((decoded.format == Pixel_format::Rgba) && (decoded.bitmap == bitmap.bitmap));
+
+    const auto preview = decode_preview_from_tga_memory(tiny.data(), tiny.size(), 2);
+    TEST_CHECK((preview.format == Pixel_format::Rgba) && (preview.bitmap == bitmap.bitmap));
+
+    const auto region = decode_region_from_tga_memory(tiny.data(), tiny.size(), 1, 1, 1, 1);
+    TEST_CHECK((region.format == Pixel_format::Rgba) && std::equal(region.bitmap.begin(), region.bitmap.end(), bitmap.bitmap.end() - sizeof(Color_rgba)));
+}
+
+// Four by two 24-bit top to bottom RLE image.  The rows are a run packet and a raw packet, in either order.
+static std::vector<uint8_t> make_rle_tga(bool run_first)
+{
+    std::vector<uint8_t> tga(18);
+    tga[2] = 10;
+    tga[12] = 4;
+    tga[14] = 2;
+    tga[16] = 24;
+    tga[17] = 0x20;
+
+    const uint8_t run_row[] = {0x83, 1, 2, 3};
+    const uint8_t raw_row[] = {0x03, 10, 11, 12, 20, 21, 22, 30, 31, 32, 40, 41, 42};
+    if(run_first)
+    {
+        tga.insert(tga.end(), run_row, run_row + sizeof(run_row));
+    }
+    tga.insert(tga.end(), raw_row, raw_row + sizeof(raw_row));
+    if(!run_first)
+    {
+        tga.insert(tga.end(), run_row, run_row + sizeof(run_row));
+    }
+
+    // Return value optimization expected.
+    return tga;
+}
+
+// Checks that decoding row y of second with an index built for first gives the same pixels as decoding without one.
+static void check_scanline_index_is_rebuilt(const std::vector<uint8_t>& first, const std::vector<uint8_t>& second, unsigned int width, unsigned int y)
+{
+    TEST_CHECK(first.size() == second.size());
+
+    const auto first_expected = decode_region_from_tga_memory(first.data(), first.size(), 0, y, width, 1);
+    const auto second_expected = decode_region_from_tga_memory(second.data(), second.size(), 0, y, width, 1);
+    TEST_CHECK(first_expected.bitmap != second_expected.bitmap);
+
+    TGA_scanline_index index{};
+    const auto first_region = decode_region_from_tga_memory(first.data(), first.size(), 0, y, width, 1, false, &index);
+    TEST_CHECK(first_region.bitmap == first_expected.bitmap);
+
+    const auto second_region = decode_region_from_tga_memory(second.data(), second.size(), 0, y, width, 1, false, &index);
+    TEST_CHECK(second_region.bitmap == second_expected.bitmap);
+}
+
+// An index built for one file must not be used for another file of the same size and height.
+static void test_scanline_index_is_rebuilt_for_other_file()
+{
+    check_scanline_index_is_rebuilt(make_rle_tga(true), make_rle_tga(false), 4, 1);
+
+    // Nine by three images with the same header and the same last row, which holds the footer bytes, whose first
+    // two rows are a run packet and a raw packet in either order.  Only the row boundaries tell them apart.
+    std::vector<uint8_t> header(18);
+    header[2] = 10;
+    header[12] = 9;
+    header[14] = 3;
+    header[16] = 24;
+    header[17] = 0x20;
+
+    const std::vector<uint8_t> run_row{0x88, 1, 2, 3};
+    std::vector<uint8_t> raw_row{0x08};
+    std::vector<uint8_t> last_row{0x08};
+    for(uint8_t value = 0; value < 27; ++value)
+    {
+        raw_row.push_back(static_cast<uint8_t>(10 + value));
+        last_row.push_back(static_cast<uint8_t>(100 + value));
+    }
+
+    auto first = header;
+    auto second = header;
+    for(const auto& row : {run_row, raw_row, last_row})
+    {
+        first.insert(first.end(), row.begin(), row.end());
+    }
+    for(const auto& row : {raw_row, run_row, last_row})
+    {
+        second.insert(second.end(), row.begin(), row.end());
+    }
+
+    check_scanline_index_is_rebuilt(first, second, 9, 1);
+}
+
+// Retained alpha is data rather than coverage, so it is never premultiplied, while coverage alpha is.
+static void test_retained_alpha_is_not_premultiplied()
+{
+    Bitmap bitmap{std::vector<uint8_t>(3 * 2 * sizeof(Color_rgba)), 3, 2, true, Pixel_format::Rgba};
+    for(size_t ii = 0; ii < bitmap.bitmap.size(); ++ii)
+    {
+        bitmap.bitmap[ii] = static_cast<uint8_t>(ii * 37 + 5);
+    }
+
+    auto encoded = encode_tga_from_bitmap(bitmap);
+    const auto premultiplied = decode_bitmap_from_tga_memory(encoded.data(), encoded.size(), true);
+    TEST_CHECK((premultiplied.format == Pixel_format::Rgba_premultiplied) && (premultiplied.bitmap != bitmap.bitmap));
+
+    // The attributes type is the last byte of the extension area, which directly follows the pixels.
+    constexpr size_t header_size = 18;
+    constexpr size_t extension_size = 495;
+    constexpr uint8_t retained_alpha = 2;
+    encoded[header_size + bitmap.bitmap.size() + extension_size - 1] = retained_alpha;
+
+    for(const bool premultiply_alpha : {false, true})
+    {
+        const auto decoded = decode_bitmap_from_tga_memory(encoded.data(), encoded.size(), premultiply_alpha);
+        TEST_CHECK((decoded.format == Pixel_format::Rgba) && (decoded.bitmap == bitmap.bitmap));
+    }
+}
+
+// Right to left rows are reversed as they are converted, for every format and alpha conversion at every level.
+static void test_right_to_left_rows_are_reversed()
+{
+    for_each_simd_level([]()
+    {
+        for(const Pixel_format format : {Pixel_format::Rgb, Pixel_format::Rgba})
+        {
+            // Thirty-seven pixels leaves a partial vector at the end of each row.
+            const auto bitmap = make_random_bitmap(37, 3, format, 35);
+            const auto encoded = encode_tga_from_bitmap(bitmap);
+
+            // Reverse the pixels of each row in the file, and mark the rows as right to left.
+            constexpr size_t header_size = 18;
+            const size_t pixel_size = get_bytes_per_pixel(format);
+            const size_t row_size = bitmap.width * pixel_size;
+            auto mirrored = encoded;
+            for(size_t row_start = header_size + encoded[0]; row_start < header_size + encoded[0] + bitmap.bitmap.size(); row_start += row_size)
+            {
+                for(size_t ix = 0; ix < bitmap.width; ++ix)
+                {
+                    const auto source_pixel = encoded.begin() + row_start + (bitmap.width - ix - 1) * pixel_size;
+                    std::copy(source_pixel, source_pixel + pixel_size, mirrored.begin() + row_start + ix * pixel_size);
+                }
+            }
+            mirrored[17] |= 0x10;
+
+            for(const bool premultiply_alpha : {false, true})
+            {
+                const auto expected = decode_bitmap_from_tga_memory(encoded.data(), encoded.size(), premultiply_alpha);
+                const auto decoded = decode_bitmap_from_tga_memory(mirrored.data(), mirrored.size(), premultiply_alpha);
+                TEST_CHECK((decoded.format == expected.format) && (decoded.bitmap == expected.bitmap));
+
+                const auto expected_region = decode_region_from_tga_memory(encoded.data(), encoded.size(), 5, 1, 29, 2, premultiply_alpha, nullptr);
+                const auto region = decode_region_from_tga_memory(mirrored.data(), mirrored.size(), 5, 1, 29, 2, premultiply_alpha, nullptr);
+                TEST_CHECK(region.bitmap == expected_region.bitmap);
+            }
+        }
+    });
+}
+
+void run_targa_tests()
+{
+    test_right_to_left_rows_are_reversed();
+    test_tiny_file_with_footer();
+    test_retained_alpha_is_not_premultiplied();
+    test_scanline_index_is_rebuilt_for_other_file();
+}
+
+}
+
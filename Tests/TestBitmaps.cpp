@@ -0,0 +1,74 @@
+#include "PreCompile.h"
+#include "Bitmap.h"
+#include "CpuDispatch.h"
+#include "Gamma.h"
+#include "TestBitmaps.h"        // Pick up forward declarations to ensure correctness.
+#include <random>
+
+namespace ImageProcessing
+{
+
+Bitmap make_random_bitmap(unsigned int width, unsigned int height, Pixel_format format, unsigned int seed)
+{
+    std::mt19937 generator(seed);
+    Bitmap bitmap{std::vector<uint8_t>(static_cast<size_t>(width) * height * get_bytes_per_pixel(format)), width, height, true, format};
+    std::generate(bitmap.bitmap.begin(), bitmap.bitmap.end(), [&generator]() { return static_cast<uint8_t>(generator()); });
+
+    // Return value optimization expected.
+    return bitmap;
+}
+
+Bitmap reference_box_filter(const std::vector<float>& filter, unsigned int dimension, const Bitmap& source, Blend_space blend_space)
+{
+    const int width = static_cast<int>(source.width);
+    const int height = static_cast<int>(source.height);
+    const int half_dimension = static_cast<int>(dimension / 2);
+
+    Bitmap target{std::vector<uint8_t>(source.bitmap.size()), source.width, source.height, source.filtered};
+    for(int h_ix = 0; h_ix < height; ++h_ix)
+    {
+        for(int w_ix = 0; w_ix < width; ++w_ix)
+        {
+            for(size_t channel = 0; channel < sizeof(Color_rgb); ++channel)
+            {
+                uint32_t srgb_sum = 0;
+                float linear_sum = 0.0f;
+                for(int d_h = 0; d_h < static_cast<int>(dimension); ++d_h)
+                {
+                    for(int d_w = 0; d_w < static_cast<int>(dimension); ++d_w)
+                    {
+                        const int sample_w = std::min(std::max(0, w_ix + d_w - half_dimension), width - 1);
+                        const int sample_h = std::min(std::max(0, h_ix + d_h - half_dimension), height - 1);
+                        const uint8_t sample = source.bitmap[(static_cast<size_t>(sample_h) * width + sample_w) * sizeof(Color_rgb) + channel];
+                        const float tap = filter[dimension * d_h + d_w];
+
+                        // Each truncated product is added as a byte, so the sum wraps at 256.
+                        srgb_sum += static_cast<uint8_t>(sample * tap);
+                        linear_sum += srgb_to_linear(sample) * tap;
+                    }
+                }
+
+                target.bitmap[(static_cast<size_t>(h_ix) * width + w_ix) * sizeof(Color_rgb) + channel] =
+                    (blend_space == Blend_space::Linear) ? linear_to_srgb(clamp_to_linear(linear_sum)) : static_cast<uint8_t>(srgb_sum);
+            }
+        }
+    }
+
+    // Return value optimization expected.
+    return target;
+}
+
+void for_each_simd_level(const std::function<void()>& test)
+{
+    const auto detected_level = get_detected_simd_level();
+    for(int level = static_cast<int>(Simd_level::Scalar); level <= static_cast<int>(detected_level); ++level)
+    {
+        set_simd_level(static_cast<Simd_level>(level));
+        test();
+    }
+
+    set_simd_level(detected_level);
+}
+
+}
+
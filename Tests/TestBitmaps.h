@@ -0,0 +1,17 @@
+#pragma once
+
+namespace ImageProcessing
+{
+
+// Bitmap of random pixels in the given format.  The same seed always gives the same bitmap.
+struct Bitmap make_random_bitmap(unsigned int width, unsigned int height, Pixel_format format, unsigned int seed);
+
+// Straightforward box filter, one output pixel and one tap at a time, with samples clamped to the edges.
+// Taps are summed in the same order as the library's filters, so linear light results are identical too.
+struct Bitmap reference_box_filter(const std::vector<float>& filter, unsigned int dimension, const struct Bitmap& source, Blend_space blend_space);
+
+// Runs test once at each level the CPU supports, then restores the detected level.
+void for_each_simd_level(const std::function<void()>& test);
+
+}
+
@@ -0,0 +1,24 @@
+#include "PreCompile.h"
+#include "Tests.h"
+#include <cstdio>
+
+int main()
+{
+    ImageProcessing::run_bitmap_tests();
+    ImageProcessing::run_bitmap_cache_tests();
+    ImageProcessing::run_blocked_bitmap_tests();
+    ImageProcessing::run_compare_tests();
+    ImageProcessing::run_filter_tests();
+    ImageProcessing::run_gamma_tests();
+    ImageProcessing::run_geometry_tests();
+    ImageProcessing::run_histogram_tests();
+    ImageProcessing::run_pixel_kernels_tests();
+    ImageProcessing::run_pixmap_tests();
+    ImageProcessing::run_quantize_tests();
+    ImageProcessing::run_targa_tests();
+    ImageProcessing::run_tiled_bitmap_tests();
+
+    std::puts("All tests passed.");
+    return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,32 @@
+#pragma once
+
+// Minimal test harness.  A failed check reports the location and exits, so the first failure is the one shown.
+#define TEST_CHECK(condition) \
+    do \
+    { \
+        if(!(condition)) \
+        { \
+            std::fprintf(stderr, "%s(%d): Check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(EXIT_FAILURE); \
+        } \
+    } while(false)
+
+namespace ImageProcessing
+{
+
+void run_bitmap_tests();
+void run_bitmap_cache_tests();
+void run_blocked_bitmap_tests();
+void run_compare_tests();
+void run_filter_tests();
+void run_gamma_tests();
+void run_geometry_tests();
+void run_histogram_tests();
+void run_pixel_kernels_tests();
+void run_pixmap_tests();
+void run_quantize_tests();
+void run_targa_tests();
+void run_tiled_bitmap_tests();
+
+}
+
@@ -0,0 +1,152 @@
+#include "PreCompile.h"
+#include "Tests.h"
+#include "Bitmap.h"
+#include "Filter.h"
+#include "PixMap.h"
+#include "targa.h"
+#include "TestBitmaps.h"
+#include "TiledBitmap.h"
+#include <cstdio>
+#include <filesystem>
+
+namespace ImageProcessing
+{
+
+// Larger than a tile in both directions, with partial tiles on the right and bottom edges.
+const unsigned int test_width = Tiled_bitmap::tile_size + 45;
+const unsigned int test_height = Tiled_bitmap::tile_size + 14;
+
+// A budget larger than any test image keeps the store in memory, and a budget of zero spills it to a scratch file.
+static const Tiled_bitmap_options test_options[] = {{size_t(1) << 30, ""}, {0, ""}};
+
+static void test_round_trip()
+{
+    for(const Pixel_format format : {Pixel_format::Rgb, Pixel_format::Rgba})
+    {
+        const auto bitmap = make_random_bitmap(test_width, test_height, format, 36);
+        for(const auto& options : test_options)
+        {
+            const auto tiled_bitmap = make_tiled_bitmap(bitmap, options);
+            TEST_CHECK(tiled_bitmap.is_file_backed() == (options.memory_budget == 0));
+
+            const auto round_trip = make_bitmap_from_tiled_bitmap(tiled_bitmap);
+            TEST_CHECK((round_trip.width == bitmap.width) && (round_trip.height == bitmap.height));
+            TEST_CHECK((round_trip.format == format) && (round_trip.bitmap == bitmap.bitmap));
+        }
+    }
+}
+
+// Each tile reads a border from its neighbors, which must give the same result as filtering the whole image.
+static void test_box_filter_matches_linear()
+{
+    const auto source = make_random_bitmap(test_width, test_height, Pixel_format::Rgb, 37);
+    for(const auto& options : test_options)
+    {
+        const auto tiled_source = make_tiled_bitmap(source, options);
+        for(const Blend_space blend_space : {Blend_space::Srgb, Blend_space::Linear})
+        {
+            for(const unsigned int dimension : {3u, 9u})
+            {
+                const auto filter = generate_simple_box_filter(dimension);
+                const auto expected = apply_box_filter(filter, dimension, source, blend_space);
+
+                Tiled_bitmap tiled_target(test_width, test_height, Pixel_format::Rgb, options);
+                apply_box_filter(filter, dimension, tiled_source, tiled_target, blend_space);
+                TEST_CHECK(make_bitmap_from_tiled_bitmap(tiled_target).bitmap == expected.bitmap);
+            }
+        }
+    }
+}
+
+// Scaled blocks cover windows of the unscaled image, which must give the same result as resizing the whole image.
+static void test_resize_matches_linear()
+{
+    const auto source = make_random_bitmap(test_width, test_height, Pixel_format::Rgb, 38);
+    for(const auto& options : test_options)
+    {
+        const auto tiled_source = make_tiled_bitmap(source, options);
+        for(const auto& size : {std::make_pair(97u, 61u), std::make_pair(2 * test_width + 3, test_height + 1)})
+        {
+            const unsigned int scaled_width = size.first;
+            const unsigned int scaled_height = size.second;
+
+            Tiled_bitmap tiled_point_sampled(scaled_width, scaled_height, Pixel_format::Rgb, options);
+            resize_bitmap_point_sampled(tiled_source, tiled_point_sampled);
+            const auto point_sampled = resize_bitmap_point_sampled(source, scaled_width, scaled_height);
+            TEST_CHECK(make_bitmap_from_tiled_bitmap(tiled_point_sampled).bitmap == point_sampled.bitmap);
+
+            for(const Blend_space blend_space : {Blend_space::Srgb, Blend_space::Linear})
+            {
+                Tiled_bitmap tiled_area_averaged(scaled_width, scaled_height, Pixel_format::Rgb, options);
+                resize_bitmap_area_averaged(tiled_source, tiled_area_averaged, blend_space);
+                const auto area_averaged = resize_bitmap_area_averaged(source, scaled_width, scaled_height, blend_space);
+                TEST_CHECK(make_bitmap_from_tiled_bitmap(tiled_area_averaged).bitmap == area_averaged.bitmap);
+            }
+        }
+    }
+}
+
+static void write_test_file(const std::string& file_name, const std::vector<uint8_t>& data)
+{
+    std::ofstream file(file_name, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    TEST_CHECK(file.good());
+}
+
+// Streaming decoders must give the same image as decoding the whole file in memory.
+static void test_decode_matches_memory_decode(const std::string& directory)
+{
+    const std::string pixmap_file_name = directory + u8"/test.ppm";
+    for(const bool grayscale : {false, true})
+    {
+        auto bitmap = make_random_bitmap(test_width, test_height, Pixel_format::Rgb, 39);
+        if(grayscale)
+        {
+            for(size_t ix = 0; ix < bitmap.bitmap.size(); ix += sizeof(Color_rgb))
+            {
+                std::fill_n(bitmap.bitmap.begin() + ix + 1, 2, bitmap.bitmap[ix]);
+            }
+        }
+
+        const auto encoded = encode_pixmap_from_bitmap(bitmap, grayscale);
+        write_test_file(pixmap_file_name, encoded);
+        const auto expected = decode_bitmap_from_pixmap_memory(encoded.data(), encoded.size());
+        for(const auto& options : test_options)
+        {
+            const auto decoded = make_bitmap_from_tiled_bitmap(decode_tiled_bitmap_from_pixmap_file(pixmap_file_name.c_str(), options));
+            TEST_CHECK((decoded.format == expected.format) && (decoded.bitmap == expected.bitmap));
+        }
+    }
+
+    const std::string tga_file_name = directory + u8"/test.tga";
+    for(const Pixel_format format : {Pixel_format::Rgb, Pixel_format::Rgba})
+    {
+        const auto encoded = encode_tga_from_bitmap(make_random_bitmap(test_width, test_height, format, 40));
+        write_test_file(tga_file_name, encoded);
+        for(const bool premultiply_alpha : {false, true})
+        {
+            const auto expected = decode_bitmap_from_tga_memory(encoded.data(), encoded.size(), premultiply_alpha);
+            for(const auto& options : test_options)
+            {
+                const auto decoded = make_bitmap_from_tiled_bitmap(decode_tiled_bitmap_from_tga_file(tga_file_name.c_str(), premultiply_alpha, options));
+                TEST_CHECK((decoded.format == expected.format) && (decoded.bitmap == expected.bitmap));
+            }
+        }
+    }
+}
+
+void run_tiled_bitmap_tests()
+{
+    test_round_trip();
+    test_box_filter_matches_linear();
+    test_resize_matches_linear();
+
+    const auto directory = std::filesystem::temp_directory_path() / u8"TiledBitmapTests";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directory(directory);
+    test_decode_matches_memory_decode(directory.string());
+    std::filesystem::remove_all(directory);
+}
+
+}
+
@@ -0,0 +1,242 @@
+#include "PreCompile.h"
+#include "Bitmap.h"
+#include "TiledBitmap.h"        // Pick up forward declarations to ensure correctness.
+#include <PortableRuntime/CheckException.h>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace ImageProcessing
+{
+
+Tiled_bitmap::Tiled_bitmap(unsigned int width, unsigned int height, Pixel_format format, const Tiled_bitmap_options& options) :
+    m_width(width),
+    m_height(height),
+    m_format(format),
+    m_pixel_size(get_bytes_per_pixel(format)),
+    m_tile_columns((static_cast<size_t>(width) + tile_size - 1) / tile_size),
+    m_tile_bytes(static_cast<size_t>(tile_size) * tile_size * get_bytes_per_pixel(format)),
+    m_pixels(nullptr),
+    m_mapped_size(0)
+{
+    const size_t tile_rows = (static_cast<size_t>(height) + tile_size - 1) / tile_size;
+    const size_t size = m_tile_columns * tile_rows * m_tile_bytes;
+
+    if(size <= options.memory_budget)
+    {
+        m_memory.resize(size);
+        m_pixels = m_memory.data();
+    }
+    else
+    {
+        map_scratch_file(options.scratch_directory, size);
+    }
+}
+
+Tiled_bitmap::Tiled_bitmap(Tiled_bitmap&& other) noexcept :
+    m_width(other.m_width),
+    m_height(other.m_height),
+    m_format(other.m_format),
+    m_pixel_size(other.m_pixel_size),
+    m_tile_columns(other.m_tile_columns),
+    m_tile_bytes(other.m_tile_bytes),
+    m_memory(std::move(other.m_memory)),
+    m_pixels(other.m_pixels),
+    m_mapped_size(other.m_mapped_size)
+{
+    other.m_pixels = nullptr;
+    other.m_mapped_size = 0;
+}
+
+Tiled_bitmap::~Tiled_bitmap()
+{
+    unmap_scratch_file();
+}
+
+// The scratch file is deleted as soon as it is mapped (POSIX) or when the mapping is closed (Windows),
+// so it cannot be leaked if the process exits abnormally.
+void Tiled_bitmap::map_scratch_file(const std::string& directory, size_t size)
+{
+#if defined(_WIN32)
+    std::string scratch_directory = directory;
+    if(scratch_directory.empty())
+    {
+        char temporary_path[MAX_PATH + 1];
+        const DWORD length = GetTempPathA(sizeof(temporary_path), temporary_path);
+        CHECK_EXCEPTION((length > 0) && (length < sizeof(temporary_path)), u8"Could not create scratch file.");
+        scratch_directory.assign(temporary_path, length);
+    }
+
+    char file_name[MAX_PATH];
+    CHECK_EXCEPTION(GetTempFileNameA(scratch_directory.c_str(), "ipt", 0, file_name) != 0, u8"Could not create scratch file.");
+
+    const HANDLE file = CreateFileA(file_name, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                                    FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+    CHECK_EXCEPTION(file != INVALID_HANDLE_VALUE, u8"Could not create scratch file.");
+
+    const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+                                              static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), nullptr);
+    void* view = (mapping != nullptr) ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size) : nullptr;
+
+    // The view keeps the mapping and the file open.
+    if(mapping != nullptr)
+    {
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    CHECK_EXCEPTION(view != nullptr, u8"Could not map scratch file.");
+#else
+    std::string scratch_directory = directory;
+    if(scratch_directory.empty())
+    {
+        const char* temporary_directory = std::getenv("TMPDIR");
+        scratch_directory = (temporary_directory != nullptr) ? temporary_directory : "/tmp";
+    }
+
+    std::string file_name = scratch_directory + "/ImageProcessing-XXXXXX";
+    const int file_descriptor = mkstemp(&file_name[0]);
+    CHECK_EXCEPTION(file_descriptor >= 0, u8"Could not create scratch file.");
+    unlink(file_name.c_str());
+
+    void* view = MAP_FAILED;
+    if(ftruncate(file_descriptor, static_cast<off_t>(size)) == 0)
+    {
+        view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+    }
+
+    // The mapping keeps the file open.
+    close(file_descriptor);
+    CHECK_EXCEPTION(view != MAP_FAILED, u8"Could not map scratch file.");
+#endif
+
+    m_pixels = static_cast<uint8_t*>(view);
+    m_mapped_size = size;
+}
+
+void Tiled_bitmap::unmap_scratch_file() noexcept
+{
+    if(m_mapped_size > 0)
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(m_pixels);
+#else
+        munmap(m_pixels, m_mapped_size);
+#endif
+        m_pixels = nullptr;
+        m_mapped_size = 0;
+    }
+}
+
+uint8_t* Tiled_bitmap::get_tile_row(unsigned int x, unsigned int y) const noexcept
+{
+    assert((x < m_width) && (y < m_height));
+
+    const size_t tile_index = (y / tile_size) * m_tile_columns + (x / tile_size);
+    return m_pixels + tile_index * m_tile_bytes + ((y % tile_size) * static_cast<size_t>(tile_size) + (x % tile_size)) * m_pixel_size;
+}
+
+void Tiled_bitmap::read_region(int x, int y, unsigned int width, unsigned int height, _Out_ uint8_t* target, size_t target_stride) const noexcept
+{
+    assert((m_width > 0) && (m_height > 0));
+
+    const int64_t right = static_cast<int64_t>(x) + width;
+    const int64_t bottom = static_cast<int64_t>(y) + height;
+    const auto clamp_x = [this](int64_t value)
+    {
+        return static_cast<unsigned int>(std::min<int64_t>(std::max<int64_t>(value, 0), m_width - 1));
+    };
+    const auto clamp_y = [this](int64_t value)
+    {
+        return static_cast<unsigned int>(std::min<int64_t>(std::max<int64_t>(value, 0), m_height - 1));
+    };
+
+    // Columns left and right of the image repeat the edge pixels.
+    const unsigned int inside_begin = clamp_x(x);
+    const unsigned int inside_end = std::max(inside_begin, static_cast<unsigned int>(std::min<int64_t>(std::max<int64_t>(right, 0), m_width)));
+    const size_t left_count = static_cast<size_t>(std::min<int64_t>(std::max<int64_t>(-static_cast<int64_t>(x), 0), width));
+    const size_t right_count = width - left_count - (inside_end - inside_begin);
+
+    for(int64_t row = y; row < bottom; ++row)
+    {
+        const unsigned int source_y = clamp_y(row);
+        uint8_t* target_row = target + static_cast<size_t>(row - y) * target_stride;
+        uint8_t* target_pixel = target_row;
+
+        const uint8_t* left_edge = get_tile_row(0, source_y);
+        for(size_t ix = 0; ix < left_count; ++ix)
+        {
+            std::copy(left_edge, left_edge + m_pixel_size, target_pixel);
+            target_pixel += m_pixel_size;
+        }
+
+        // Copy the part of the row inside each tile.
+        for(unsigned int column = inside_begin; column < inside_end;)
+        {
+            const unsigned int count = std::min(inside_end, (column / tile_size + 1) * tile_size) - column;
+            const uint8_t* source = get_tile_row(column, source_y);
+            target_pixel = std::copy(source, source + count * m_pixel_size, target_pixel);
+            column += count;
+        }
+
+        const uint8_t* right_edge = get_tile_row(m_width - 1, source_y);
+        for(size_t ix = 0; ix < right_count; ++ix)
+        {
+            std::copy(right_edge, right_edge + m_pixel_size, target_pixel);
+            target_pixel += m_pixel_size;
+        }
+    }
+}
+
+void Tiled_bitmap::write_region(unsigned int x, unsigned int y, unsigned int width, unsigned int height, _In_ const uint8_t* source, size_t source_stride) noexcept
+{
+    assert((static_cast<uint64_t>(x) + width <= m_width) && (static_cast<uint64_t>(y) + height <= m_height));
+
+    for(unsigned int row = 0; row < height; ++row)
+    {
+        const uint8_t* source_pixel = source + row * source_stride;
+        for(unsigned int column = x; column < x + width;)
+        {
+            const unsigned int count = std::min(x + width, (column / tile_size + 1) * tile_size) - column;
+            uint8_t* target = get_tile_row(column, y + row);
+            std::copy(source_pixel, source_pixel + count * m_pixel_size, target);
+            source_pixel += count * m_pixel_size;
+            column += count;
+        }
+    }
+}
+
+Tiled_bitmap make_tiled_bitmap(const Bitmap& bitmap, const Tiled_bitmap_options& options)
+{
+    Tiled_bitmap tiled_bitmap(bitmap.width, bitmap.height, bitmap.format, options);
+
+    const size_t row_size = static_cast<size_t>(bitmap.width) * get_bytes_per_pixel(bitmap.format);
+    assert(bitmap.bitmap.size() >= row_size * bitmap.height);
+    tiled_bitmap.write_region(0, 0, bitmap.width, bitmap.height, bitmap.bitmap.data(), row_size);
+
+    // Return value optimization expected.
+    return tiled_bitmap;
+}
+
+Bitmap make_bitmap_from_tiled_bitmap(const Tiled_bitmap& tiled_bitmap)
+{
+    const size_t row_size = static_cast<size_t>(tiled_bitmap.width()) * get_bytes_per_pixel(tiled_bitmap.format());
+    Bitmap bitmap{std::vector<uint8_t>(row_size * tiled_bitmap.height()), tiled_bitmap.width(), tiled_bitmap.height(), true, tiled_bitmap.format()};
+
+    if(!bitmap.bitmap.empty())
+    {
+        tiled_bitmap.read_region(0, 0, tiled_bitmap.width(), tiled_bitmap.height(), bitmap.bitmap.data(), row_size);
+    }
+
+    // Return value optimization expected.
+    return bitmap;
+}
+
+}
+
@@ -0,0 +1,66 @@
+#pragma once
+
+namespace ImageProcessing
+{
+
+struct Tiled_bitmap_options
+{
+    size_t memory_budget;               // Stores larger than this many bytes spill to a scratch file.
+    std::string scratch_directory;      // Directory for scratch files.  Empty selects the system temporary directory.
+};
+
+// Image stored as square tiles, for images too large to process as a single Bitmap.  Stores larger than
+// the memory budget are backed by a memory mapped scratch file, which the operating system pages in and
+// out as tiles are used, so resident memory stays bounded.  The scratch file is deleted when the store
+// is destroyed.
+//
+// Distinct regions may be read and written concurrently from multiple threads.
+class Tiled_bitmap
+{
+public:
+    static const unsigned int tile_size = 256;
+
+    Tiled_bitmap(unsigned int width, unsigned int height, Pixel_format format, const Tiled_bitmap_options& options);
+    Tiled_bitmap(Tiled_bitmap&& other) noexcept;
+    ~Tiled_bitmap();
+
+    Tiled_bitmap(const Tiled_bitmap&) = delete;
+    Tiled_bitmap& operator=(const Tiled_bitmap&) = delete;
+    Tiled_bitmap& operator=(Tiled_bitmap&&) = delete;
+
+    unsigned int width() const noexcept { return m_width; }
+    unsigned int height() const noexcept { return m_height; }
+    Pixel_format format() const noexcept { return m_format; }
+    bool is_file_backed() const noexcept { return m_mapped_size > 0; }
+
+    // Copies a rectangle into target, whose rows are target_stride bytes apart.  Coordinates outside the
+    // image are clamped to the nearest edge, so halos around tiles can be read without special cases.
+    void read_region(int x, int y, unsigned int width, unsigned int height, _Out_ uint8_t* target, size_t target_stride) const noexcept;
+
+    // Copies a rectangle, which must be inside the image, from source, whose rows are source_stride bytes apart.
+    void write_region(unsigned int x, unsigned int y, unsigned int width, unsigned int height, _In_ const uint8_t* source, size_t source_stride) noexcept;
+
+private:
+    // Pixels of a tile are stored in rows of tile_size pixels.  Tiles on the right and bottom edges are padded.
+    uint8_t* get_tile_row(unsigned int x, unsigned int y) const noexcept;
+
+    void map_scratch_file(const std::string& directory, size_t size);
+    void unmap_scratch_file() noexcept;
+
+    unsigned int m_width;
+    unsigned int m_height;
+    Pixel_format m_format;
+    size_t m_pixel_size;
+    size_t m_tile_columns;
+    size_t m_tile_bytes;
+
+    std::vector<uint8_t> m_memory;
+    uint8_t* m_pixels;
+    size_t m_mapped_size;
+};
+
+Tiled_bitmap make_tiled_bitmap(const struct Bitmap& bitmap, const Tiled_bitmap_options& options);
+struct Bitmap make_bitmap_from_tiled_bitmap(const Tiled_bitmap& tiled_bitmap);
+
+}
+
@@ -1,7 +1,10 @@
 #include "PreCompile.h"
 #include "pcx.h"                // Pick up forward declarations to ensure correctness.
 #include "Bitmap.h"
+#include "CpuDispatch.h"
 #include "FileExtensionTest.h"
+#include "Parallel.h"
+#include "PixelKernels.h"
 #include <PortableRuntime/CheckException.h>
 
 // PCX spec:
@@ -49,12 +52,17 @@ static void validate_pcx_header(_In_ const PCX_header* header)
 {
     CHECK_EXCEPTION(header->manufacturer == PCX_manufacturer::PCX_magic, u8"Image data is invalid.");
     CHECK_EXCEPTION(header->encoding == PCX_encoding::RLE_encoding, u8"Image data is invalid.");
-    CHECK_EXCEPTION(header->min_x < header->max_x, u8"Image data is invalid.");
-    CHECK_EXCEPTION(header->min_y < header->max_y, u8"Image data is invalid.");
+    CHECK_EXCEPTION(header->min_x <= header->max_x, u8"Image data is invalid.");
+    CHECK_EXCEPTION(header->min_y <= header->max_y, u8"Image data is invalid.");
     CHECK_EXCEPTION((header->color_plane_count == 1) || (header->color_plane_count == 3), u8"Image data is invalid.");
     CHECK_EXCEPTION(header->bits_per_pixel == 8, u8"Image data is invalid.");
+    CHECK_EXCEPTION(header->bytes_per_line >= static_cast<unsigned int>(header->max_x) - header->min_x + 1, u8"Image data is invalid.");
 }
 
+// Runs are stored in the low six bits of a byte with the top two bits set.
+const uint8_t rle_marker = 0xc0;
+const unsigned int max_run_count = 63;
+
 static const uint8_t* rle_decode(
     _In_ const uint8_t* start_iterator,
     _In_ const uint8_t* end_iterator,
@@ -64,9 +72,9 @@ static const uint8_t* rle_decode(
     CHECK_EXCEPTION(start_iterator < end_iterator, u8"Image data is invalid.");
 
     *run_count = 1;
-    if(*start_iterator >= 192)
+    if(*start_iterator >= rle_marker)
     {
-        *run_count = *start_iterator - 192;
+        *run_count = *start_iterator - rle_marker;
         ++start_iterator;
 
         CHECK_EXCEPTION(start_iterator < end_iterator, u8"Image data is invalid.");
@@ -77,56 +85,267 @@ static const uint8_t* rle_decode(
     return start_iterator;
 }
 
-static void rle_decode_fill(
+// Expands the RLE stream into planar scanlines.  Runs may cross scanline boundaries in files
+// written by some encoders, so the entire image is expanded before the planes are interleaved.
+static void pcx_decode(
     _In_reads_to_ptr_(end_iterator) const uint8_t* start_iterator,
     const uint8_t* end_iterator,
     _Out_writes_to_ptr_(output_end_iterator) uint8_t* output_start_iterator,
-    uint8_t* output_end_iterator,
-    const std::function<uint8_t* (uint8_t*, uint8_t*, uint8_t, uint8_t)>& fill_buffer)
+    uint8_t* output_end_iterator)
 {
-    do
+    // MSVC complains that fill_n is insecure.
+    // _SCL_SECURE_NO_WARNINGS or checked iterator required.
+    // TODO: 2014: Revisit this in a future compiler.
+    while(output_start_iterator < output_end_iterator)
     {
         uint8_t value;
         uint8_t run_count;
         start_iterator = rle_decode(start_iterator, end_iterator, &value, &run_count);
 
-        output_start_iterator = fill_buffer(output_start_iterator, output_end_iterator, value, run_count);
-    } while(output_start_iterator < output_end_iterator);
+        CHECK_EXCEPTION(output_start_iterator + run_count <= output_end_iterator, u8"Image data is invalid.");
+        std::fill_n(output_start_iterator, run_count, value);
+        output_start_iterator += run_count;
+    }
 
     assert(output_start_iterator == output_end_iterator);
 }
 
-static void pcx_decode(
+// Position in the RLE stream for decoding it in pieces.  A run may continue into the next piece.
+struct PCX_rle_state
+{
+    const uint8_t* iterator;
+    const uint8_t* end_iterator;
+    uint8_t value;
+    size_t remaining_count;
+};
+
+// Expands the next count bytes of the RLE stream into output, or skips them if output is null.
+static void pcx_decode_bytes(PCX_rle_state* state, _Out_writes_opt_(count) uint8_t* output, size_t count)
+{
+    while(count > 0)
+    {
+        if(state->remaining_count == 0)
+        {
+            // Skipped packets that end within the count are stepped over directly.
+            if(output == nullptr)
+            {
+                // Selects rather than branches on the packet type, which is unpredictable in detailed images.
+                while((count > 0) && (state->end_iterator - state->iterator >= 2))
+                {
+                    const uint8_t packet = *state->iterator;
+                    const bool is_run = packet >= rle_marker;
+                    const size_t packet_count = is_run ? packet - rle_marker : 1;
+                    if(packet_count > count)
+                    {
+                        break;
+                    }
+
+                    state->iterator += is_run ? 2 : 1;
+                    count -= packet_count;
+                }
+
+                if(count == 0)
+                {
+                    break;
+                }
+            }
+
+            uint8_t run_count;
+            state->iterator = rle_decode(state->iterator, state->end_iterator, &state->value, &run_count);
+            state->remaining_count = run_count;
+        }
+
+        const size_t run_count = std::min(state->remaining_count, count);
+        if(output != nullptr)
+        {
+            std::fill_n(output, run_count, state->value);
+            output += run_count;
+        }
+
+        state->remaining_count -= run_count;
+        count -= run_count;
+    }
+}
+
+static void convert_scanline_to_rgb(
+    _In_reads_(bytes_per_line * plane_count) const uint8_t* scanline,
+    size_t bytes_per_line,
+    unsigned int plane_count,
+    _In_reads_opt_(256) const Color_rgb* palette,
+    _Out_writes_(width) Color_rgb* pixels,
+    unsigned int width) noexcept
+{
+    if(plane_count == 3)
+    {
+        get_pixel_kernels().interleave_planes(scanline, scanline + bytes_per_line, scanline + bytes_per_line * 2, pixels, width);
+    }
+    else if(palette != nullptr)
+    {
+        for(unsigned int ix = 0; ix < width; ++ix)
+        {
+            pixels[ix] = palette[scanline[ix]];
+        }
+    }
+    else
+    {
+        // Single plane images without a palette are grayscale.
+        for(unsigned int ix = 0; ix < width; ++ix)
+        {
+            pixels[ix] = Color_rgb(scanline[ix], scanline[ix], scanline[ix]);
+        }
+    }
+}
+
+#if defined(IMAGEPROCESSING_SSE2)
+static unsigned int count_trailing_zeros(unsigned int value) noexcept
+{
+    assert(value != 0);
+
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return index;
+#else
+    return __builtin_ctz(value);
+#endif
+}
+#endif
+
+// Returns the number of bytes starting at start_iterator that have the same value, up to max_run_count.
+static unsigned int get_run_count(_In_reads_to_ptr_(end_iterator) const uint8_t* start_iterator, const uint8_t* end_iterator) noexcept
+{
+    assert(start_iterator < end_iterator);
+
+    const auto max_count = static_cast<unsigned int>(std::min<size_t>(end_iterator - start_iterator, max_run_count));
+    const uint8_t value = *start_iterator;
+    unsigned int run_count = 1;
+
+#if defined(IMAGEPROCESSING_SSE2)
+    // Compare sixteen bytes at a time.  The first mismatched byte ends the run.
+    const __m128i splat_value = _mm_set1_epi8(static_cast<char>(value));
+    while(run_count + 16 <= max_count)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(start_iterator + run_count));
+        const unsigned int mismatch_mask = ~static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, splat_value))) & 0xffff;
+        if(mismatch_mask != 0)
+        {
+            return run_count + count_trailing_zeros(mismatch_mask);
+        }
+
+        run_count += 16;
+    }
+#endif
+
+    while((run_count < max_count) && (start_iterator[run_count] == value))
+    {
+        ++run_count;
+    }
+
+    return run_count;
+}
+
+// Encodes a single plane of a scanline.  The output must have space for twice the input size.
+static uint8_t* rle_encode(
     _In_reads_to_ptr_(end_iterator) const uint8_t* start_iterator,
     const uint8_t* end_iterator,
-    _Out_writes_to_ptr_(bitmap_end_iterator) uint8_t* bitmap_start_iterator,
-    uint8_t* bitmap_end_iterator,
-    _In_reads_opt_(256) const Color_rgb* palette)
+    _Out_ uint8_t* output_iterator) noexcept
 {
-    // MSVC complains that fill_n is insecure.
-    // _SCL_SECURE_NO_WARNINGS or checked iterator required.
-    // MSVC 10 also does not implement fill_n's C++11 return value.
-    // TODO: 2014: Revisit this in a future compiler.
-    const std::function<uint8_t* (uint8_t*, uint8_t*, uint8_t, uint8_t)> fill_palette =
-        [palette](uint8_t* output_start_iterator, uint8_t* output_end_iterator, uint8_t value, uint8_t run_count) -> uint8_t*
+    while(start_iterator < end_iterator)
+    {
+        const uint8_t value = *start_iterator;
+        const unsigned int run_count = get_run_count(start_iterator, end_iterator);
+
+        // Single bytes that would be mistaken for a run marker must be encoded as a run of one.
+        if((run_count > 1) || (value >= rle_marker))
         {
-            CHECK_EXCEPTION(output_start_iterator + (run_count * sizeof(Color_rgb)) <= output_end_iterator, u8"Image data is invalid.");
-            std::fill_n(reinterpret_cast<Color_rgb*>(output_start_iterator), run_count, palette[value]);
-            return output_start_iterator + (run_count * sizeof(palette[0]));
-        };
+            *output_iterator++ = static_cast<uint8_t>(rle_marker | run_count);
+        }
+        *output_iterator++ = value;
 
-    const std::function<uint8_t* (uint8_t*, uint8_t*, uint8_t, uint8_t)> fill_no_palette =
-        [](uint8_t* output_start_iterator, uint8_t* output_end_iterator, uint8_t value, uint8_t run_count) -> uint8_t*
+        start_iterator += run_count;
+    }
+
+    return output_iterator;
+}
+
+static std::vector<uint8_t> pcx_encode(
+    unsigned int width,
+    unsigned int height,
+    uint8_t plane_count,
+    _In_reads_opt_(256) const Color_rgb* palette,
+    const std::function<void (unsigned int, uint8_t*, size_t)>& fill_scanline)
+{
+    // bytes_per_line is an even uint16_t.
+    CHECK_EXCEPTION((width > 0) && (width < 65535), u8"Image data is invalid.");
+    CHECK_EXCEPTION((height > 0) && (height <= 65536), u8"Image data is invalid.");
+
+    // Bytes per line must be even.
+    const size_t bytes_per_line = (static_cast<size_t>(width) + 1) & ~static_cast<size_t>(1);
+    const size_t scanline_size = bytes_per_line * plane_count;
+
+    // Worst case is every byte encoded as a run of one, which doubles the size.
+    const size_t max_encoded_scanline_size = scanline_size * 2;
+    const size_t palette_size = palette != nullptr ? 1 + sizeof(Color_rgb) * 256 : 0;
+
+    std::vector<uint8_t> pcx(sizeof(PCX_header) + max_encoded_scanline_size * height + palette_size);
+
+    PCX_header* header = reinterpret_cast<PCX_header*>(pcx.data());
+    header->manufacturer = PCX_manufacturer::PCX_magic;
+    header->version = PCX_version::PC_Paintbrush_3;
+    header->encoding = PCX_encoding::RLE_encoding;
+    header->bits_per_pixel = 8;
+    header->max_x = static_cast<uint16_t>(width - 1);
+    header->max_y = static_cast<uint16_t>(height - 1);
+    header->horizontal_dpi = 72;
+    header->vertical_dpi = 72;
+    header->color_plane_count = plane_count;
+    header->bytes_per_line = static_cast<uint16_t>(bytes_per_line);
+    header->palette_info = 1;
+
+    // Scanlines are independent, so encode them in parallel, each into its own worst case sized slot.
+    uint8_t* encoded_start = pcx.data() + sizeof(PCX_header);
+    std::vector<size_t> encoded_sizes(height);
+    parallel_for(height, 64, [=, &encoded_sizes, &fill_scanline](size_t row_begin, size_t row_end)
+    {
+        std::vector<uint8_t> scanline(scanline_size);
+        for(size_t row = row_begin; row < row_end; ++row)
         {
-            CHECK_EXCEPTION(output_start_iterator + run_count <= output_end_iterator, u8"Image data is invalid.");
-            std::fill_n(output_start_iterator, run_count, value);
-            return output_start_iterator + run_count;
-        };
+            fill_scanline(static_cast<unsigned int>(row), scanline.data(), bytes_per_line);
+
+            uint8_t* const slot = encoded_start + row * max_encoded_scanline_size;
+            uint8_t* output_iterator = slot;
+            for(size_t plane = 0; plane < plane_count; ++plane)
+            {
+                const uint8_t* plane_start = scanline.data() + plane * bytes_per_line;
+                output_iterator = rle_encode(plane_start, plane_start + bytes_per_line, output_iterator);
+            }
+
+            encoded_sizes[row] = output_iterator - slot;
+        }
+    });
 
-    const auto fill_buffer = palette != nullptr ? fill_palette : fill_no_palette;
-    rle_decode_fill(start_iterator, end_iterator,
-                    bitmap_start_iterator, bitmap_end_iterator,
-                    fill_buffer);
+    // Concatenate the slots.  Each destination is at or before its source, so memmove in order is safe.
+    uint8_t* output_iterator = encoded_start;
+    for(size_t row = 0; row < height; ++row)
+    {
+        std::memmove(output_iterator, encoded_start + row * max_encoded_scanline_size, encoded_sizes[row]);
+        output_iterator += encoded_sizes[row];
+    }
+
+    if(palette != nullptr)
+    {
+        // Some documentation incorrectly says this byte is C0 instead of 0C.
+        *output_iterator++ = 0x0c;
+        output_iterator = std::copy(reinterpret_cast<const uint8_t*>(palette),
+                                    reinterpret_cast<const uint8_t*>(palette + 256),
+                                    output_iterator);
+    }
+
+    // Shrinking does not reallocate.
+    pcx.resize(output_iterator - pcx.data());
+
+    // Return value optimization expected.
+    return pcx;
 }
 
 bool is_pcx_file_name(_In_z_ const char* file_name)
@@ -134,13 +353,9 @@ bool is_pcx_file_name(_In_z_ const char* file_name)
     return file_has_extension_case_sensitive(file_name, ".pcx");
 }
 
-Bitmap decode_bitmap_from_pcx_memory(_In_reads_(size) const uint8_t* pcx_memory, size_t size)
+// Returns the palette at the end of the file, or null if the image has none.
+static const Color_rgb* find_pcx_palette(_In_reads_(size) const uint8_t* pcx_memory, size_t size, _In_ const PCX_header* header)
 {
-    CHECK_EXCEPTION(size >= sizeof(PCX_header), u8"Image data is invalid.");
-
-    const PCX_header* header = reinterpret_cast<const PCX_header*>(pcx_memory);
-    validate_pcx_header(header);
-
     const Color_rgb* palette = nullptr;
     if(header->version == PCX_version::PC_Paintbrush_3 && header->color_plane_count == 1)
     {
@@ -153,18 +368,140 @@ Bitmap decode_bitmap_from_pcx_memory(_In_reads_(size) const uint8_t* pcx_memory,
         CHECK_EXCEPTION(reinterpret_cast<const uint8_t*>(palette)[-1] == 0x0c, u8"Image data is invalid.");
     }
 
+    return palette;
+}
+
+Bitmap decode_bitmap_from_pcx_memory(_In_reads_(size) const uint8_t* pcx_memory, size_t size)
+{
+    CHECK_EXCEPTION(size >= sizeof(PCX_header), u8"Image data is invalid.");
+
+    const PCX_header* header = reinterpret_cast<const PCX_header*>(pcx_memory);
+    validate_pcx_header(header);
+
+    const Color_rgb* palette = find_pcx_palette(pcx_memory, size, header);
+
     const auto image_width = static_cast<unsigned int>(header->max_x) - header->min_x + 1;
     const auto image_height = static_cast<unsigned int>(header->max_y) - header->min_y + 1;
     Bitmap bitmap{std::vector<uint8_t>(image_width * image_height * sizeof(Color_rgb)), image_width, image_height, true};
 
+    const size_t bytes_per_line = header->bytes_per_line;
+    const size_t scanline_size = bytes_per_line * header->color_plane_count;
+    std::vector<uint8_t> scanlines(scanline_size * image_height);
+
+    const uint8_t* start_iterator = pcx_memory + sizeof(PCX_header);
+    const uint8_t* end_iterator = palette != nullptr ? reinterpret_cast<const uint8_t*>(palette) - 1 : pcx_memory + size;
+
+    pcx_decode(start_iterator, end_iterator, scanlines.data(), scanlines.data() + scanlines.size());
+
+    auto pixels = reinterpret_cast<Color_rgb*>(bitmap.bitmap.data());
+    for(unsigned int iy = 0; iy < image_height; ++iy)
+    {
+        convert_scanline_to_rgb(&scanlines[iy * scanline_size], bytes_per_line, header->color_plane_count, palette,
+                                pixels + static_cast<size_t>(iy) * image_width, image_width);
+    }
+
+    // Return value optimization expected.
+    return bitmap;
+}
+
+// Scanlines that are not sampled are skipped a run at a time, without being expanded.  Only the sampled
+// columns of each sampled scanline are converted.
+Bitmap decode_preview_from_pcx_memory(_In_reads_(size) const uint8_t* pcx_memory, size_t size, unsigned int preview_size)
+{
+    CHECK_EXCEPTION(size >= sizeof(PCX_header), u8"Image data is invalid.");
+
+    const PCX_header* header = reinterpret_cast<const PCX_header*>(pcx_memory);
+    validate_pcx_header(header);
+
+    const auto image_width = static_cast<unsigned int>(header->max_x) - header->min_x + 1;
+    const auto image_height = static_cast<unsigned int>(header->max_y) - header->min_y + 1;
+    const unsigned int reduction = get_preview_reduction(image_width, image_height, preview_size);
+    if(reduction == 1)
+    {
+        return decode_bitmap_from_pcx_memory(pcx_memory, size);
+    }
+
+    const Color_rgb* palette = find_pcx_palette(pcx_memory, size, header);
+
+    const unsigned int preview_width = get_reduced_size(image_width, reduction);
+    const unsigned int preview_height = get_reduced_size(image_height, reduction);
+    Bitmap bitmap{std::vector<uint8_t>(static_cast<size_t>(preview_width) * preview_height * sizeof(Color_rgb)), preview_width, preview_height, true};
+
+    const unsigned int plane_count = header->color_plane_count;
+    const size_t bytes_per_line = header->bytes_per_line;
+    const size_t scanline_size = bytes_per_line * plane_count;
+    std::vector<uint8_t> scanline(scanline_size);
+    std::vector<uint8_t> sampled_scanline(static_cast<size_t>(preview_width) * plane_count);
+
     const uint8_t* start_iterator = pcx_memory + sizeof(PCX_header);
-    const uint8_t* end_iterator = palette != nullptr ? reinterpret_cast<const uint8_t*>(palette) - 1 : start_iterator + size;
+    const uint8_t* end_iterator = palette != nullptr ? reinterpret_cast<const uint8_t*>(palette) - 1 : pcx_memory + size;
+    PCX_rle_state rle_state{start_iterator, end_iterator, 0, 0};
+
+    auto pixels = reinterpret_cast<Color_rgb*>(bitmap.bitmap.data());
+    for(unsigned int iy = 0; iy < preview_height; ++iy)
+    {
+        const size_t skipped_count = (iy > 0) ? reduction - 1 : 0;
+        pcx_decode_bytes(&rle_state, nullptr, skipped_count * scanline_size);
+        pcx_decode_bytes(&rle_state, scanline.data(), scanline_size);
 
-    pcx_decode(start_iterator, end_iterator, bitmap.bitmap.data(), bitmap.bitmap.data() + bitmap.bitmap.size(), palette);
+        for(unsigned int plane = 0; plane < plane_count; ++plane)
+        {
+            for(unsigned int ix = 0; ix < preview_width; ++ix)
+            {
+                sampled_scanline[plane * preview_width + ix] = scanline[plane * bytes_per_line + ix * reduction];
+            }
+        }
+
+        convert_scanline_to_rgb(sampled_scanline.data(), preview_width, plane_count, palette, pixels + static_cast<size_t>(iy) * preview_width, preview_width);
+    }
 
     // Return value optimization expected.
     return bitmap;
 }
 
+std::vector<uint8_t> encode_pcx_from_bitmap(const Bitmap& bitmap)
+{
+    CHECK_EXCEPTION(bitmap.bitmap.size() == static_cast<size_t>(bitmap.width) * bitmap.height * sizeof(Color_rgb), u8"Image data is invalid.");
+
+    // Twenty-four bit images are stored as three planes per scanline: red, green, then blue.
+    const auto pixels = reinterpret_cast<const Color_rgb*>(bitmap.bitmap.data());
+    const unsigned int width = bitmap.width;
+    return pcx_encode(bitmap.width, bitmap.height, 3, nullptr, [pixels, width](unsigned int row, uint8_t* scanline, size_t bytes_per_line)
+    {
+        const Color_rgb* row_pixels = pixels + static_cast<size_t>(row) * width;
+        for(unsigned int ix = 0; ix < width; ++ix)
+        {
+            scanline[ix] = row_pixels[ix].red;
+            scanline[bytes_per_line + ix] = row_pixels[ix].green;
+            scanline[bytes_per_line * 2 + ix] = row_pixels[ix].blue;
+        }
+
+        // Zero the padding byte that keeps bytes_per_line even.
+        for(size_t plane = 0; plane < 3; ++plane)
+        {
+            std::fill(scanline + plane * bytes_per_line + width, scanline + (plane + 1) * bytes_per_line, static_cast<uint8_t>(0));
+        }
+    });
+}
+
+std::vector<uint8_t> encode_pcx_from_paletted_bitmap(const Paletted_bitmap& bitmap)
+{
+    CHECK_EXCEPTION(bitmap.indices.size() == static_cast<size_t>(bitmap.width) * bitmap.height, u8"Image data is invalid.");
+    CHECK_EXCEPTION(bitmap.palette.size() <= 256, u8"Image data is invalid.");
+
+    // The PCX palette always has 256 entries.
+    std::vector<Color_rgb> palette(256, Color_rgb(0, 0, 0));
+    std::copy(bitmap.palette.cbegin(), bitmap.palette.cend(), palette.begin());
+
+    const uint8_t* indices = bitmap.indices.data();
+    const unsigned int width = bitmap.width;
+    return pcx_encode(bitmap.width, bitmap.height, 1, palette.data(), [indices, width](unsigned int row, uint8_t* scanline, size_t bytes_per_line)
+    {
+        const uint8_t* row_indices = indices + static_cast<size_t>(row) * width;
+        std::copy(row_indices, row_indices + width, scanline);
+        std::fill(scanline + width, scanline + bytes_per_line, static_cast<uint8_t>(0));
+    });
+}
+
 }
 
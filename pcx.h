@@ -6,5 +6,10 @@ namespace ImageProcessing
 bool is_pcx_file_name(_In_z_ const char* file_name);
 struct Bitmap decode_bitmap_from_pcx_memory(_In_reads_(size) const uint8_t* pcx_memory, size_t size);
 
+// Decodes the image at a reduced size, see get_preview_reduction.
+struct Bitmap decode_preview_from_pcx_memory(_In_reads_(size) const uint8_t* pcx_memory, size_t size, unsigned int preview_size);
+std::vector<uint8_t> encode_pcx_from_bitmap(const struct Bitmap& bitmap);
+std::vector<uint8_t> encode_pcx_from_paletted_bitmap(const struct Paletted_bitmap& bitmap);
+
 }
 
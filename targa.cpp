@@ -1,9 +1,11 @@
 #include "PreCompile.h"
 #include "targa.h"              // Pick up forward declarations to ensure correctness.
 #include "Bitmap.h"
+#include "CpuDispatch.h"
 #include "FileExtensionTest.h"
+#include "PixelKernels.h"
+#include "TiledBitmap.h"
 #include <PortableRuntime/CheckException.h>
-#include <PortableRuntime/Tracing.h>
 
 // Targa spec:
 // http://www.dca.fee.unicamp.br/~martino/disciplinas/ea978/tgaffs.pdf
@@ -130,19 +132,28 @@ static unsigned int top_to_bottom_bit()
     return 0x20;
 }
 
-static void validate_tga_header(_In_ const TGA_header* header)
+static unsigned int get_alpha_depth(uint8_t image_descriptor)
+{
+    return image_descriptor & 0x0f;
+}
+
+static void validate_tga_header(_In_ const TGA_header* header, unsigned int maximum_dimension)
 {
     bool succeeded = true;
 
-    succeeded &= (header->image_type == TGA_image_type::True_color);
-    succeeded &= (header->bits_per_pixel == 24);
+    succeeded &= ((header->image_type == TGA_image_type::True_color) || (header->image_type == TGA_image_type::RLE_true_color));
+    succeeded &= ((header->bits_per_pixel == 24) || (header->bits_per_pixel == 32));
     succeeded &= (header->color_map_length == 0);
     succeeded &= (header->color_map_bits_per_pixel == 0);
-    succeeded &= (is_left_to_right(header->image_descriptor));
+
+    // Twenty-four bit images have no alpha.  Thirty-two bit images have eight bits of alpha,
+    // though some writers leave the alpha depth as zero.
+    const unsigned int alpha_depth = get_alpha_depth(header->image_descriptor);
+    succeeded &= (header->bits_per_pixel == 24) ? (alpha_depth == 0) : ((alpha_depth == 0) || (alpha_depth == 8));
 
     // Bound the size as this is used in buffer size calculations.
-    succeeded &= (header->image_width <= max_dimension);
-    succeeded &= (header->image_height <= max_dimension);
+    succeeded &= (header->image_width <= maximum_dimension);
+    succeeded &= (header->image_height <= maximum_dimension);
 
     // id_length (uint8_t) is unbounded.
 
@@ -156,49 +167,680 @@ static size_t get_pixel_data_offset(_In_ const TGA_header* header)
            static_cast<size_t>(header->color_map_length) * (header->color_map_bits_per_pixel / 8);
 }
 
+static const char tga_signature[] = u8"TRUEVISION-XFILE.";
+
+// Returns true if a file of the given size has a version 2.0 footer that points to an extension area.
+static bool has_tga_extension_area(_In_ const TGA_footer* footer, size_t size) noexcept
+{
+    // Check the size first, so that the subtraction below cannot wrap for small files.
+    return (size >= sizeof(TGA_header) + sizeof(TGA_extension_area) + sizeof(TGA_footer)) &&
+           std::equal(tga_signature, tga_signature + sizeof(tga_signature), footer->signature) &&
+           (footer->extension_area_offset >= sizeof(TGA_header)) &&
+           (footer->extension_area_offset + sizeof(TGA_extension_area) <= size - sizeof(TGA_footer));
+}
+
+// Returns the extension area if the file has a version 2.0 footer that points to one.
+static const TGA_extension_area* find_tga_extension_area(_In_reads_(size) const uint8_t* tga_memory, size_t size)
+{
+    if((size < sizeof(TGA_footer)) || !has_tga_extension_area(reinterpret_cast<const TGA_footer*>(tga_memory + size - sizeof(TGA_footer)), size))
+    {
+        return nullptr;
+    }
+
+    const TGA_footer* footer = reinterpret_cast<const TGA_footer*>(tga_memory + size - sizeof(TGA_footer));
+    const TGA_extension_area* extension_area = reinterpret_cast<const TGA_extension_area*>(tga_memory + footer->extension_area_offset);
+    return extension_area->extension_size >= sizeof(TGA_extension_area) ? extension_area : nullptr;
+}
+
+// extension_area is null if the file has none.
+static TGA_alpha_type get_alpha_type(_In_ const TGA_header* header, _In_opt_ const TGA_extension_area* extension_area)
+{
+    if(header->bits_per_pixel != 32)
+    {
+        return TGA_alpha_type::No_alpha;
+    }
+
+    // Without an extension area, the alpha depth in the header is all that is known.
+    if(extension_area == nullptr)
+    {
+        return get_alpha_depth(header->image_descriptor) == 8 ? TGA_alpha_type::Alpha_exists : TGA_alpha_type::Ignorable_alpha;
+    }
+
+    return extension_area->attributes_type;
+}
+
+enum class Alpha_conversion
+{
+    Copy,           // Alpha is copied as is.
+    Premultiply,    // Color channels are multiplied by alpha.
+    Opaque,         // Alpha is undefined, so it is replaced by full opacity.
+};
+
+// Computes round(color * alpha / 255) exactly, without a division.
+static uint8_t multiply_by_alpha(uint8_t color, uint8_t alpha) noexcept
+{
+    const unsigned int product = color * alpha + 128;
+    return static_cast<uint8_t>((product + (product >> 8)) >> 8);
+}
+
+// Targa stores pixels as BGRA.  Right to left rows are written in reverse, so target[ix] is source pixel width - ix - 1.
+static void convert_bgra_row(_In_reads_(width * 4) const uint8_t* source, _Out_writes_(width) Color_rgba* target, size_t width, Alpha_conversion conversion,
+                             bool right_to_left) noexcept
+{
+    size_t ix = 0;
+
+#if defined(IMAGEPROCESSING_SSE2)
+    // Four pixels at a time.  Red and blue are swapped with shifts, as SSE2 has no byte shuffle.
+    const __m128i green_alpha_mask = _mm_set1_epi32(static_cast<int>(0xff00ff00));
+    const __m128i low_byte_mask = _mm_set1_epi32(0x000000ff);
+    const __m128i opaque_alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+    const __m128i alpha_lane_mask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    const __m128i rounding = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+    for(; ix + 4 <= width; ix += 4)
+    {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + ix * 4));
+        pixels = _mm_or_si128(_mm_and_si128(pixels, green_alpha_mask),
+                              _mm_or_si128(_mm_and_si128(_mm_srli_epi32(pixels, 16), low_byte_mask),
+                                           _mm_slli_epi32(_mm_and_si128(pixels, low_byte_mask), 16)));
+
+        if(conversion == Alpha_conversion::Premultiply)
+        {
+            const auto premultiply = [alpha_lane_mask, rounding](__m128i channels) -> __m128i
+            {
+                // Broadcast each pixel's alpha to its four lanes.
+                __m128i alpha = _mm_shufflelo_epi16(channels, _MM_SHUFFLE(3, 3, 3, 3));
+                alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+
+                __m128i product = _mm_add_epi16(_mm_mullo_epi16(channels, alpha), rounding);
+                product = _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+
+                // Keep the original alpha.
+                return _mm_or_si128(_mm_and_si128(alpha_lane_mask, channels), _mm_andnot_si128(alpha_lane_mask, product));
+            };
+
+            pixels = _mm_packus_epi16(premultiply(_mm_unpacklo_epi8(pixels, zero)), premultiply(_mm_unpackhi_epi8(pixels, zero)));
+        }
+        else if(conversion == Alpha_conversion::Opaque)
+        {
+            pixels = _mm_or_si128(pixels, opaque_alpha);
+        }
+
+        if(right_to_left)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + width - ix - 4), _mm_shuffle_epi32(pixels, _MM_SHUFFLE(0, 1, 2, 3)));
+        }
+        else
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + ix), pixels);
+        }
+    }
+#endif
+
+    for(; ix < width; ++ix)
+    {
+        const uint8_t* pixel = source + ix * 4;
+        const uint8_t alpha = pixel[3];
+        Color_rgba& target_pixel = target[right_to_left ? width - ix - 1 : ix];
+        if(conversion == Alpha_conversion::Premultiply)
+        {
+            target_pixel = Color_rgba(multiply_by_alpha(pixel[2], alpha), multiply_by_alpha(pixel[1], alpha), multiply_by_alpha(pixel[0], alpha), alpha);
+        }
+        else
+        {
+            target_pixel = Color_rgba(pixel[2], pixel[1], pixel[0], conversion == Alpha_conversion::Opaque ? 0xff : alpha);
+        }
+    }
+}
+
+// RLE packets may span scanlines, so the state of the current packet is kept between rows.
+// The run pixel is copied, so the encoded data may be streamed through a buffer between rows.
+struct TGA_rle_state
+{
+    const uint8_t* iterator;
+    const uint8_t* end_iterator;
+    uint8_t run_pixel[4];
+    bool is_run;
+    size_t remaining_count;
+};
+
+// row may be null to skip a row without copying it.
+static void tga_rle_decode_row(TGA_rle_state* state, size_t pixel_size, _Out_writes_opt_(width * pixel_size) uint8_t* row, size_t width)
+{
+    size_t ix = 0;
+    while(ix < width)
+    {
+        if(state->remaining_count == 0)
+        {
+            // The high bit of the packet header indicates a run.  The low seven bits are the count minus one.
+            CHECK_EXCEPTION(state->iterator < state->end_iterator, u8"Image data is invalid.");
+            const uint8_t packet_header = *state->iterator++;
+            state->remaining_count = (packet_header & 0x7f) + 1;
+            state->is_run = (packet_header & 0x80) != 0;
+
+            if(state->is_run)
+            {
+                CHECK_EXCEPTION(static_cast<size_t>(state->end_iterator - state->iterator) >= pixel_size, u8"Image data is invalid.");
+                std::copy(state->iterator, state->iterator + pixel_size, state->run_pixel);
+                state->iterator += pixel_size;
+            }
+        }
+
+        const size_t count = std::min(state->remaining_count, width - ix);
+        if(state->is_run)
+        {
+            for(size_t run_ix = 0; (row != nullptr) && (run_ix < count); ++run_ix)
+            {
+                std::copy(state->run_pixel, state->run_pixel + pixel_size, row + (ix + run_ix) * pixel_size);
+            }
+        }
+        else
+        {
+            CHECK_EXCEPTION(static_cast<size_t>(state->end_iterator - state->iterator) >= count * pixel_size, u8"Image data is invalid.");
+            if(row != nullptr)
+            {
+                std::copy(state->iterator, state->iterator + count * pixel_size, row + ix * pixel_size);
+            }
+            state->iterator += count * pixel_size;
+        }
+
+        ix += count;
+        state->remaining_count -= count;
+    }
+}
+
 bool is_tga_file_name(_In_z_ const char* file_name)
 {
     return file_has_extension_case_sensitive(file_name, ".tga");
 }
 
 Bitmap decode_bitmap_from_tga_memory(_In_reads_(size) const uint8_t* tga_memory, size_t size)
+{
+    return decode_bitmap_from_tga_memory(tga_memory, size, false);
+}
+
+// Alpha already multiplied by the content creation tool must not be multiplied again.
+static Pixel_format get_decoded_format(_In_ const TGA_header* header, TGA_alpha_type alpha_type, bool premultiply_alpha, _Out_ Alpha_conversion* conversion) noexcept
+{
+    Pixel_format format = Pixel_format::Rgb;
+    *conversion = Alpha_conversion::Copy;
+    switch(alpha_type)
+    {
+        case TGA_alpha_type::No_alpha:
+            if(header->bits_per_pixel == 32)
+            {
+                format = Pixel_format::Rgba;
+                *conversion = Alpha_conversion::Opaque;
+            }
+            break;
+
+        case TGA_alpha_type::Ignorable_alpha:
+            format = Pixel_format::Rgba;
+            *conversion = Alpha_conversion::Opaque;
+            break;
+
+        case TGA_alpha_type::Premultiplied_alpha:
+            format = Pixel_format::Rgba_premultiplied;
+            break;
+
+        // Retained alpha is not coverage, so color is never multiplied by it.  It is kept exactly as stored.
+        case TGA_alpha_type::Retained_alpha:
+            format = Pixel_format::Rgba;
+            break;
+
+        default:
+            format = premultiply_alpha ? Pixel_format::Rgba_premultiplied : Pixel_format::Rgba;
+            *conversion = premultiply_alpha ? Alpha_conversion::Premultiply : Alpha_conversion::Copy;
+            break;
+    }
+
+    return format;
+}
+
+// Converts one row of file pixels into target.  Right to left rows are reversed as they are converted.
+static void convert_tga_row(_In_ const TGA_header* header, _In_ const uint8_t* source_row, Pixel_format format, Alpha_conversion conversion, _Out_ uint8_t* target)
+{
+    const bool right_to_left = !is_left_to_right(header->image_descriptor);
+    if(format == Pixel_format::Rgb)
+    {
+        // Targa stores pixels as BGR.
+        const auto& kernels = get_pixel_kernels();
+        const auto convert = right_to_left ? kernels.convert_bgr_reversed : kernels.convert_bgr;
+        convert(source_row, reinterpret_cast<Color_rgb*>(target), header->image_width);
+    }
+    else
+    {
+        convert_bgra_row(source_row, reinterpret_cast<Color_rgba*>(target), header->image_width, conversion, right_to_left);
+    }
+}
+
+// Converts the rows of an image of the size in header, where get_row(iy) returns the file pixels of the
+// row stored iy-th in the file.  Bottom to top images are flipped as each row is copied, so there is no second pass.
+template<typename Get_row>
+static Bitmap convert_tga_rows(_In_ const TGA_header* header, Pixel_format format, Alpha_conversion conversion, const Get_row& get_row)
+{
+    const size_t pixel_size = get_bytes_per_pixel(format);
+    const size_t pixel_count = static_cast<size_t>(header->image_width) * header->image_height;
+    Bitmap bitmap{std::vector<uint8_t>(pixel_count * pixel_size), header->image_width, header->image_height, true, format};
+
+    for(size_t iy = 0; iy < header->image_height; ++iy)
+    {
+        const size_t target_row = is_top_to_bottom(header->image_descriptor) ? iy : header->image_height - iy - 1;
+        convert_tga_row(header, get_row(iy), format, conversion, bitmap.bitmap.data() + target_row * header->image_width * pixel_size);
+    }
+
+    // Return value optimization expected.
+    return bitmap;
+}
+
+Bitmap decode_bitmap_from_tga_memory(_In_reads_(size) const uint8_t* tga_memory, size_t size, bool premultiply_alpha)
 {
     CHECK_EXCEPTION(size >= sizeof(TGA_header), u8"Image data is invalid.");
 
     const TGA_header* header = reinterpret_cast<const TGA_header*>(tga_memory);
-    validate_tga_header(header);
+    validate_tga_header(header, max_dimension);
 
-    // TODO: 2016: Validate no integer overflows from untrusted data.
     const size_t pixel_data_offset = get_pixel_data_offset(header);
-    const auto pixel_size = sizeof(Color_rgb);
+    CHECK_EXCEPTION(pixel_data_offset <= size, u8"Image data is invalid.");
+
+    const size_t file_pixel_size = header->bits_per_pixel / 8;
     const auto pixel_start = reinterpret_cast<const uint8_t*>(tga_memory + pixel_data_offset);
+    const auto pixel_end = tga_memory + size;
     const size_t pixel_count = static_cast<size_t>(header->image_width) * header->image_height;
+    const size_t row_size = static_cast<size_t>(header->image_width) * file_pixel_size;
+    const bool is_rle = header->image_type == TGA_image_type::RLE_true_color;
+
+    // Dimensions are bounded by max_dimension, so this cannot overflow.
+    CHECK_EXCEPTION(is_rle || (pixel_count * file_pixel_size <= static_cast<size_t>(pixel_end - pixel_start)), u8"Image data is invalid.");
+
+    Alpha_conversion conversion;
+    const Pixel_format format = get_decoded_format(header, get_alpha_type(header, find_tga_extension_area(tga_memory, size)), premultiply_alpha, &conversion);
+
+    // RLE rows are expanded into a single row buffer that stays in cache for the conversion.
+    std::vector<uint8_t> rle_row(is_rle ? row_size : 0);
+    TGA_rle_state rle_state{pixel_start, pixel_end, {}, false, 0};
+    return convert_tga_rows(header, format, conversion, [&](size_t iy)
+    {
+        if(!is_rle)
+        {
+            return pixel_start + iy * row_size;
+        }
+
+        tga_rle_decode_row(&rle_state, file_pixel_size, rle_row.data(), header->image_width);
+        return static_cast<const uint8_t*>(rle_row.data());
+    });
+}
+
+Bitmap decode_preview_from_tga_memory(_In_reads_(size) const uint8_t* tga_memory, size_t size, unsigned int preview_size)
+{
+    return decode_preview_from_tga_memory(tga_memory, size, preview_size, false);
+}
+
+// The postage stamp image follows a byte each of width and height, and is stored in the pixel format and
+// orientation of the image, without compression.  Otherwise only the rows and columns sampled by the reduced
+// image are converted.  RLE rows that are not sampled are skipped without being expanded.
+Bitmap decode_preview_from_tga_memory(_In_reads_(size) const uint8_t* tga_memory, size_t size, unsigned int preview_size, bool premultiply_alpha)
+{
+    CHECK_EXCEPTION(size >= sizeof(TGA_header), u8"Image data is invalid.");
+
+    const TGA_header* header = reinterpret_cast<const TGA_header*>(tga_memory);
+    validate_tga_header(header, max_dimension);
 
-    CHECK_EXCEPTION((pixel_start + (pixel_count * pixel_size) >= pixel_start) && (tga_memory + size >= tga_memory), u8"Image data is invalid.");
-    CHECK_EXCEPTION(reinterpret_cast<const uint8_t*>(pixel_start + (pixel_count * pixel_size)) <= (tga_memory + size), u8"Image data is invalid.");
+    const size_t pixel_data_offset = get_pixel_data_offset(header);
+    CHECK_EXCEPTION(pixel_data_offset <= size, u8"Image data is invalid.");
 
-    // MSVC complains that std::copy is insecure.
-    // _SCL_SECURE_NO_WARNINGS or checked iterator required. TODO: 2016: Consider using _SCL_SECURE_NO_WARNINGS only in release.
-    Bitmap bitmap{std::vector<uint8_t>(pixel_count * pixel_size), header->image_width, header->image_height, true};
-    if(is_top_to_bottom(header->image_descriptor))
+    const TGA_extension_area* extension_area = find_tga_extension_area(tga_memory, size);
+    Alpha_conversion conversion;
+    const Pixel_format format = get_decoded_format(header, get_alpha_type(header, extension_area), premultiply_alpha, &conversion);
+    const size_t file_pixel_size = header->bits_per_pixel / 8;
+
+    if((extension_area != nullptr) && (extension_area->thumbnail_image_offset != 0))
     {
-        std::copy(pixel_start, pixel_start + (pixel_count * pixel_size), bitmap.bitmap.data());
+        const size_t stamp_offset = extension_area->thumbnail_image_offset;
+        CHECK_EXCEPTION((stamp_offset >= sizeof(TGA_header)) && (stamp_offset <= size - 2), u8"Image data is invalid.");
+
+        TGA_header stamp_header = *header;
+        stamp_header.image_width = tga_memory[stamp_offset];
+        stamp_header.image_height = tga_memory[stamp_offset + 1];
+
+        const size_t stamp_row_size = stamp_header.image_width * file_pixel_size;
+        const uint8_t* stamp_start = tga_memory + stamp_offset + 2;
+        CHECK_EXCEPTION(stamp_row_size * stamp_header.image_height <= size - stamp_offset - 2, u8"Image data is invalid.");
+
+        if((stamp_header.image_width > 0) && (stamp_header.image_height > 0))
+        {
+            return convert_tga_rows(&stamp_header, format, conversion, [stamp_start, stamp_row_size](size_t iy)
+            {
+                return stamp_start + iy * stamp_row_size;
+            });
+        }
     }
-    else
+
+    const unsigned int width = header->image_width;
+    const unsigned int height = header->image_height;
+    const unsigned int reduction = get_preview_reduction(width, height, preview_size);
+    if(reduction == 1)
+    {
+        return decode_bitmap_from_tga_memory(tga_memory, size, premultiply_alpha);
+    }
+
+    const auto pixel_start = tga_memory + pixel_data_offset;
+    const auto pixel_end = tga_memory + size;
+    const size_t row_size = width * file_pixel_size;
+    const bool is_rle = header->image_type == TGA_image_type::RLE_true_color;
+    CHECK_EXCEPTION(is_rle || (static_cast<size_t>(height) * row_size <= static_cast<size_t>(pixel_end - pixel_start)), u8"Image data is invalid.");
+
+    TGA_header preview_header = *header;
+    preview_header.image_width = static_cast<uint16_t>(get_reduced_size(width, reduction));
+    preview_header.image_height = static_cast<uint16_t>(get_reduced_size(height, reduction));
+
+    // The reduced image samples rows and columns at multiples of the reduction from its top left corner,
+    // which are found from the other end of the file for bottom to top and right to left images.
+    const unsigned int preview_width = preview_header.image_width;
+    const unsigned int preview_height = preview_header.image_height;
+    const bool bottom_to_top = !is_top_to_bottom(header->image_descriptor);
+    const bool right_to_left = !is_left_to_right(header->image_descriptor);
+
+    std::vector<uint8_t> rle_row(is_rle ? row_size : 0);
+    std::vector<uint8_t> sampled_row(preview_width * file_pixel_size);
+    TGA_rle_state rle_state{pixel_start, pixel_end, {}, false, 0};
+    size_t rle_row_index = 0;
+    return convert_tga_rows(&preview_header, format, conversion, [&](size_t iy)
     {
-        // If this code path is hit, it means that the image should be exported from the content creation tool
-        // from top to bottom.
-        // TODO: 2016: To encourage this, make such a tool available from the ImageProcessing library.
-        PortableRuntime::dprintf("^Copying Targa image bottom to top. Use content that is encoded from top to bottom for best performance.");
+        const size_t file_row_index = bottom_to_top ? height - 1 - (preview_height - 1 - iy) * reduction : iy * reduction;
 
-        const auto row_length = pixel_count / header->image_height;
-        for(decltype(header->image_height) iy = 0; iy < header->image_height; ++iy)
+        const uint8_t* file_row = pixel_start + file_row_index * row_size;
+        if(is_rle)
         {
-            const auto row_offset = row_length * iy;
-            std::copy(pixel_start + (row_offset * pixel_size),
-                      pixel_start + ((row_offset + row_length) * pixel_size),
-                      &bitmap.bitmap[(pixel_count - row_offset - row_length) * pixel_size]);
+            for(; rle_row_index < file_row_index; ++rle_row_index)
+            {
+                tga_rle_decode_row(&rle_state, file_pixel_size, nullptr, width);
+            }
+
+            tga_rle_decode_row(&rle_state, file_pixel_size, rle_row.data(), width);
+            ++rle_row_index;
+            file_row = rle_row.data();
         }
+
+        for(unsigned int ix = 0; ix < preview_width; ++ix)
+        {
+            const size_t file_column = right_to_left ? width - 1 - (preview_width - 1 - ix) * reduction : ix * reduction;
+            std::copy(file_row + file_column * file_pixel_size, file_row + (file_column + 1) * file_pixel_size, &sampled_row[ix * file_pixel_size]);
+        }
+
+        return static_cast<const uint8_t*>(sampled_row.data());
+    });
+}
+
+Bitmap decode_region_from_tga_memory(_In_reads_(size) const uint8_t* tga_memory, size_t size,
+                                     unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+{
+    return decode_region_from_tga_memory(tga_memory, size, x, y, width, height, false, nullptr);
+}
+
+static void build_tga_scanline_index(_In_ const TGA_header* header, _In_reads_(size) const uint8_t* tga_memory, size_t size, _Out_ TGA_scanline_index* index)
+{
+    index->file_size = 0;
+    index->starts.clear();
+    index->starts.reserve(header->image_height);
+
+    const size_t file_pixel_size = header->bits_per_pixel / 8;
+    TGA_rle_state rle_state{tga_memory + get_pixel_data_offset(header), tga_memory + size, {}, false, 0};
+    for(size_t iy = 0; iy < header->image_height; ++iy)
+    {
+        TGA_scanline_start start{static_cast<size_t>(rle_state.iterator - tga_memory), {}, static_cast<uint8_t>(rle_state.remaining_count), rle_state.is_run};
+        std::copy(rle_state.run_pixel, rle_state.run_pixel + sizeof(rle_state.run_pixel), start.run_pixel);
+        index->starts.push_back(start);
+
+        tga_rle_decode_row(&rle_state, file_pixel_size, nullptr, header->image_width);
+    }
+
+    // Only a complete index is marked as matching the file.
+    std::copy(tga_memory, tga_memory + sizeof(index->header), index->header);
+    const size_t footer_size = std::min(size, sizeof(index->footer));
+    std::fill(std::copy(tga_memory + size - footer_size, tga_memory + size, index->footer), index->footer + sizeof(index->footer), uint8_t(0));
+    index->file_size = size;
+}
+
+static void restore_tga_rle_state(_In_ const uint8_t* tga_memory, const TGA_scanline_start& start, _Inout_ TGA_rle_state* rle_state) noexcept
+{
+    rle_state->iterator = tga_memory + start.offset;
+    std::copy(start.run_pixel, start.run_pixel + sizeof(start.run_pixel), rle_state->run_pixel);
+    rle_state->remaining_count = start.remaining_count;
+    rle_state->is_run = start.is_run;
+}
+
+// Returns true if index was built for this file, as far as can be told without reading the whole file.  The file
+// size, header and footer must be unchanged, and decoding the stored row, or the one before it for the last row,
+// must end exactly at the state stored for the next row.
+static bool tga_scanline_index_matches(_In_ const TGA_header* header, _In_reads_(size) const uint8_t* tga_memory, size_t size,
+                                       const TGA_scanline_index& index, size_t file_row)
+{
+    static_assert(sizeof(TGA_header) == sizeof(TGA_scanline_index::header), "The index must hold a whole header.");
+    static_assert(sizeof(TGA_footer) == sizeof(TGA_scanline_index::footer), "The index must hold a whole footer.");
+
+    const size_t footer_size = std::min(size, sizeof(index.footer));
+    if((index.file_size != size) || (index.starts.size() != header->image_height) ||
+       !std::equal(index.header, index.header + sizeof(index.header), tga_memory) ||
+       !std::equal(index.footer, index.footer + footer_size, tga_memory + size - footer_size))
+    {
+        return false;
+    }
+
+    // The first row starts with the first packet, and a single row has no other row to check against.
+    const size_t pixel_data_offset = get_pixel_data_offset(header);
+    if(header->image_height == 1)
+    {
+        return (index.starts[0].offset == pixel_data_offset) && (index.starts[0].remaining_count == 0);
+    }
+
+    const size_t checked_row = std::min<size_t>(file_row, header->image_height - 2u);
+    for(const size_t row : {file_row, checked_row, checked_row + 1})
+    {
+        if((index.starts[row].offset < pixel_data_offset) || (index.starts[row].offset > size))
+        {
+            return false;
+        }
+    }
+
+    TGA_rle_state rle_state{nullptr, tga_memory + size, {}, false, 0};
+    restore_tga_rle_state(tga_memory, index.starts[checked_row], &rle_state);
+    try
+    {
+        tga_rle_decode_row(&rle_state, header->bits_per_pixel / 8, nullptr, header->image_width);
+    }
+    catch(...)
+    {
+        // The stored start is not a packet boundary of this file.
+        return false;
+    }
+
+    const TGA_scanline_start& next = index.starts[checked_row + 1];
+    return (static_cast<size_t>(rle_state.iterator - tga_memory) == next.offset) && (rle_state.remaining_count == next.remaining_count) &&
+           (rle_state.is_run == next.is_run) && (!next.is_run || std::equal(next.run_pixel, next.run_pixel + sizeof(next.run_pixel), rle_state.run_pixel));
+}
+
+// Uncompressed rows are found by their offsets.  The first RLE row of the region is found from the index, then
+// from the scanline table of the extension area, and only then by skipping the rows above it.  Within each row,
+// the pixels outside the region are skipped without being expanded.
+Bitmap decode_region_from_tga_memory(_In_reads_(size) const uint8_t* tga_memory, size_t size,
+                                     unsigned int x, unsigned int y, unsigned int width, unsigned int height,
+                                     bool premultiply_alpha, _Inout_opt_ TGA_scanline_index* index)
+{
+    CHECK_EXCEPTION(size >= sizeof(TGA_header), u8"Image data is invalid.");
+
+    const TGA_header* header = reinterpret_cast<const TGA_header*>(tga_memory);
+    validate_tga_header(header, max_dimension);
+
+    const size_t pixel_data_offset = get_pixel_data_offset(header);
+    CHECK_EXCEPTION(pixel_data_offset <= size, u8"Image data is invalid.");
+
+    const unsigned int image_width = header->image_width;
+    const unsigned int image_height = header->image_height;
+    CHECK_EXCEPTION((static_cast<uint64_t>(x) + width <= image_width) && (static_cast<uint64_t>(y) + height <= image_height), u8"Region is outside the image.");
+
+    const TGA_extension_area* extension_area = find_tga_extension_area(tga_memory, size);
+    Alpha_conversion conversion;
+    const Pixel_format format = get_decoded_format(header, get_alpha_type(header, extension_area), premultiply_alpha, &conversion);
+
+    const size_t file_pixel_size = header->bits_per_pixel / 8;
+    const auto pixel_start = tga_memory + pixel_data_offset;
+    const auto pixel_end = tga_memory + size;
+    const size_t row_size = image_width * file_pixel_size;
+    const bool is_rle = header->image_type == TGA_image_type::RLE_true_color;
+    CHECK_EXCEPTION(is_rle || (static_cast<size_t>(image_height) * row_size <= static_cast<size_t>(pixel_end - pixel_start)), u8"Image data is invalid.");
+
+    TGA_header region_header = *header;
+    region_header.image_width = static_cast<uint16_t>(width);
+    region_header.image_height = static_cast<uint16_t>(height);
+
+    // The region is found from the other end of the file for bottom to top and right to left images.
+    const size_t first_file_row = is_top_to_bottom(header->image_descriptor) ? y : image_height - y - height;
+    const size_t file_column = is_left_to_right(header->image_descriptor) ? x : image_width - x - width;
+
+    if(!is_rle)
+    {
+        return convert_tga_rows(&region_header, format, conversion, [=](size_t iy)
+        {
+            return pixel_start + (first_file_row + iy) * row_size + file_column * file_pixel_size;
+        });
+    }
+
+    TGA_rle_state rle_state{pixel_start, pixel_end, {}, false, 0};
+    if(height > 0)
+    {
+        if(index != nullptr)
+        {
+            if(!tga_scanline_index_matches(header, tga_memory, size, *index, first_file_row))
+            {
+                build_tga_scanline_index(header, tga_memory, size, index);
+            }
+
+            restore_tga_rle_state(tga_memory, index->starts[first_file_row], &rle_state);
+        }
+        else if((extension_area != nullptr) && (extension_area->scanline_table_offset != 0))
+        {
+            // The table holds the offset of each row in the order rows are stored.  Version 2.0 packets
+            // do not span rows, so each row starts with a packet header.
+            const size_t table_offset = extension_area->scanline_table_offset;
+            CHECK_EXCEPTION((table_offset >= sizeof(TGA_header)) && (table_offset <= size) &&
+                            (static_cast<size_t>(image_height) * sizeof(uint32_t) <= size - table_offset), u8"Image data is invalid.");
+
+            uint32_t row_offset;
+            std::memcpy(&row_offset, tga_memory + table_offset + first_file_row * sizeof(uint32_t), sizeof(row_offset));
+            CHECK_EXCEPTION((row_offset >= pixel_data_offset) && (row_offset <= size), u8"Image data is invalid.");
+            rle_state.iterator = tga_memory + row_offset;
+        }
+        else
+        {
+            for(size_t iy = 0; iy < first_file_row; ++iy)
+            {
+                tga_rle_decode_row(&rle_state, file_pixel_size, nullptr, image_width);
+            }
+        }
+    }
+
+    std::vector<uint8_t> region_row(width * file_pixel_size);
+    return convert_tga_rows(&region_header, format, conversion, [&](size_t)
+    {
+        tga_rle_decode_row(&rle_state, file_pixel_size, nullptr, file_column);
+        tga_rle_decode_row(&rle_state, file_pixel_size, region_row.data(), width);
+        tga_rle_decode_row(&rle_state, file_pixel_size, nullptr, image_width - file_column - width);
+        return static_cast<const uint8_t*>(region_row.data());
+    });
+}
+
+static void read_tga_file(std::ifstream& file, uint64_t offset, size_t size, _Out_writes_(size) void* target)
+{
+    file.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+    file.read(static_cast<char*>(target), size);
+    CHECK_EXCEPTION(file.good(), u8"Could not read image file.");
+}
+
+// The file is read sequentially through a buffer, one row at a time, so memory use is bounded by the
+// width of the image.  The size is limited only by the sixteen bit dimensions of the format.
+Tiled_bitmap decode_tiled_bitmap_from_tga_file(_In_z_ const char* file_name, bool premultiply_alpha, const Tiled_bitmap_options& options)
+{
+    std::ifstream file(file_name, std::ios::in | std::ios::binary | std::ios::ate);
+    CHECK_EXCEPTION(file.good(), u8"Could not open image file.");
+    const auto file_size = static_cast<uint64_t>(file.tellg());
+
+    TGA_header header;
+    CHECK_EXCEPTION(file_size >= sizeof(TGA_header), u8"Image data is invalid.");
+    read_tga_file(file, 0, sizeof(header), &header);
+    validate_tga_header(&header, UINT16_MAX);
+
+    TGA_extension_area extension_area;
+    bool has_extension_area = false;
+    if(file_size >= sizeof(TGA_header) + sizeof(TGA_footer))
+    {
+        TGA_footer footer;
+        read_tga_file(file, file_size - sizeof(TGA_footer), sizeof(footer), &footer);
+        if(has_tga_extension_area(&footer, static_cast<size_t>(file_size)))
+        {
+            read_tga_file(file, footer.extension_area_offset, sizeof(extension_area), &extension_area);
+            has_extension_area = extension_area.extension_size >= sizeof(TGA_extension_area);
+        }
+    }
+
+    Alpha_conversion conversion;
+    const Pixel_format format = get_decoded_format(&header, get_alpha_type(&header, has_extension_area ? &extension_area : nullptr), premultiply_alpha, &conversion);
+
+    const uint64_t pixel_data_offset = get_pixel_data_offset(&header);
+    CHECK_EXCEPTION(pixel_data_offset <= file_size, u8"Image data is invalid.");
+
+    const size_t file_pixel_size = header.bits_per_pixel / 8;
+    const size_t row_size = static_cast<size_t>(header.image_width) * file_pixel_size;
+    const bool is_rle = header.image_type == TGA_image_type::RLE_true_color;
+    CHECK_EXCEPTION(is_rle || (static_cast<uint64_t>(row_size) * header.image_height <= file_size - pixel_data_offset), u8"Image data is invalid.");
+
+    Tiled_bitmap bitmap(header.image_width, header.image_height, format, options);
+
+    // Encoded data is buffered so that a whole row, even if every packet is a single raw pixel, is
+    // available before each row is decoded.
+    const size_t maximum_encoded_row_size = is_rle ? static_cast<size_t>(header.image_width) * (file_pixel_size + 1) : row_size;
+    std::vector<uint8_t> encoded(2 * maximum_encoded_row_size);
+    size_t encoded_begin = 0;
+    size_t encoded_end = 0;
+    uint64_t file_remaining = file_size - pixel_data_offset;
+    file.seekg(static_cast<std::streamoff>(pixel_data_offset), std::ios::beg);
+
+    const size_t pixel_size = get_bytes_per_pixel(format);
+    std::vector<uint8_t> rle_row(is_rle ? row_size : 0);
+    std::vector<uint8_t> target_row(header.image_width * pixel_size);
+    TGA_rle_state rle_state{nullptr, nullptr, {}, false, 0};
+    for(unsigned int iy = 0; iy < header.image_height; ++iy)
+    {
+        if((encoded_end - encoded_begin < maximum_encoded_row_size) && (file_remaining > 0))
+        {
+            encoded_end = std::copy(encoded.begin() + encoded_begin, encoded.begin() + encoded_end, encoded.begin()) - encoded.begin();
+            encoded_begin = 0;
+
+            const size_t read_size = static_cast<size_t>(std::min<uint64_t>(encoded.size() - encoded_end, file_remaining));
+            file.read(reinterpret_cast<char*>(&encoded[encoded_end]), read_size);
+            CHECK_EXCEPTION(file.good(), u8"Could not read image file.");
+            encoded_end += read_size;
+            file_remaining -= read_size;
+        }
+
+        const uint8_t* source_row = &encoded[encoded_begin];
+        if(is_rle)
+        {
+            rle_state.iterator = &encoded[0] + encoded_begin;
+            rle_state.end_iterator = &encoded[0] + encoded_end;
+            tga_rle_decode_row(&rle_state, file_pixel_size, rle_row.data(), header.image_width);
+            encoded_begin = rle_state.iterator - &encoded[0];
+            source_row = rle_row.data();
+        }
+        else
+        {
+            encoded_begin += row_size;
+        }
+
+        convert_tga_row(&header, source_row, format, conversion, target_row.data());
+
+        const unsigned int target_y = is_top_to_bottom(header.image_descriptor) ? iy : header.image_height - iy - 1;
+        bitmap.write_region(0, target_y, header.image_width, 1, target_row.data(), target_row.size());
     }
 
     // Return value optimization expected.
@@ -210,18 +852,87 @@ std::vector<uint8_t> encode_tga_from_bitmap(const Bitmap& bitmap)
     CHECK_EXCEPTION(bitmap.width <= max_dimension, u8"Image data is invalid.");
     CHECK_EXCEPTION(bitmap.height <= max_dimension, u8"Image data is invalid.");
 
-    std::vector<uint8_t> tga(sizeof(TGA_header) + bitmap.bitmap.size() * sizeof(Color_rgb));
+    const size_t pixel_size = get_bytes_per_pixel(bitmap.format);
+    const size_t pixel_count = static_cast<size_t>(bitmap.width) * bitmap.height;
+    CHECK_EXCEPTION(bitmap.bitmap.size() == pixel_count * pixel_size, u8"Image data is invalid.");
+
+    // Images with alpha carry an extension area so that readers know whether alpha is pre-multiplied.
+    const bool has_alpha = bitmap.format != Pixel_format::Rgb;
+    const size_t pixel_data_size = pixel_count * pixel_size;
+    const size_t extension_size = has_alpha ? sizeof(TGA_extension_area) + sizeof(TGA_footer) : 0;
+    std::vector<uint8_t> tga(sizeof(TGA_header) + pixel_data_size + extension_size);
 
     TGA_header* header = reinterpret_cast<TGA_header*>(tga.data());
     header->color_map_type = TGA_color_map::Has_no_color_map;
     header->image_type = TGA_image_type::True_color;
     header->image_width = static_cast<decltype(header->image_width)>(bitmap.width);
     header->image_height = static_cast<decltype(header->image_height)>(bitmap.height);
-    header->bits_per_pixel = sizeof(Color_rgb) * 8;
+    header->bits_per_pixel = static_cast<uint8_t>(pixel_size * 8);
+    header->image_descriptor |= top_to_bottom_bit();
+    if(has_alpha)
+    {
+        header->image_descriptor |= 8;
+    }
+
+    // Targa stores pixels as BGR or BGRA.
+    uint8_t* target = &tga[sizeof(TGA_header)];
+    for(size_t ix = 0; ix < pixel_data_size; ix += pixel_size)
+    {
+        target[ix] = bitmap.bitmap[ix + 2];
+        target[ix + 1] = bitmap.bitmap[ix + 1];
+        target[ix + 2] = bitmap.bitmap[ix];
+        if(has_alpha)
+        {
+            target[ix + 3] = bitmap.bitmap[ix + 3];
+        }
+    }
+
+    if(has_alpha)
+    {
+        const size_t extension_area_offset = sizeof(TGA_header) + pixel_data_size;
+        TGA_extension_area* extension_area = reinterpret_cast<TGA_extension_area*>(&tga[extension_area_offset]);
+        extension_area->extension_size = sizeof(TGA_extension_area);
+        extension_area->attributes_type = bitmap.format == Pixel_format::Rgba_premultiplied ? TGA_alpha_type::Premultiplied_alpha : TGA_alpha_type::Alpha_exists;
+
+        TGA_footer* footer = reinterpret_cast<TGA_footer*>(&tga[extension_area_offset + sizeof(TGA_extension_area)]);
+        footer->extension_area_offset = static_cast<uint32_t>(extension_area_offset);
+        std::copy(tga_signature, tga_signature + sizeof(tga_signature), footer->signature);
+    }
+
+    // Return value optimization expected.
+    return tga;
+}
+
+std::vector<uint8_t> encode_tga_from_paletted_bitmap(const Paletted_bitmap& bitmap)
+{
+    CHECK_EXCEPTION(bitmap.width <= max_dimension, u8"Image data is invalid.");
+    CHECK_EXCEPTION(bitmap.height <= max_dimension, u8"Image data is invalid.");
+    CHECK_EXCEPTION(bitmap.indices.size() == static_cast<size_t>(bitmap.width) * bitmap.height, u8"Image data is invalid.");
+    CHECK_EXCEPTION((bitmap.palette.size() > 0) && (bitmap.palette.size() <= 256), u8"Image data is invalid.");
+
+    const size_t color_map_size = bitmap.palette.size() * sizeof(Color_rgb);
+    std::vector<uint8_t> tga(sizeof(TGA_header) + color_map_size + bitmap.indices.size());
+
+    TGA_header* header = reinterpret_cast<TGA_header*>(tga.data());
+    header->color_map_type = TGA_color_map::Has_color_map;
+    header->image_type = TGA_image_type::Color_mapped;
+    header->color_map_length = static_cast<decltype(header->color_map_length)>(bitmap.palette.size());
+    header->color_map_bits_per_pixel = sizeof(Color_rgb) * 8;
+    header->image_width = static_cast<decltype(header->image_width)>(bitmap.width);
+    header->image_height = static_cast<decltype(header->image_height)>(bitmap.height);
+    header->bits_per_pixel = 8;
     header->image_descriptor |= top_to_bottom_bit();
 
-    const auto pixel_start = reinterpret_cast<const uint8_t*>(bitmap.bitmap.data());
-    std::copy(pixel_start, pixel_start + bitmap.bitmap.size() * sizeof(Color_rgb), &tga[sizeof(TGA_header)]);
+    // Color map entries are stored as BGR.
+    uint8_t* color_map = &tga[sizeof(TGA_header)];
+    for(const auto& color : bitmap.palette)
+    {
+        *color_map++ = color.blue;
+        *color_map++ = color.green;
+        *color_map++ = color.red;
+    }
+
+    std::copy(bitmap.indices.cbegin(), bitmap.indices.cend(), color_map);
 
     // Return value optimization expected.
     return tga;
@@ -3,9 +3,46 @@
 namespace ImageProcessing
 {
 
+// State of the RLE decoder at the start of a stored row.  Packets may span rows, so the packet in progress is kept.
+struct TGA_scanline_start
+{
+    size_t offset;                      // Offset in bytes from the beginning of the file.
+    uint8_t run_pixel[4];
+    uint8_t remaining_count;
+    bool is_run;
+};
+
+// Start of each stored row of an RLE image, so repeated region decodes need not skip the rows above the region.
+// Filled in by the first decode_region_from_tga_memory that is given it.  An index belongs to exactly one file.
+// It is refilled if the file size, header or footer differ, or if the row it is about to be used for does not
+// end where the index says the next row starts.  These checks cost the same whatever the file size, so they catch
+// most, but not all, other files.
+struct TGA_scanline_index
+{
+    size_t file_size;
+    uint8_t header[18];                 // Copy of the file's TGA_header.
+    uint8_t footer[26];                 // Copy of the last bytes of the file, where a TGA_footer is stored.
+    std::vector<TGA_scanline_start> starts;
+};
+
 bool is_tga_file_name(_In_z_ const char* file_name);
 struct Bitmap decode_bitmap_from_tga_memory(_In_reads_(size) const uint8_t* tga_memory, size_t size);
+// premultiply_alpha multiplies color by alpha for files whose alpha is coverage.  Files that mark alpha as retained
+// data, rather than coverage, decode to Rgba with alpha and color exactly as stored.  Files with no alpha or ignorable
+// alpha decode as opaque, and premultiplied files decode to Rgba_premultiplied without being multiplied again.
+struct Bitmap decode_bitmap_from_tga_memory(_In_reads_(size) const uint8_t* tga_memory, size_t size, bool premultiply_alpha);
+// Returns the postage stamp image if the file has one.  Otherwise the image is decoded at a reduced size, see get_preview_reduction.
+struct Bitmap decode_preview_from_tga_memory(_In_reads_(size) const uint8_t* tga_memory, size_t size, unsigned int preview_size);
+struct Bitmap decode_preview_from_tga_memory(_In_reads_(size) const uint8_t* tga_memory, size_t size, unsigned int preview_size, bool premultiply_alpha);
+// Decodes the width by height pixels at x, y, which must be inside the image.  index may be null.
+struct Bitmap decode_region_from_tga_memory(_In_reads_(size) const uint8_t* tga_memory, size_t size,
+                                            unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+struct Bitmap decode_region_from_tga_memory(_In_reads_(size) const uint8_t* tga_memory, size_t size,
+                                            unsigned int x, unsigned int y, unsigned int width, unsigned int height,
+                                            bool premultiply_alpha, _Inout_opt_ TGA_scanline_index* index);
+class Tiled_bitmap decode_tiled_bitmap_from_tga_file(_In_z_ const char* file_name, bool premultiply_alpha, const struct Tiled_bitmap_options& options);
 std::vector<uint8_t> encode_tga_from_bitmap(const struct Bitmap& bitmap);
+std::vector<uint8_t> encode_tga_from_paletted_bitmap(const struct Paletted_bitmap& bitmap);
 
 }
 